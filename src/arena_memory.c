@@ -0,0 +1,69 @@
+#define _DEFAULT_SOURCE
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+/* Huge page size assumed for MAP_HUGETLB, the default one on x86-64 and arm64 */
+#define CLAY_LUA_HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+/*
+ * Allocates the memory for a clay arena.
+ * With hugePages set it tries to back the arena with huge pages, so the
+ * layout pass touching the whole arena every frame misses the TLB less.
+ * *mappedSize is the length that was mapped, to give to clay_lua_freeArena,
+ * or 0 if the memory came from malloc.
+ */
+void *
+clay_lua_allocArena(size_t size, int hugePages, size_t *mappedSize)
+{
+  *mappedSize = 0;
+#if defined(__linux__) && defined(MAP_ANONYMOUS)
+  if (hugePages)
+  {
+    void *memory = MAP_FAILED;
+    size_t length = size;
+#ifdef MAP_HUGETLB
+    /* Explicit huge pages only work if the system reserved some, fall back to transparent ones */
+    length = (size + CLAY_LUA_HUGE_PAGE_SIZE - 1) & ~(CLAY_LUA_HUGE_PAGE_SIZE - 1);
+    memory = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (memory == MAP_FAILED)
+    {
+      length = size;
+      memory = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+      if (memory != MAP_FAILED) madvise(memory, length, MADV_HUGEPAGE);
+#endif
+    }
+    if (memory != MAP_FAILED)
+    {
+      *mappedSize = length;
+      return memory;
+    }
+  }
+#else
+  (void)hugePages;
+#endif
+  return malloc(size);
+}
+
+/* Frees memory from clay_lua_allocArena, given the mappedSize it returned */
+void
+clay_lua_freeArena(void *memory, size_t mappedSize)
+{
+  if (!memory) return;
+#if defined(__linux__) && defined(MAP_ANONYMOUS)
+  if (mappedSize > 0)
+  {
+    munmap(memory, mappedSize);
+    return;
+  }
+#else
+  (void)mappedSize;
+#endif
+  free(memory);
+}
@@ -17,6 +17,12 @@
 // SIMD includes on supported platforms
 #if !defined(CLAY_DISABLE_SIMD) && (defined(__x86_64__) || defined(_M_X64) || defined(_M_AMD64))
 #include <emmintrin.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 #elif !defined(CLAY_DISABLE_SIMD) && defined(__aarch64__)
 #include <arm_neon.h>
 #endif
@@ -217,6 +223,8 @@ typedef CLAY_PACKED_ENUM {
     CLAY__ELEMENT_CONFIG_TYPE_SHARED,
 } Clay__ElementConfigType;
 
+#define CLAY__ELEMENT_CONFIG_TYPE_COUNT (CLAY__ELEMENT_CONFIG_TYPE_SHARED + 1)
+
 // Element Configs ---------------------------
 // Layout
 typedef CLAY_PACKED_ENUM {
@@ -534,18 +542,45 @@ typedef struct {
     void *userData;
 } Clay_ErrorHandler;
 
+// Everything that decides how much memory a context needs, see Clay_InitializeWithOptions().
+typedef struct Clay_ContextOptions {
+    int32_t maxElementCount;
+    int32_t maxMeasureTextCacheWordCount;
+    // Alternates between two render command buffers, so the commands returned by Clay_EndLayout()
+    // (and the strings they point to) stay valid until the Clay_EndLayout() after the next one.
+    bool doubleBufferRenderCommands;
+    // Sizes and positions independent layout trees (the root and its floating elements) at the same time
+    // using the function given to Clay_SetParallelForFunction(). Needs some extra memory per element.
+    bool parallelLayoutRoots;
+    // Copies the sizes and sizing rules of every element into contiguous arrays in breadth first order before sizing,
+    // so the sizing passes read them in order instead of following child indexes and config pointers.
+    // Faster on large layouts, needs some extra memory per element. Not used for roots laid out in parallel.
+    bool compactLayoutSizing;
+    // Keeps the sizes of the previous frame and reuses them for subtrees that were declared the same way and got the
+    // same size from their parent, instead of sizing them again. Positions and render commands are still generated
+    // for every element. Needs some extra memory per element. Sizing along each axis doesn't use it with compactLayoutSizing.
+    bool retainedLayoutSizing;
+    // Keeps the bounding boxes Clay_SetPointerState() tests after each layout and sorts them into a uniform grid, so
+    // further calls before the next layout only test the elements near the pointer. Needs some extra memory per element.
+    bool pointerHitTestGrid;
+} Clay_ContextOptions;
+
 // Function Forward Declarations ---------------------------------
 // Public API functions ---
 uint32_t Clay_MinMemorySize(void);
+uint32_t Clay_MinMemorySizeWithOptions(Clay_ContextOptions options);
 Clay_Arena Clay_CreateArenaWithCapacityAndMemory(uint32_t capacity, void *offset);
 void Clay_SetPointerState(Clay_Vector2 position, bool pointerDown);
 Clay_Context* Clay_Initialize(Clay_Arena arena, Clay_Dimensions layoutDimensions, Clay_ErrorHandler errorHandler);
+Clay_Context* Clay_InitializeWithOptions(Clay_Arena arena, Clay_Dimensions layoutDimensions, Clay_ErrorHandler errorHandler, Clay_ContextOptions options);
 Clay_Context* Clay_GetCurrentContext(void);
 void Clay_SetCurrentContext(Clay_Context* context);
 void Clay_UpdateScrollContainers(bool enableDragScrolling, Clay_Vector2 scrollDelta, float deltaTime);
 void Clay_SetLayoutDimensions(Clay_Dimensions dimensions);
 void Clay_BeginLayout(void);
 Clay_RenderCommandArray Clay_EndLayout(void);
+void Clay_EndLayoutDeclaration(void);
+Clay_RenderCommandArray Clay_FinishLayout(void);
 Clay_ElementId Clay_GetElementId(Clay_String idString);
 Clay_ElementId Clay_GetElementIdWithIndex(Clay_String idString, uint32_t index);
 Clay_ElementData Clay_GetElementData (Clay_ElementId id);
@@ -556,6 +591,7 @@ Clay_ScrollContainerData Clay_GetScrollContainerData(Clay_ElementId id);
 Clay_TextElementConfig * Clay__StoreTextElementConfig(Clay_TextElementConfig config);
 void Clay_SetMeasureTextFunction(Clay_Dimensions (*measureTextFunction)(Clay_StringSlice text, Clay_TextElementConfig *config, void *userData), void *userData);
 void Clay_SetQueryScrollOffsetFunction(Clay_Vector2 (*queryScrollOffsetFunction)(uint32_t elementId, void *userData), void *userData);
+void Clay_SetParallelForFunction(void (*parallelForFunction)(void (*taskFunction)(void *taskData, int32_t taskIndex), void *taskData, int32_t taskCount, void *userData), void *userData);
 Clay_RenderCommand * Clay_RenderCommandArray_Get(Clay_RenderCommandArray* array, int32_t index);
 void Clay_SetDebugModeEnabled(bool enabled);
 bool Clay_IsDebugModeEnabled(void);
@@ -599,6 +635,14 @@ extern uint32_t Clay__debugViewWidth;
 #define CLAY__MAXFLOAT 3.40282346638528859812e+38F
 #endif
 
+#ifndef CLAY__PARALLEL_TEXT_WRAP_MAX_TASKS
+#define CLAY__PARALLEL_TEXT_WRAP_MAX_TASKS 64
+#endif
+
+#ifndef CLAY__PARALLEL_TEXT_WRAP_MIN_ELEMENTS_PER_TASK
+#define CLAY__PARALLEL_TEXT_WRAP_MIN_ELEMENTS_PER_TASK 32
+#endif
+
 Clay_LayoutConfig CLAY_LAYOUT_DEFAULT = CLAY__DEFAULT_STRUCT;
 
 Clay_Color Clay__Color_DEFAULT = CLAY__DEFAULT_STRUCT;
@@ -666,7 +710,19 @@ typedef struct                                   \
                                                  \
 CLAY__ARRAY_DEFINE_FUNCTIONS(typeName, arrayName) \
 
-Clay_Context *Clay__currentContext;
+// With CLAY_THREAD_LOCAL_CONTEXT each thread has its own current context, so a context can be laid out
+// on a background thread (see Clay_FinishLayout) while another thread keeps using a different one.
+#ifdef CLAY_THREAD_LOCAL_CONTEXT
+    #if defined(_MSC_VER)
+        #define CLAY__THREAD_LOCAL __declspec(thread)
+    #else
+        #define CLAY__THREAD_LOCAL __thread
+    #endif
+#else
+    #define CLAY__THREAD_LOCAL
+#endif
+
+CLAY__THREAD_LOCAL Clay_Context *Clay__currentContext;
 int32_t Clay__defaultMaxElementCount = 8192;
 int32_t Clay__defaultMaxMeasureTextWordCacheCount = 16384;
 
@@ -746,6 +802,8 @@ typedef struct {
     Clay_String text;
     Clay_Dimensions preferredDimensions;
     int32_t elementIndex;
+    int32_t measuredWordsStartIndex;
+    bool containsNewlines;
     Clay__WrappedTextLineArraySlice wrappedLines;
 } Clay__TextElementData;
 
@@ -765,7 +823,14 @@ typedef struct {
     Clay_Dimensions minDimensions;
     Clay_LayoutConfig *layoutConfig;
     Clay__ElementConfigArraySlice elementConfigs;
+    // Bit (1 << type) is set for every config type in elementConfigs, configIndexes holds the first config of each type
+    uint8_t configTypes;
+    uint8_t configIndexes[CLAY__ELEMENT_CONFIG_TYPE_COUNT];
     uint32_t id;
+    // Only set with retainedLayoutSizing: a hash of everything in the subtree that sizing depends on, and how many
+    // elements were declared inside this one (floating ones included), which come right after it in layoutElements
+    uint32_t fingerprint;
+    int32_t descendantCount;
 } Clay_LayoutElement;
 
 CLAY__ARRAY_DEFINE(Clay_LayoutElement, Clay_LayoutElementArray)
@@ -800,14 +865,25 @@ typedef struct { // todo get this struct into a single cache line
     Clay_LayoutElement* layoutElement;
     void (*onHoverFunction)(Clay_ElementId elementId, Clay_PointerData pointerInfo, intptr_t userData);
     intptr_t hoverFunctionUserData;
-    int32_t nextIndex;
     uint32_t generation;
     uint32_t idAlias;
     Clay__DebugElementData *debugData;
+    // Where the element was in the previous frame with retainedLayoutSizing, valid if retainedGeneration is the current generation
+    uint32_t retainedFingerprint;
+    int32_t retainedIndex;
+    uint32_t retainedGeneration;
 } Clay_LayoutElementHashMapItem;
 
 CLAY__ARRAY_DEFINE(Clay_LayoutElementHashMapItem, Clay__LayoutElementHashMapItemArray)
 
+// A slot of the layout element hash map, ids are stored inline so probing doesn't touch the items
+typedef struct {
+    uint32_t id;
+    int32_t itemIndex; // -1 if the slot is empty
+} Clay__LayoutElementHashMapSlot;
+
+CLAY__ARRAY_DEFINE(Clay__LayoutElementHashMapSlot, Clay__LayoutElementHashMapSlotArray)
+
 typedef struct {
     int32_t startOffset;
     int32_t length;
@@ -847,6 +923,58 @@ typedef struct {
 
 CLAY__ARRAY_DEFINE(Clay__LayoutElementTreeRoot, Clay__LayoutElementTreeRootArray)
 
+// Scheduling data for laying out a tree root in parallel with the others, see Clay__ScheduleLayoutRoots()
+typedef struct {
+    int32_t level; // Roots only depend on roots of lower levels
+    int32_t elementCount;
+    int32_t firstElement; // Start of this root's slice of the scratch buffers
+    Clay_RenderCommandArray renderCommands; // This root's slice of the render command array
+    bool exceededCapacity;
+} Clay__LayoutRootTask;
+
+CLAY__ARRAY_DEFINE(Clay__LayoutRootTask, Clay__LayoutRootTaskArray)
+
+// Where the sizes of a set of elements live: in the layout elements themselves, or in the compact sizing arrays
+typedef struct {
+    Clay_Dimensions *dimensions;
+    Clay_Dimensions *minDimensions;
+    int32_t stride; // Bytes from the dimensions of one element to the next
+} Clay__DimensionsView;
+
+CLAY__ARRAY_DEFINE(Clay_Dimensions, Clay__DimensionsArray)
+CLAY__ARRAY_DEFINE(Clay_Sizing, Clay__SizingArray)
+CLAY__ARRAY_DEFINE(uint8_t, Clay__uint8_tArray)
+
+// What the sizing passes need to know about a compact element besides its sizes
+typedef CLAY_PACKED_ENUM {
+    CLAY__COMPACT_RESIZABLE_X = 1, // Can be grown or compressed by its parent along the axis
+    CLAY__COMPACT_RESIZABLE_Y = 2,
+    CLAY__COMPACT_SCROLL_X = 4,
+    CLAY__COMPACT_SCROLL_Y = 8,
+    CLAY__COMPACT_LEFT_TO_RIGHT = 16,
+} Clay__CompactElementFlag;
+
+// An element Clay_SetPointerState() tests the pointer against, in the order it tests them
+typedef struct {
+    Clay_BoundingBox boundingBox; // Already offset by the pointerOffset of its tree root
+    Clay_LayoutElementHashMapItem *hashMapItem;
+    int32_t rootIndex;
+    bool inGrid; // False if it is in pointerGridLargeTargets instead
+} Clay__PointerTarget;
+
+CLAY__ARRAY_DEFINE(Clay__PointerTarget, Clay__PointerTargetArray)
+
+typedef enum {
+    CLAY__POINTER_GRID_DECLARING, // The elements are being declared, there is nothing to index
+    CLAY__POINTER_GRID_EMPTY, // The layout is done, but the pointer wasn't tested against it yet
+    CLAY__POINTER_GRID_RECORDED, // The targets were recorded while testing the pointer
+    CLAY__POINTER_GRID_BUILT,
+} Clay__PointerGridState;
+
+#define CLAY__POINTER_GRID_MAX_COLUMNS 64
+// Targets over more cells than this are tested for any position instead of being added to every cell
+#define CLAY__POINTER_GRID_MAX_TARGET_CELLS 16
+
 struct Clay_Context {
     int32_t maxElementCount;
     int32_t maxMeasureTextCacheWordCount;
@@ -867,6 +995,16 @@ struct Clay_Context {
     uintptr_t arenaResetOffset;
     void *measureTextUserData;
     void *queryScrollOffsetUserData;
+    void (*parallelForFunction)(void (*taskFunction)(void *taskData, int32_t taskIndex), void *taskData, int32_t taskCount, void *userData);
+    void *parallelForUserData;
+    bool doubleBufferRenderCommands;
+    int32_t renderCommandBufferIndex;
+    Clay_RenderCommandArray renderCommandBuffers[2];
+    Clay__charArray dynamicStringDataBuffers[2];
+    bool parallelLayoutRoots;
+    bool compactLayoutSizing;
+    bool retainedLayoutSizing;
+    bool pointerHitTestGrid;
     Clay_Arena internalArena;
     // Layout Elements / Render Commands
     Clay_LayoutElementArray layoutElements;
@@ -878,6 +1016,7 @@ struct Clay_Context {
     Clay__int32_tArray imageElementPointers;
     Clay__int32_tArray reusableElementIndexBuffer;
     Clay__int32_tArray layoutElementClipElementIds;
+    Clay__int32_tArray layoutElementHashMapItems; // Index in layoutElementsHashMapInternal of each layout element's item, -1 if it couldn't be added
     // Configs
     Clay__LayoutConfigArray layoutConfigs;
     Clay__ElementConfigArray elementConfigs;
@@ -894,7 +1033,8 @@ struct Clay_Context {
     Clay__LayoutElementTreeNodeArray layoutElementTreeNodeArray1;
     Clay__LayoutElementTreeRootArray layoutElementTreeRoots;
     Clay__LayoutElementHashMapItemArray layoutElementsHashMapInternal;
-    Clay__int32_tArray layoutElementsHashMap;
+    Clay__LayoutElementHashMapSlotArray layoutElementsHashMap; // Open addressing with linear probing, the capacity is a power of two
+    int32_t layoutElementsHashMapShift; // Turns a multiplied id into a slot, see Clay__LayoutElementHashMapSlotIndex()
     Clay__MeasureTextCacheItemArray measureTextHashMapInternal;
     Clay__int32_tArray measureTextHashMapInternalFreeList;
     Clay__int32_tArray measureTextHashMap;
@@ -906,6 +1046,34 @@ struct Clay_Context {
     Clay__boolArray treeNodeVisited;
     Clay__charArray dynamicStringData;
     Clay__DebugElementDataArray debugElementData;
+    // Only allocated with parallelLayoutRoots
+    Clay__LayoutRootTaskArray layoutRootTasks;
+    Clay__int32_tArray layoutElementRoots; // Index of the root element of the tree each layout element belongs to
+    Clay__int32_tArray layoutRootIndexes; // Index in layoutElementTreeRoots of each root element
+    Clay__int32_tArray layoutRootOrder; // Tree roots grouped by level
+    // Only allocated with compactLayoutSizing, see Clay__BuildCompactLayout()
+    Clay__int32_tArray compactElementIndexes; // Layout element of each compact element
+    Clay__int32_tArray compactIndexes; // Compact element of each layout element
+    Clay__int32_tArray compactRootStarts; // First compact element of each tree root
+    Clay__int32_tArray compactFirstChildren;
+    Clay__int32_tArray compactChildCounts;
+    Clay__int32_tArray compactChildGaps;
+    Clay__DimensionsArray compactPadding; // Total padding along each axis
+    Clay__DimensionsArray compactDimensions;
+    Clay__DimensionsArray compactMinDimensions;
+    Clay__SizingArray compactSizing;
+    Clay__uint8_tArray compactFlags;
+    // Only allocated with retainedLayoutSizing, indexed by layout element and by generation parity so the previous frame is kept
+    Clay__DimensionsArray retainedDimensions[2]; // Final sizes
+    Clay__DimensionsArray retainedPropagatedDimensions[2]; // Sizes once heights were propagated to parents, before sizing along the Y axis
+    // Only allocated with pointerHitTestGrid, see Clay__BuildPointerGrid()
+    Clay__PointerGridState pointerGridState;
+    Clay__PointerTargetArray pointerTargets;
+    Clay__int32_tArray pointerGridCells; // Where the targets of each cell start in pointerGridEntries, row by row
+    Clay__int32_tArray pointerGridEntries;
+    Clay__int32_tArray pointerGridLargeTargets;
+    int32_t pointerGridColumns; // The grid has as many rows as columns
+    Clay_Dimensions pointerGridCellSize;
 };
 
 Clay_Context* Clay__Context_Allocate_Arena(Clay_Arena *arena) {
@@ -962,18 +1130,19 @@ Clay_ElementConfig Clay__AttachElementConfig(Clay_ElementConfigUnion config, Cla
         return CLAY__INIT(Clay_ElementConfig) CLAY__DEFAULT_STRUCT;
     }
     Clay_LayoutElement *openLayoutElement = Clay__GetOpenLayoutElement();
+    if (!(openLayoutElement->configTypes & (1 << type))) {
+        openLayoutElement->configTypes |= (uint8_t)(1 << type);
+        openLayoutElement->configIndexes[type] = (uint8_t)openLayoutElement->elementConfigs.length;
+    }
     openLayoutElement->elementConfigs.length++;
     return *Clay__ElementConfigArray_Add(&context->elementConfigs, CLAY__INIT(Clay_ElementConfig) { .type = type, .config = config });
 }
 
 Clay_ElementConfigUnion Clay__FindElementConfigWithType(Clay_LayoutElement *element, Clay__ElementConfigType type) {
-    for (int32_t i = 0; i < element->elementConfigs.length; i++) {
-        Clay_ElementConfig *config = Clay__ElementConfigArraySlice_Get(&element->elementConfigs, i);
-        if (config->type == type) {
-            return config->config;
-        }
+    if (!(element->configTypes & (1 << type))) {
+        return CLAY__INIT(Clay_ElementConfigUnion) { NULL };
     }
-    return CLAY__INIT(Clay_ElementConfigUnion) { NULL };
+    return element->elementConfigs.internalArray[element->configIndexes[type]].config;
 }
 
 Clay_ElementId Clay__HashNumber(const uint32_t offset, const uint32_t seed) {
@@ -988,7 +1157,69 @@ Clay_ElementId Clay__HashNumber(const uint32_t offset, const uint32_t seed) {
     return CLAY__INIT(Clay_ElementId) { .id = hash + 1, .offset = offset, .baseId = seed, .stringId = CLAY__STRING_DEFAULT }; // Reserve the hash result of zero as "null id"
 }
 
+#ifdef CLAY_FAST_HASH
+// Word-at-a-time hashing, enabled with CLAY_FAST_HASH. Keys are consumed eight bytes per step instead of one,
+// which matters for long string ids and text contents that are re-hashed every frame.
+// Ids produced with this option differ from the default hash, so they are only stable between builds that agree on it.
+uint64_t Clay__HashReadWord(const char *chars);
+#if !defined(CLAY_DISABLE_SIMD) && (defined(__x86_64__) || defined(_M_X64) || defined(_M_AMD64))
+    uint64_t Clay__HashReadWord(const char *chars) {
+        return (uint64_t)_mm_cvtsi128_si64(_mm_loadl_epi64((const __m128i *)chars));
+    }
+#elif !defined(CLAY_DISABLE_SIMD) && defined(__aarch64__)
+    uint64_t Clay__HashReadWord(const char *chars) {
+        return vget_lane_u64(vreinterpret_u64_u8(vld1_u8((const uint8_t *)chars)), 0);
+    }
+#else
+    uint64_t Clay__HashReadWord(const char *chars) {
+        const uint8_t *bytes = (const uint8_t *)chars;
+        return (uint64_t)bytes[0] | ((uint64_t)bytes[1] << 8) | ((uint64_t)bytes[2] << 16) | ((uint64_t)bytes[3] << 24)
+            | ((uint64_t)bytes[4] << 32) | ((uint64_t)bytes[5] << 40) | ((uint64_t)bytes[6] << 48) | ((uint64_t)bytes[7] << 56);
+    }
+#endif
+
+uint64_t Clay__HashMixWord(uint64_t hash, uint64_t word) {
+    hash = (hash ^ word) * 0xbf58476d1ce4e5b9ULL;
+    return hash ^ (hash >> 31);
+}
+
+uint64_t Clay__HashBytesWide(const char *chars, int32_t length, uint64_t seed) {
+    uint64_t hash = seed ^ ((uint64_t)length * 0x9e3779b97f4a7c15ULL);
+    while (length >= 8) {
+        hash = Clay__HashMixWord(hash, Clay__HashReadWord(chars));
+        chars += 8;
+        length -= 8;
+    }
+    if (length > 0) {
+        uint64_t tail = 0;
+        for (int32_t i = 0; i < length; i++) {
+            tail |= (uint64_t)(uint8_t)chars[i] << (i * 8);
+        }
+        hash = Clay__HashMixWord(hash, tail);
+    }
+    return hash;
+}
+
+uint64_t Clay__HashFinalizeWide(uint64_t hash) {
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+}
+
+uint32_t Clay__HashFoldWide(uint64_t hash) {
+    uint32_t folded = (uint32_t)(hash >> 32);
+    return folded == 0 ? 1 : folded; // Reserve the hash result of zero as "null id"
+}
+#endif
+
 Clay_ElementId Clay__HashString(Clay_String key, const uint32_t offset, const uint32_t seed) {
+#ifdef CLAY_FAST_HASH
+    uint64_t baseWide = Clay__HashFinalizeWide(Clay__HashBytesWide(key.chars, key.length, seed));
+    uint64_t hashWide = Clay__HashFinalizeWide(baseWide + offset);
+    return CLAY__INIT(Clay_ElementId) { .id = Clay__HashFoldWide(hashWide), .offset = offset, .baseId = Clay__HashFoldWide(baseWide), .stringId = key };
+#else
     uint32_t hash = 0;
     uint32_t base = seed;
 
@@ -1009,9 +1240,21 @@ Clay_ElementId Clay__HashString(Clay_String key, const uint32_t offset, const ui
     hash += (hash << 15);
     base += (base << 15);
     return CLAY__INIT(Clay_ElementId) { .id = hash + 1, .offset = offset, .baseId = base + 1, .stringId = key }; // Reserve the hash result of zero as "null id"
+#endif
 }
 
 uint32_t Clay__HashTextWithConfig(Clay_String *text, Clay_TextElementConfig *config) {
+#ifdef CLAY_FAST_HASH
+    uint64_t hashWide = 0;
+    if (config->hashStringContents) {
+        hashWide = Clay__HashBytesWide(text->chars, CLAY__MIN(text->length, 256), 0);
+    } else {
+        hashWide = Clay__HashMixWord(hashWide, (uint64_t)(uintptr_t)text->chars);
+    }
+    hashWide = Clay__HashMixWord(hashWide, (uint64_t)config->fontId | ((uint64_t)config->fontSize << 16) | ((uint64_t)config->lineHeight << 32) | ((uint64_t)config->letterSpacing << 48));
+    hashWide = Clay__HashMixWord(hashWide, (uint64_t)(uint32_t)text->length | ((uint64_t)config->wrapMode << 32));
+    return Clay__HashFoldWide(Clay__HashFinalizeWide(hashWide));
+#else
     uint32_t hash = 0;
     uintptr_t pointerAsNumber = (uintptr_t)text->chars;
 
@@ -1056,6 +1299,56 @@ uint32_t Clay__HashTextWithConfig(Clay_String *text, Clay_TextElementConfig *con
     hash ^= (hash >> 11);
     hash += (hash << 15);
     return hash + 1; // Reserve the hash result of zero as "null id"
+#endif
+}
+
+// Layout fingerprints for retainedLayoutSizing are built with the same steps as the hashes above
+uint32_t Clay__HashFingerprint(uint32_t hash, uint32_t value) {
+    hash += value;
+    hash += (hash << 10);
+    hash ^= (hash >> 6);
+    return hash;
+}
+
+uint32_t Clay__HashFingerprintFloat(uint32_t hash, float value) {
+    union { float value; uint32_t bits; } floatBits = { value };
+    return Clay__HashFingerprint(hash, floatBits.bits);
+}
+
+uint32_t Clay__HashFingerprintDimensions(uint32_t hash, Clay_Dimensions dimensions) {
+    return Clay__HashFingerprintFloat(Clay__HashFingerprintFloat(hash, dimensions.width), dimensions.height);
+}
+
+// Hashes everything sizing an element depends on into its fingerprint, which already has the fingerprints of its children
+// mixed in as they were closed. The sizes it starts with cover text measurements and the sizes of its children.
+void Clay__FingerprintElement(Clay_LayoutElement *element) {
+    Clay_LayoutConfig *layoutConfig = element->layoutConfig;
+    uint32_t hash = element->fingerprint;
+    hash = Clay__HashFingerprint(hash, element->configTypes & ((1 << CLAY__ELEMENT_CONFIG_TYPE_FLOATING) | (1 << CLAY__ELEMENT_CONFIG_TYPE_SCROLL) | (1 << CLAY__ELEMENT_CONFIG_TYPE_IMAGE)));
+    hash = Clay__HashFingerprint(hash, (uint32_t)layoutConfig->layoutDirection | ((uint32_t)layoutConfig->sizing.width.type << 8) | ((uint32_t)layoutConfig->sizing.height.type << 16));
+    hash = Clay__HashFingerprint(hash, (uint32_t)layoutConfig->padding.left | ((uint32_t)layoutConfig->padding.right << 16));
+    hash = Clay__HashFingerprint(hash, (uint32_t)layoutConfig->padding.top | ((uint32_t)layoutConfig->padding.bottom << 16));
+    hash = Clay__HashFingerprint(hash, (uint32_t)layoutConfig->childGap | ((uint32_t)element->childrenOrTextContent.children.length << 16));
+    hash = Clay__HashFingerprint(hash, (uint32_t)element->descendantCount);
+    // The percentage shares its bits with the minimum size
+    hash = Clay__HashFingerprintFloat(hash, layoutConfig->sizing.width.size.minMax.min);
+    hash = Clay__HashFingerprintFloat(hash, layoutConfig->sizing.width.size.minMax.max);
+    hash = Clay__HashFingerprintFloat(hash, layoutConfig->sizing.height.size.minMax.min);
+    hash = Clay__HashFingerprintFloat(hash, layoutConfig->sizing.height.size.minMax.max);
+    hash = Clay__HashFingerprintDimensions(hash, element->dimensions);
+    hash = Clay__HashFingerprintDimensions(hash, element->minDimensions);
+    Clay_ScrollElementConfig *scrollConfig = Clay__FindElementConfigWithType(element, CLAY__ELEMENT_CONFIG_TYPE_SCROLL).scrollElementConfig;
+    if (scrollConfig) {
+        hash = Clay__HashFingerprint(hash, (uint32_t)scrollConfig->horizontal | ((uint32_t)scrollConfig->vertical << 1));
+    }
+    Clay_ImageElementConfig *imageConfig = Clay__FindElementConfigWithType(element, CLAY__ELEMENT_CONFIG_TYPE_IMAGE).imageElementConfig;
+    if (imageConfig) {
+        hash = Clay__HashFingerprintDimensions(hash, imageConfig->sourceDimensions);
+    }
+    hash += (hash << 3);
+    hash ^= (hash >> 11);
+    hash += (hash << 15);
+    element->fingerprint = hash;
 }
 
 Clay__MeasuredWord *Clay__AddMeasuredWord(Clay__MeasuredWord word, Clay__MeasuredWord *previousWord) {
@@ -1072,6 +1365,84 @@ Clay__MeasuredWord *Clay__AddMeasuredWord(Clay__MeasuredWord word, Clay__Measure
     }
 }
 
+// Returns the index of the first space or newline at or after index, or length if there isn't one
+int32_t Clay__FindNextWordBoundary(const char *chars, int32_t index, int32_t length);
+#if !defined(CLAY_DISABLE_SIMD) && (defined(__x86_64__) || defined(_M_X64) || defined(_M_AMD64))
+    int32_t Clay__CountTrailingZeros(uint32_t mask) {
+    #if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return (int32_t)index;
+    #else
+        return __builtin_ctz(mask);
+    #endif
+    }
+
+    int32_t Clay__FindNextWordBoundary(const char *chars, int32_t index, int32_t length) {
+        const __m128i spaces = _mm_set1_epi8(' ');
+        const __m128i newlines = _mm_set1_epi8('\n');
+    #ifdef __AVX2__
+        // Most words are short, so probe 16 bytes before switching to wider loads
+        if (index + 16 <= length) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(chars + index));
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, spaces), _mm_cmpeq_epi8(v, newlines)));
+            if (mask != 0) {
+                return index + Clay__CountTrailingZeros(mask);
+            }
+            index += 16;
+        }
+        const __m256i spaces32 = _mm256_set1_epi8(' ');
+        const __m256i newlines32 = _mm256_set1_epi8('\n');
+        while (index + 32 <= length) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(chars + index));
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, spaces32), _mm256_cmpeq_epi8(v, newlines32)));
+            if (mask != 0) {
+                return index + Clay__CountTrailingZeros(mask);
+            }
+            index += 32;
+        }
+    #endif
+        while (index + 16 <= length) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(chars + index));
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, spaces), _mm_cmpeq_epi8(v, newlines)));
+            if (mask != 0) {
+                return index + Clay__CountTrailingZeros(mask);
+            }
+            index += 16;
+        }
+        while (index < length && chars[index] != ' ' && chars[index] != '\n') {
+            index++;
+        }
+        return index;
+    }
+#elif !defined(CLAY_DISABLE_SIMD) && defined(__aarch64__)
+    int32_t Clay__FindNextWordBoundary(const char *chars, int32_t index, int32_t length) {
+        const uint8x16_t spaces = vdupq_n_u8(' ');
+        const uint8x16_t newlines = vdupq_n_u8('\n');
+        while (index + 16 <= length) {
+            uint8x16_t v = vld1q_u8((const uint8_t *)(chars + index));
+            uint8x16_t matches = vorrq_u8(vceqq_u8(v, spaces), vceqq_u8(v, newlines));
+            // Narrow each byte of the comparison down to 4 bits so the result fits in a 64 bit mask
+            uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+            if (mask != 0) {
+                return index + (int32_t)(__builtin_ctzll(mask) >> 2);
+            }
+            index += 16;
+        }
+        while (index < length && chars[index] != ' ' && chars[index] != '\n') {
+            index++;
+        }
+        return index;
+    }
+#else
+    int32_t Clay__FindNextWordBoundary(const char *chars, int32_t index, int32_t length) {
+        while (index < length && chars[index] != ' ' && chars[index] != '\n') {
+            index++;
+        }
+        return index;
+    }
+#endif
+
 Clay__MeasureTextCacheItem *Clay__MeasureTextCached(Clay_String *text, Clay_TextElementConfig *config) {
     Clay_Context* context = Clay_GetCurrentContext();
     #ifndef CLAY_WASM
@@ -1087,7 +1458,8 @@ Clay__MeasureTextCacheItem *Clay__MeasureTextCached(Clay_String *text, Clay_Text
     }
     #endif
     uint32_t id = Clay__HashTextWithConfig(text, config);
-    uint32_t hashBucket = id % (context->maxMeasureTextCacheWordCount / 32);
+    // The bucket array is sized from maxElementCount, the word count can be changed independently of it
+    uint32_t hashBucket = id % context->measureTextHashMap.capacity;
     int32_t elementIndexPrevious = 0;
     int32_t elementIndex = context->measureTextHashMap.internalArray[hashBucket];
     while (elementIndex != 0) {
@@ -1164,6 +1536,10 @@ Clay__MeasureTextCacheItem *Clay__MeasureTextCached(Clay_String *text, Clay_Text
             }
             return &Clay__MeasureTextCacheItem_DEFAULT;
         }
+        end = Clay__FindNextWordBoundary(text->chars, end, text->length);
+        if (end == text->length) {
+            break;
+        }
         char current = text->chars[end];
         if (current == ' ' || current == '\n') {
             int32_t length = end - start;
@@ -1212,19 +1588,24 @@ bool Clay__PointIsInsideRect(Clay_Vector2 point, Clay_BoundingBox rect) {
     return point.x >= rect.x && point.x <= rect.x + rect.width && point.y >= rect.y && point.y <= rect.y + rect.height;
 }
 
+// Fibonacci hashing: the top bits of the product depend on every bit of the id
+uint32_t Clay__LayoutElementHashMapSlotIndex(Clay_Context *context, uint32_t id) {
+    return (id * 2654435769u) >> context->layoutElementsHashMapShift;
+}
+
 Clay_LayoutElementHashMapItem* Clay__AddHashMapItem(Clay_ElementId elementId, Clay_LayoutElement* layoutElement, uint32_t idAlias) {
     Clay_Context* context = Clay_GetCurrentContext();
     if (context->layoutElementsHashMapInternal.length == context->layoutElementsHashMapInternal.capacity - 1) {
         return NULL;
     }
-    Clay_LayoutElementHashMapItem item = { .elementId = elementId, .layoutElement = layoutElement, .nextIndex = -1, .generation = context->generation + 1, .idAlias = idAlias };
-    uint32_t hashBucket = elementId.id % context->layoutElementsHashMap.capacity;
-    int32_t hashItemPrevious = -1;
-    int32_t hashItemIndex = context->layoutElementsHashMap.internalArray[hashBucket];
-    while (hashItemIndex != -1) { // Just replace collision, not a big deal - leave it up to the end user
-        Clay_LayoutElementHashMapItem *hashItem = Clay__LayoutElementHashMapItemArray_Get(&context->layoutElementsHashMapInternal, hashItemIndex);
-        if (hashItem->elementId.id == elementId.id) { // Collision - resolve based on generation
-            item.nextIndex = hashItem->nextIndex;
+    Clay_LayoutElementHashMapItem item = { .elementId = elementId, .layoutElement = layoutElement, .generation = context->generation + 1, .idAlias = idAlias };
+    Clay__LayoutElementHashMapSlot *slots = context->layoutElementsHashMap.internalArray;
+    uint32_t mask = (uint32_t)context->layoutElementsHashMap.capacity - 1;
+    uint32_t slot = Clay__LayoutElementHashMapSlotIndex(context, elementId.id);
+    // Items are never removed, so the first empty slot ends the probe sequence
+    for (; slots[slot].itemIndex != -1; slot = (slot + 1) & mask) { // Just replace collision, not a big deal - leave it up to the end user
+        if (slots[slot].id == elementId.id) { // Collision - resolve based on generation
+            Clay_LayoutElementHashMapItem *hashItem = Clay__LayoutElementHashMapItemArray_Get(&context->layoutElementsHashMapInternal, slots[slot].itemIndex);
             if (hashItem->generation <= context->generation) { // First collision - assume this is the "same" element
                 hashItem->elementId = elementId; // Make sure to copy this across. If the stringId reference has changed, we should update the hash item to use the new one.
                 hashItem->generation = context->generation + 1;
@@ -1241,49 +1622,54 @@ Clay_LayoutElementHashMapItem* Clay__AddHashMapItem(Clay_ElementId elementId, Cl
             }
             return hashItem;
         }
-        hashItemPrevious = hashItemIndex;
-        hashItemIndex = hashItem->nextIndex;
     }
     Clay_LayoutElementHashMapItem *hashItem = Clay__LayoutElementHashMapItemArray_Add(&context->layoutElementsHashMapInternal, item);
     hashItem->debugData = Clay__DebugElementDataArray_Add(&context->debugElementData, CLAY__INIT(Clay__DebugElementData) CLAY__DEFAULT_STRUCT);
-    if (hashItemPrevious != -1) {
-        Clay__LayoutElementHashMapItemArray_Get(&context->layoutElementsHashMapInternal, hashItemPrevious)->nextIndex = (int32_t)context->layoutElementsHashMapInternal.length - 1;
-    } else {
-        context->layoutElementsHashMap.internalArray[hashBucket] = (int32_t)context->layoutElementsHashMapInternal.length - 1;
-    }
+    slots[slot] = CLAY__INIT(Clay__LayoutElementHashMapSlot) { .id = elementId.id, .itemIndex = (int32_t)context->layoutElementsHashMapInternal.length - 1 };
     return hashItem;
 }
 
 Clay_LayoutElementHashMapItem *Clay__GetHashMapItem(uint32_t id) {
     Clay_Context* context = Clay_GetCurrentContext();
-    uint32_t hashBucket = id % context->layoutElementsHashMap.capacity;
-    int32_t elementIndex = context->layoutElementsHashMap.internalArray[hashBucket];
-    while (elementIndex != -1) {
-        Clay_LayoutElementHashMapItem *hashEntry = Clay__LayoutElementHashMapItemArray_Get(&context->layoutElementsHashMapInternal, elementIndex);
-        if (hashEntry->elementId.id == id) {
-            return hashEntry;
+    Clay__LayoutElementHashMapSlot *slots = context->layoutElementsHashMap.internalArray;
+    uint32_t mask = (uint32_t)context->layoutElementsHashMap.capacity - 1;
+    for (uint32_t slot = Clay__LayoutElementHashMapSlotIndex(context, id); slots[slot].itemIndex != -1; slot = (slot + 1) & mask) {
+        if (slots[slot].id == id) {
+            return &context->layoutElementsHashMapInternal.internalArray[slots[slot].itemIndex];
         }
-        elementIndex = hashEntry->nextIndex;
     }
     return &Clay_LayoutElementHashMapItem_DEFAULT;
 }
 
+// Adds the hash map item of a layout element and remembers which one it is, see Clay__GetLayoutElementHashMapItem()
+void Clay__AddLayoutElementHashMapItem(Clay_ElementId elementId, Clay_LayoutElement* layoutElement, uint32_t idAlias) {
+    Clay_Context* context = Clay_GetCurrentContext();
+    Clay_LayoutElementHashMapItem *hashItem = Clay__AddHashMapItem(elementId, layoutElement, idAlias);
+    int32_t itemIndex = hashItem && hashItem != &Clay_LayoutElementHashMapItem_DEFAULT ? (int32_t)(hashItem - context->layoutElementsHashMapInternal.internalArray) : -1;
+    Clay__int32_tArray_Set(&context->layoutElementHashMapItems, (int32_t)(layoutElement - context->layoutElements.internalArray), itemIndex);
+}
+
+// Same as Clay__GetHashMapItem(layoutElement->id) without hashing, for layout elements of the current layout
+Clay_LayoutElementHashMapItem *Clay__GetLayoutElementHashMapItem(Clay_Context *context, Clay_LayoutElement *layoutElement) {
+    int32_t itemIndex = context->layoutElementHashMapItems.internalArray[layoutElement - context->layoutElements.internalArray];
+    if (itemIndex < 0) {
+        // Either the map was full or the element never got an id, look it up like before
+        return Clay__GetHashMapItem(layoutElement->id);
+    }
+    return &context->layoutElementsHashMapInternal.internalArray[itemIndex];
+}
+
 void Clay__GenerateIdForAnonymousElement(Clay_LayoutElement *openLayoutElement) {
     Clay_Context* context = Clay_GetCurrentContext();
     Clay_LayoutElement *parentElement = Clay_LayoutElementArray_Get(&context->layoutElements, Clay__int32_tArray_GetValue(&context->openLayoutElementStack, context->openLayoutElementStack.length - 2));
     Clay_ElementId elementId = Clay__HashNumber(parentElement->childrenOrTextContent.children.length, parentElement->id);
     openLayoutElement->id = elementId.id;
-    Clay__AddHashMapItem(elementId, openLayoutElement, 0);
+    Clay__AddLayoutElementHashMapItem(elementId, openLayoutElement, 0);
     Clay__StringArray_Add(&context->layoutElementIdStrings, elementId.stringId);
 }
 
 bool Clay__ElementHasConfig(Clay_LayoutElement *layoutElement, Clay__ElementConfigType type) {
-    for (int32_t i = 0; i < layoutElement->elementConfigs.length; i++) {
-        if (Clay__ElementConfigArraySlice_Get(&layoutElement->elementConfigs, i)->type == type) {
-            return true;
-        }
-    }
-    return false;
+    return (layoutElement->configTypes & (1 << type)) != 0;
 }
 
 void Clay__CloseElement(void) {
@@ -1295,14 +1681,11 @@ void Clay__CloseElement(void) {
     Clay_LayoutConfig *layoutConfig = openLayoutElement->layoutConfig;
     bool elementHasScrollHorizontal = false;
     bool elementHasScrollVertical = false;
-    for (int32_t i = 0; i < openLayoutElement->elementConfigs.length; i++) {
-        Clay_ElementConfig *config = Clay__ElementConfigArraySlice_Get(&openLayoutElement->elementConfigs, i);
-        if (config->type == CLAY__ELEMENT_CONFIG_TYPE_SCROLL) {
-            elementHasScrollHorizontal = config->config.scrollElementConfig->horizontal;
-            elementHasScrollVertical = config->config.scrollElementConfig->vertical;
-            context->openClipElementStack.length--;
-            break;
-        }
+    if (Clay__ElementHasConfig(openLayoutElement, CLAY__ELEMENT_CONFIG_TYPE_SCROLL)) {
+        Clay_ScrollElementConfig *scrollConfig = Clay__FindElementConfigWithType(openLayoutElement, CLAY__ELEMENT_CONFIG_TYPE_SCROLL).scrollElementConfig;
+        elementHasScrollHorizontal = scrollConfig->horizontal;
+        elementHasScrollVertical = scrollConfig->vertical;
+        context->openClipElementStack.length--;
     }
 
     // Attach children to the current open element
@@ -1373,6 +1756,12 @@ void Clay__CloseElement(void) {
     }
 
     bool elementIsFloating = Clay__ElementHasConfig(openLayoutElement, CLAY__ELEMENT_CONFIG_TYPE_FLOATING);
+    uint32_t fingerprint = 0;
+    if (context->retainedLayoutSizing) {
+        openLayoutElement->descendantCount = context->layoutElements.length - 1 - Clay__int32_tArray_GetValue(&context->openLayoutElementStack, (int)context->openLayoutElementStack.length - 1);
+        Clay__FingerprintElement(openLayoutElement);
+        fingerprint = openLayoutElement->fingerprint;
+    }
 
     // Close the currently open element
     int32_t closingElementIndex = Clay__int32_tArray_RemoveSwapback(&context->openLayoutElementStack, (int)context->openLayoutElementStack.length - 1);
@@ -1382,6 +1771,10 @@ void Clay__CloseElement(void) {
         openLayoutElement->childrenOrTextContent.children.length++;
         Clay__int32_tArray_Add(&context->layoutElementChildrenBuffer, closingElementIndex);
     }
+    // Floating elements are mixed in too, they take up part of the parent's range of layoutElements
+    if (context->retainedLayoutSizing && context->openLayoutElementStack.length > 1) {
+        openLayoutElement->fingerprint = Clay__HashFingerprint(openLayoutElement->fingerprint, fingerprint);
+    }
 }
 
 bool Clay__MemCmp(const char *s1, const char *s2, int32_t length);
@@ -1458,6 +1851,7 @@ void Clay__OpenElement(void) {
     Clay_LayoutElement layoutElement = CLAY__DEFAULT_STRUCT;
     Clay_LayoutElementArray_Add(&context->layoutElements, layoutElement);
     Clay__int32_tArray_Add(&context->openLayoutElementStack, context->layoutElements.length - 1);
+    Clay__int32_tArray_Set(&context->layoutElementHashMapItems, context->layoutElements.length - 1, -1);
     if (context->openClipElementStack.length > 0) {
         Clay__int32_tArray_Set(&context->layoutElementClipElementIds, context->layoutElements.length - 1, Clay__int32_tArray_GetValue(&context->openClipElementStack, (int)context->openClipElementStack.length - 1));
     } else {
@@ -1485,17 +1879,23 @@ void Clay__OpenTextElement(Clay_String text, Clay_TextElementConfig *textConfig)
     Clay__MeasureTextCacheItem *textMeasured = Clay__MeasureTextCached(&text, textConfig);
     Clay_ElementId elementId = Clay__HashNumber(parentElement->childrenOrTextContent.children.length, parentElement->id);
     textElement->id = elementId.id;
-    Clay__AddHashMapItem(elementId, textElement, 0);
+    Clay__AddLayoutElementHashMapItem(elementId, textElement, 0);
     Clay__StringArray_Add(&context->layoutElementIdStrings, elementId.stringId);
     Clay_Dimensions textDimensions = { .width = textMeasured->unwrappedDimensions.width, .height = textConfig->lineHeight > 0 ? (float)textConfig->lineHeight : textMeasured->unwrappedDimensions.height };
     textElement->dimensions = textDimensions;
     textElement->minDimensions = CLAY__INIT(Clay_Dimensions) { .width = textMeasured->unwrappedDimensions.height, .height = textDimensions.height }; // TODO not sure this is the best way to decide min width for text
-    textElement->childrenOrTextContent.textElementData = Clay__TextElementDataArray_Add(&context->textElementData, CLAY__INIT(Clay__TextElementData) { .text = text, .preferredDimensions = textMeasured->unwrappedDimensions, .elementIndex = context->layoutElements.length - 1 });
+    textElement->childrenOrTextContent.textElementData = Clay__TextElementDataArray_Add(&context->textElementData, CLAY__INIT(Clay__TextElementData) { .text = text, .preferredDimensions = textMeasured->unwrappedDimensions, .elementIndex = context->layoutElements.length - 1, .measuredWordsStartIndex = textMeasured->measuredWordsStartIndex, .containsNewlines = textMeasured->containsNewlines });
     textElement->elementConfigs = CLAY__INIT(Clay__ElementConfigArraySlice) {
             .length = 1,
             .internalArray = Clay__ElementConfigArray_Add(&context->elementConfigs, CLAY__INIT(Clay_ElementConfig) { .type = CLAY__ELEMENT_CONFIG_TYPE_TEXT, .config = { .textElementConfig = textConfig }})
     };
+    textElement->configTypes = 1 << CLAY__ELEMENT_CONFIG_TYPE_TEXT;
     textElement->layoutConfig = &CLAY_LAYOUT_DEFAULT;
+    if (context->retainedLayoutSizing) {
+        // The measure cache id covers the text and the config used to measure and wrap it
+        textElement->fingerprint = Clay__HashFingerprintDimensions(Clay__HashFingerprint(CLAY__ELEMENT_CONFIG_TYPE_TEXT, textMeasured->id), textElement->dimensions);
+        parentElement->fingerprint = Clay__HashFingerprint(parentElement->fingerprint, textElement->fingerprint);
+    }
     parentElement->childrenOrTextContent.children.length++;
 }
 
@@ -1631,13 +2031,46 @@ void Clay__InitializeEphemeralMemory(Clay_Context* context) {
     context->openLayoutElementStack = Clay__int32_tArray_Allocate_Arena(maxElementCount, arena);
     context->textElementData = Clay__TextElementDataArray_Allocate_Arena(maxElementCount, arena);
     context->imageElementPointers = Clay__int32_tArray_Allocate_Arena(maxElementCount, arena);
-    context->renderCommands = Clay_RenderCommandArray_Allocate_Arena(maxElementCount, arena);
+    if (context->doubleBufferRenderCommands) {
+        // The other buffer holds the previous frame, which may still be in use
+        context->renderCommandBufferIndex ^= 1;
+        context->renderCommands = context->renderCommandBuffers[context->renderCommandBufferIndex];
+        context->dynamicStringData = context->dynamicStringDataBuffers[context->renderCommandBufferIndex];
+    } else {
+        context->renderCommands = Clay_RenderCommandArray_Allocate_Arena(maxElementCount, arena);
+        context->dynamicStringData = Clay__charArray_Allocate_Arena(maxElementCount, arena);
+    }
     context->treeNodeVisited = Clay__boolArray_Allocate_Arena(maxElementCount, arena);
     context->treeNodeVisited.length = context->treeNodeVisited.capacity; // This array is accessed directly rather than behaving as a list
     context->openClipElementStack = Clay__int32_tArray_Allocate_Arena(maxElementCount, arena);
     context->reusableElementIndexBuffer = Clay__int32_tArray_Allocate_Arena(maxElementCount, arena);
     context->layoutElementClipElementIds = Clay__int32_tArray_Allocate_Arena(maxElementCount, arena);
-    context->dynamicStringData = Clay__charArray_Allocate_Arena(maxElementCount, arena);
+    context->layoutElementHashMapItems = Clay__int32_tArray_Allocate_Arena(maxElementCount, arena);
+    if (context->parallelLayoutRoots) {
+        context->layoutRootTasks = Clay__LayoutRootTaskArray_Allocate_Arena(maxElementCount, arena);
+        context->layoutElementRoots = Clay__int32_tArray_Allocate_Arena(maxElementCount, arena);
+        context->layoutRootIndexes = Clay__int32_tArray_Allocate_Arena(maxElementCount, arena);
+        context->layoutRootOrder = Clay__int32_tArray_Allocate_Arena(maxElementCount, arena);
+    }
+    if (context->compactLayoutSizing) {
+        context->compactElementIndexes = Clay__int32_tArray_Allocate_Arena(maxElementCount, arena);
+        context->compactIndexes = Clay__int32_tArray_Allocate_Arena(maxElementCount, arena);
+        context->compactRootStarts = Clay__int32_tArray_Allocate_Arena(maxElementCount + 1, arena);
+        context->compactFirstChildren = Clay__int32_tArray_Allocate_Arena(maxElementCount, arena);
+        context->compactChildCounts = Clay__int32_tArray_Allocate_Arena(maxElementCount, arena);
+        context->compactChildGaps = Clay__int32_tArray_Allocate_Arena(maxElementCount, arena);
+        context->compactPadding = Clay__DimensionsArray_Allocate_Arena(maxElementCount, arena);
+        context->compactDimensions = Clay__DimensionsArray_Allocate_Arena(maxElementCount, arena);
+        context->compactMinDimensions = Clay__DimensionsArray_Allocate_Arena(maxElementCount, arena);
+        context->compactSizing = Clay__SizingArray_Allocate_Arena(maxElementCount, arena);
+        context->compactFlags = Clay__uint8_tArray_Allocate_Arena(maxElementCount, arena);
+    }
+    if (context->pointerHitTestGrid) {
+        context->pointerTargets = Clay__PointerTargetArray_Allocate_Arena(maxElementCount, arena);
+        context->pointerGridCells = Clay__int32_tArray_Allocate_Arena(CLAY__POINTER_GRID_MAX_COLUMNS * CLAY__POINTER_GRID_MAX_COLUMNS + 1, arena);
+        context->pointerGridEntries = Clay__int32_tArray_Allocate_Arena(maxElementCount * 4, arena);
+        context->pointerGridLargeTargets = Clay__int32_tArray_Allocate_Arena(maxElementCount, arena);
+    }
 }
 
 void Clay__InitializePersistentMemory(Clay_Context* context) {
@@ -1648,7 +2081,13 @@ void Clay__InitializePersistentMemory(Clay_Context* context) {
 
     context->scrollContainerDatas = Clay__ScrollContainerDataInternalArray_Allocate_Arena(10, arena);
     context->layoutElementsHashMapInternal = Clay__LayoutElementHashMapItemArray_Allocate_Arena(maxElementCount, arena);
-    context->layoutElementsHashMap = Clay__int32_tArray_Allocate_Arena(maxElementCount, arena);
+    // At least twice the items the map can hold, so probe sequences stay short
+    int32_t hashMapCapacityLog2 = 1;
+    while ((1 << hashMapCapacityLog2) < maxElementCount * 2) {
+        hashMapCapacityLog2++;
+    }
+    context->layoutElementsHashMap = Clay__LayoutElementHashMapSlotArray_Allocate_Arena(1 << hashMapCapacityLog2, arena);
+    context->layoutElementsHashMapShift = 32 - hashMapCapacityLog2;
     context->measureTextHashMapInternal = Clay__MeasureTextCacheItemArray_Allocate_Arena(maxElementCount, arena);
     context->measureTextHashMapInternalFreeList = Clay__int32_tArray_Allocate_Arena(maxElementCount, arena);
     context->measuredWordsFreeList = Clay__int32_tArray_Allocate_Arena(maxMeasureTextCacheWordCount, arena);
@@ -1656,27 +2095,45 @@ void Clay__InitializePersistentMemory(Clay_Context* context) {
     context->measuredWords = Clay__MeasuredWordArray_Allocate_Arena(maxMeasureTextCacheWordCount, arena);
     context->pointerOverIds = Clay__ElementIdArray_Allocate_Arena(maxElementCount, arena);
     context->debugElementData = Clay__DebugElementDataArray_Allocate_Arena(maxElementCount, arena);
+    if (context->doubleBufferRenderCommands) {
+        for (int32_t i = 0; i < 2; ++i) {
+            context->renderCommandBuffers[i] = Clay_RenderCommandArray_Allocate_Arena(maxElementCount, arena);
+            context->dynamicStringDataBuffers[i] = Clay__charArray_Allocate_Arena(maxElementCount, arena);
+        }
+    }
+    if (context->retainedLayoutSizing) {
+        for (int32_t i = 0; i < 2; ++i) {
+            context->retainedDimensions[i] = Clay__DimensionsArray_Allocate_Arena(maxElementCount, arena);
+            context->retainedPropagatedDimensions[i] = Clay__DimensionsArray_Allocate_Arena(maxElementCount, arena);
+        }
+    }
     context->arenaResetOffset = arena->nextAllocation;
 }
 
-void Clay__CompressChildrenAlongAxis(bool xAxis, float totalSizeToDistribute, Clay__int32_tArray resizableContainerBuffer) {
-    Clay_Context* context = Clay_GetCurrentContext();
-    Clay__int32_tArray largestContainers = context->openClipElementStack;
+Clay__DimensionsView Clay__LayoutElementDimensionsView(Clay_Context *context) {
+    Clay_LayoutElement *elements = context->layoutElements.internalArray;
+    return CLAY__INIT(Clay__DimensionsView) { &elements->dimensions, &elements->minDimensions, (int32_t)sizeof(Clay_LayoutElement) };
+}
+
+float *Clay__ElementSizeAlongAxis(Clay__DimensionsView view, int32_t index, bool xAxis, bool minimum) {
+    Clay_Dimensions *dimensions = (Clay_Dimensions *)((char *)(minimum ? view.minDimensions : view.dimensions) + (size_t)index * (size_t)view.stride);
+    return xAxis ? &dimensions->width : &dimensions->height;
+}
 
+void Clay__CompressChildrenAlongAxis(Clay__DimensionsView view, bool xAxis, float totalSizeToDistribute, Clay__int32_tArray resizableContainerBuffer, Clay__int32_tArray largestContainers) {
     while (totalSizeToDistribute > 0.1) {
         largestContainers.length = 0;
         float largestSize = 0;
         float targetSize = 0;
         for (int32_t i = 0; i < resizableContainerBuffer.length; ++i) {
-            Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, Clay__int32_tArray_GetValue(&resizableContainerBuffer, i));
-            float childSize = xAxis ? childElement->dimensions.width : childElement->dimensions.height;
+            float childSize = *Clay__ElementSizeAlongAxis(view, resizableContainerBuffer.internalArray[i], xAxis, false);
             if ((childSize - largestSize) < 0.1 && (childSize - largestSize) > -0.1) {
-                Clay__int32_tArray_Add(&largestContainers, Clay__int32_tArray_GetValue(&resizableContainerBuffer, i));
+                Clay__int32_tArray_Add(&largestContainers, resizableContainerBuffer.internalArray[i]);
             } else if (childSize > largestSize) {
                 targetSize = largestSize;
                 largestSize = childSize;
                 largestContainers.length = 0;
-                Clay__int32_tArray_Add(&largestContainers, Clay__int32_tArray_GetValue(&resizableContainerBuffer, i));
+                Clay__int32_tArray_Add(&largestContainers, resizableContainerBuffer.internalArray[i]);
             }
             else if (childSize > targetSize) {
                 targetSize = childSize;
@@ -1690,16 +2147,15 @@ void Clay__CompressChildrenAlongAxis(bool xAxis, float totalSizeToDistribute, Cl
         targetSize = CLAY__MAX(targetSize, (largestSize * largestContainers.length) - totalSizeToDistribute) / largestContainers.length;
 
         for (int32_t childOffset = 0; childOffset < largestContainers.length; childOffset++) {
-            int32_t childIndex = Clay__int32_tArray_GetValue(&largestContainers, childOffset);
-            Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, childIndex);
-            float *childSize = xAxis ? &childElement->dimensions.width : &childElement->dimensions.height;
-            float childMinSize = xAxis ? childElement->minDimensions.width : childElement->minDimensions.height;
+            int32_t childIndex = largestContainers.internalArray[childOffset];
+            float *childSize = Clay__ElementSizeAlongAxis(view, childIndex, xAxis, false);
+            float childMinSize = *Clay__ElementSizeAlongAxis(view, childIndex, xAxis, true);
             float oldChildSize = *childSize;
             *childSize = CLAY__MAX(childMinSize, targetSize);
             totalSizeToDistribute -= (oldChildSize - *childSize);
             if (*childSize == childMinSize) {
                 for (int32_t i = 0; i < resizableContainerBuffer.length; i++) {
-                    if (Clay__int32_tArray_GetValue(&resizableContainerBuffer, i) == childIndex) {
+                    if (resizableContainerBuffer.internalArray[i] == childIndex) {
                         Clay__int32_tArray_RemoveSwapback(&resizableContainerBuffer, i);
                         break;
                     }
@@ -1709,71 +2165,370 @@ void Clay__CompressChildrenAlongAxis(bool xAxis, float totalSizeToDistribute, Cl
     }
 }
 
-void Clay__SizeContainersAlongAxis(bool xAxis) {
+// Index the element had in the previous frame if its subtree was declared the same way then, -1 otherwise
+int32_t Clay__RetainedElementIndex(Clay_Context *context, Clay_LayoutElement *element, Clay__DimensionsArray *retained) {
+    Clay_LayoutElementHashMapItem *hashMapItem = Clay__GetLayoutElementHashMapItem(context, element);
+    if (hashMapItem->retainedGeneration != context->generation || hashMapItem->retainedFingerprint != element->fingerprint) {
+        return -1;
+    }
+    // Guards against fingerprint collisions reading past the sizes of the previous frame
+    if (hashMapItem->retainedIndex + element->descendantCount >= retained->length) {
+        return -1;
+    }
+    return hashMapItem->retainedIndex;
+}
+
+// Copies the sizes of an element and its descendants along one axis from the previous frame.
+// Floating descendants are skipped along with everything inside them, they are sized as roots of their own.
+void Clay__CopyRetainedSizes(Clay_Context *context, int32_t elementIndex, int32_t retainedIndex, Clay_Dimensions *retained, bool xAxis) {
+    Clay_LayoutElement *elements = context->layoutElements.internalArray;
+    int32_t lastIndex = elementIndex + elements[elementIndex].descendantCount;
+    for (int32_t i = elementIndex; i <= lastIndex; ++i) {
+        Clay_LayoutElement *element = &elements[i];
+        if (i > elementIndex && Clay__ElementHasConfig(element, CLAY__ELEMENT_CONFIG_TYPE_FLOATING)) {
+            i += element->descendantCount;
+            continue;
+        }
+        Clay_Dimensions *source = &retained[retainedIndex + (i - elementIndex)];
+        if (xAxis) {
+            element->dimensions.width = source->width;
+        } else {
+            element->dimensions.height = source->height;
+        }
+    }
+}
+
+// Sizing a subtree only depends on how it was declared and the size its parent gave it. If both are the same as in the
+// previous frame, the sizes of the previous frame are copied instead and true is returned.
+bool Clay__RestoreRetainedSizes(Clay_Context *context, int32_t elementIndex, bool xAxis) {
+    Clay_LayoutElement *element = &context->layoutElements.internalArray[elementIndex];
+    Clay__DimensionsArray *retained = &context->retainedDimensions[(context->generation - 1) & 1];
+    int32_t retainedIndex = Clay__RetainedElementIndex(context, element, retained);
+    if (retainedIndex < 0) {
+        return false;
+    }
+    Clay_Dimensions retainedDimensions = retained->internalArray[retainedIndex];
+    if (element->dimensions.width != retainedDimensions.width || (!xAxis && element->dimensions.height != retainedDimensions.height)) {
+        return false;
+    }
+    Clay__CopyRetainedSizes(context, elementIndex, retainedIndex, retained->internalArray, xAxis);
+    return true;
+}
+
+// Same as Clay__RestoreRetainedSizes() for the heights propagated up from children, once the element has its final width
+bool Clay__RestoreRetainedPropagatedHeights(Clay_Context *context, int32_t elementIndex) {
+    Clay_LayoutElement *element = &context->layoutElements.internalArray[elementIndex];
+    Clay__DimensionsArray *retained = &context->retainedPropagatedDimensions[(context->generation - 1) & 1];
+    int32_t retainedIndex = Clay__RetainedElementIndex(context, element, retained);
+    if (retainedIndex < 0 || element->dimensions.width != retained->internalArray[retainedIndex].width) {
+        return false;
+    }
+    Clay__CopyRetainedSizes(context, elementIndex, retainedIndex, retained->internalArray, false);
+    return true;
+}
+
+// Keeps the sizes of this frame for the next one, see Clay__RestoreRetainedSizes()
+void Clay__RetainSizes(Clay_Context *context, Clay__DimensionsArray *retained) {
+    for (int32_t i = 0; i < context->layoutElements.length; ++i) {
+        retained->internalArray[i] = context->layoutElements.internalArray[i].dimensions;
+    }
+    retained->length = context->layoutElements.length;
+}
+
+// Sizes a single layout tree, the buffers are scratch space big enough for every element in it.
+void Clay__SizeLayoutRootAlongAxis(Clay__LayoutElementTreeRoot *root, bool xAxis, Clay__int32_tArray bfsBuffer, Clay__int32_tArray resizableContainerBuffer, Clay__int32_tArray largestContainerBuffer) {
     Clay_Context* context = Clay_GetCurrentContext();
-    Clay__int32_tArray bfsBuffer = context->layoutElementChildrenBuffer;
+    bfsBuffer.length = 0;
+    Clay_LayoutElement *rootElement = Clay_LayoutElementArray_Get(&context->layoutElements, (int)root->layoutElementIndex);
+    Clay__int32_tArray_Add(&bfsBuffer, (int32_t)root->layoutElementIndex);
+
+    // Size floating containers to their parents
+    if (Clay__ElementHasConfig(rootElement, CLAY__ELEMENT_CONFIG_TYPE_FLOATING)) {
+        Clay_FloatingElementConfig *floatingElementConfig = Clay__FindElementConfigWithType(rootElement, CLAY__ELEMENT_CONFIG_TYPE_FLOATING).floatingElementConfig;
+        Clay_LayoutElementHashMapItem *parentItem = Clay__GetHashMapItem(floatingElementConfig->parentId);
+        if (parentItem && parentItem != &Clay_LayoutElementHashMapItem_DEFAULT) {
+            Clay_LayoutElement *parentLayoutElement = parentItem->layoutElement;
+            if (rootElement->layoutConfig->sizing.width.type == CLAY__SIZING_TYPE_GROW) {
+                rootElement->dimensions.width = parentLayoutElement->dimensions.width;
+            }
+            if (rootElement->layoutConfig->sizing.height.type == CLAY__SIZING_TYPE_GROW) {
+                rootElement->dimensions.height = parentLayoutElement->dimensions.height;
+            }
+        }
+    }
+
+    rootElement->dimensions.width = CLAY__MIN(CLAY__MAX(rootElement->dimensions.width, rootElement->layoutConfig->sizing.width.size.minMax.min), rootElement->layoutConfig->sizing.width.size.minMax.max);
+    rootElement->dimensions.height = CLAY__MIN(CLAY__MAX(rootElement->dimensions.height, rootElement->layoutConfig->sizing.height.size.minMax.min), rootElement->layoutConfig->sizing.height.size.minMax.max);
+
+    for (int32_t i = 0; i < bfsBuffer.length; ++i) {
+        int32_t parentIndex = Clay__int32_tArray_GetValue(&bfsBuffer, i);
+        // Its parent was sized already, so it has the size it will end up with
+        if (i > 0 && context->retainedLayoutSizing && Clay__RestoreRetainedSizes(context, parentIndex, xAxis)) {
+            continue;
+        }
+        Clay_LayoutElement *parent = Clay_LayoutElementArray_Get(&context->layoutElements, parentIndex);
+        Clay_LayoutConfig *parentStyleConfig = parent->layoutConfig;
+        int32_t growContainerCount = 0;
+        float parentSize = xAxis ? parent->dimensions.width : parent->dimensions.height;
+        float parentPadding = (float)(xAxis ? (parent->layoutConfig->padding.left + parent->layoutConfig->padding.right) : (parent->layoutConfig->padding.top + parent->layoutConfig->padding.bottom));
+        float innerContentSize = 0, growContainerContentSize = 0, totalPaddingAndChildGaps = parentPadding;
+        bool sizingAlongAxis = (xAxis && parentStyleConfig->layoutDirection == CLAY_LEFT_TO_RIGHT) || (!xAxis && parentStyleConfig->layoutDirection == CLAY_TOP_TO_BOTTOM);
+        resizableContainerBuffer.length = 0;
+        float parentChildGap = parentStyleConfig->childGap;
+
+        for (int32_t childOffset = 0; childOffset < parent->childrenOrTextContent.children.length; childOffset++) {
+            int32_t childElementIndex = parent->childrenOrTextContent.children.elements[childOffset];
+            Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, childElementIndex);
+            Clay_SizingAxis childSizing = xAxis ? childElement->layoutConfig->sizing.width : childElement->layoutConfig->sizing.height;
+            float childSize = xAxis ? childElement->dimensions.width : childElement->dimensions.height;
+
+            if (!Clay__ElementHasConfig(childElement, CLAY__ELEMENT_CONFIG_TYPE_TEXT) && childElement->childrenOrTextContent.children.length > 0) {
+                Clay__int32_tArray_Add(&bfsBuffer, childElementIndex);
+            }
+
+            if (childSizing.type != CLAY__SIZING_TYPE_PERCENT
+                && childSizing.type != CLAY__SIZING_TYPE_FIXED
+                && (!Clay__ElementHasConfig(childElement, CLAY__ELEMENT_CONFIG_TYPE_TEXT) || (Clay__FindElementConfigWithType(childElement, CLAY__ELEMENT_CONFIG_TYPE_TEXT).textElementConfig->wrapMode == CLAY_TEXT_WRAP_WORDS))
+                && (xAxis || !Clay__ElementHasConfig(childElement, CLAY__ELEMENT_CONFIG_TYPE_IMAGE))
+            ) {
+                Clay__int32_tArray_Add(&resizableContainerBuffer, childElementIndex);
+            }
+
+            if (sizingAlongAxis) {
+                innerContentSize += (childSizing.type == CLAY__SIZING_TYPE_PERCENT ? 0 : childSize);
+                if (childSizing.type == CLAY__SIZING_TYPE_GROW) {
+                    growContainerContentSize += childSize;
+                    growContainerCount++;
+                }
+                if (childOffset > 0) {
+                    innerContentSize += parentChildGap; // For children after index 0, the childAxisOffset is the gap from the previous child
+                    totalPaddingAndChildGaps += parentChildGap;
+                }
+            } else {
+                innerContentSize = CLAY__MAX(childSize, innerContentSize);
+            }
+        }
+
+        // Expand percentage containers to size
+        for (int32_t childOffset = 0; childOffset < parent->childrenOrTextContent.children.length; childOffset++) {
+            int32_t childElementIndex = parent->childrenOrTextContent.children.elements[childOffset];
+            Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, childElementIndex);
+            Clay_SizingAxis childSizing = xAxis ? childElement->layoutConfig->sizing.width : childElement->layoutConfig->sizing.height;
+            float *childSize = xAxis ? &childElement->dimensions.width : &childElement->dimensions.height;
+            if (childSizing.type == CLAY__SIZING_TYPE_PERCENT) {
+                *childSize = (parentSize - totalPaddingAndChildGaps) * childSizing.size.percent;
+                if (sizingAlongAxis) {
+                    innerContentSize += *childSize;
+                }
+            }
+        }
+
+        if (sizingAlongAxis) {
+            float sizeToDistribute = parentSize - parentPadding - innerContentSize;
+            // The content is too large, compress the children as much as possible
+            if (sizeToDistribute < 0) {
+                // If the parent can scroll in the axis direction in this direction, don't compress children, just leave them alone
+                Clay_ScrollElementConfig *scrollElementConfig = Clay__FindElementConfigWithType(parent, CLAY__ELEMENT_CONFIG_TYPE_SCROLL).scrollElementConfig;
+                if (scrollElementConfig) {
+                    if (((xAxis && scrollElementConfig->horizontal) || (!xAxis && scrollElementConfig->vertical))) {
+                        continue;
+                    }
+                }
+                // Scrolling containers preferentially compress before others
+                Clay__CompressChildrenAlongAxis(Clay__LayoutElementDimensionsView(context), xAxis, -sizeToDistribute, resizableContainerBuffer, largestContainerBuffer);
+            // The content is too small, allow SIZING_GROW containers to expand
+            } else if (sizeToDistribute > 0 && growContainerCount > 0) {
+                float targetSize = (sizeToDistribute + growContainerContentSize) / (float)growContainerCount;
+                for (int32_t childOffset = 0; childOffset < resizableContainerBuffer.length; childOffset++) {
+                    Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, Clay__int32_tArray_GetValue(&resizableContainerBuffer, childOffset));
+                    Clay_SizingAxis childSizing = xAxis ? childElement->layoutConfig->sizing.width : childElement->layoutConfig->sizing.height;
+                    if (childSizing.type == CLAY__SIZING_TYPE_GROW) {
+                        float *childSize = xAxis ? &childElement->dimensions.width : &childElement->dimensions.height;
+                        float *minSize = xAxis ? &childElement->minDimensions.width : &childElement->minDimensions.height;
+                        if (targetSize < *minSize) {
+                            growContainerContentSize -= *minSize;
+                            Clay__int32_tArray_RemoveSwapback(&resizableContainerBuffer, childOffset);
+                            growContainerCount--;
+                            targetSize = (sizeToDistribute + growContainerContentSize) / (float)growContainerCount;
+                            childOffset = -1;
+                            continue;
+                        }
+                        *childSize = targetSize;
+                    }
+                }
+            }
+        // Sizing along the non layout axis ("off axis")
+        } else {
+            for (int32_t childOffset = 0; childOffset < resizableContainerBuffer.length; childOffset++) {
+                Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, Clay__int32_tArray_GetValue(&resizableContainerBuffer, childOffset));
+                Clay_SizingAxis childSizing = xAxis ? childElement->layoutConfig->sizing.width : childElement->layoutConfig->sizing.height;
+                float *childSize = xAxis ? &childElement->dimensions.width : &childElement->dimensions.height;
+
+                if (!xAxis && Clay__ElementHasConfig(childElement, CLAY__ELEMENT_CONFIG_TYPE_IMAGE)) {
+                    continue; // Currently we don't support resizing aspect ratio images on the Y axis because it would break the ratio
+                }
+
+                // If we're laying out the children of a scroll panel, grow containers expand to the height of the inner content, not the outer container
+                float maxSize = parentSize - parentPadding;
+                if (Clay__ElementHasConfig(parent, CLAY__ELEMENT_CONFIG_TYPE_SCROLL)) {
+                    Clay_ScrollElementConfig *scrollElementConfig = Clay__FindElementConfigWithType(parent, CLAY__ELEMENT_CONFIG_TYPE_SCROLL).scrollElementConfig;
+                    if (((xAxis && scrollElementConfig->horizontal) || (!xAxis && scrollElementConfig->vertical))) {
+                        maxSize = CLAY__MAX(maxSize, innerContentSize);
+                    }
+                }
+                if (childSizing.type == CLAY__SIZING_TYPE_FIT) {
+                    *childSize = CLAY__MAX(childSizing.size.minMax.min, CLAY__MIN(*childSize, maxSize));
+                } else if (childSizing.type == CLAY__SIZING_TYPE_GROW) {
+                    *childSize = CLAY__MIN(maxSize, childSizing.size.minMax.max);
+                }
+            }
+        }
+    }
+}
+
+// Copies what the sizing passes need into the compact arrays. Each tree is stored breadth first from its root, so the
+// children of an element are next to each other and come after it, and sizing can walk the arrays from start to end.
+// Returns false if some layout element isn't part of any tree, the compact layout can't be used then.
+bool Clay__BuildCompactLayout(Clay_Context *context) {
+    Clay_LayoutElement *elements = context->layoutElements.internalArray;
+    int32_t *elementIndexes = context->compactElementIndexes.internalArray;
+    int32_t *compactIndexes = context->compactIndexes.internalArray;
+    int32_t *rootStarts = context->compactRootStarts.internalArray;
+    int32_t count = 0;
+    for (int32_t rootIndex = 0; rootIndex < context->layoutElementTreeRoots.length; ++rootIndex) {
+        rootStarts[rootIndex] = count;
+        elementIndexes[count++] = (int32_t)context->layoutElementTreeRoots.internalArray[rootIndex].layoutElementIndex;
+        for (int32_t i = rootStarts[rootIndex]; i < count; ++i) {
+            Clay_LayoutElement *element = &elements[elementIndexes[i]];
+            int32_t childCount = Clay__ElementHasConfig(element, CLAY__ELEMENT_CONFIG_TYPE_TEXT) ? 0 : element->childrenOrTextContent.children.length;
+            compactIndexes[elementIndexes[i]] = i;
+            context->compactFirstChildren.internalArray[i] = count;
+            context->compactChildCounts.internalArray[i] = childCount;
+            for (int32_t childOffset = 0; childOffset < childCount; ++childOffset) {
+                elementIndexes[count++] = element->childrenOrTextContent.children.elements[childOffset];
+            }
+        }
+    }
+    rootStarts[context->layoutElementTreeRoots.length] = count;
+    if (count != context->layoutElements.length) {
+        return false;
+    }
+    context->compactElementIndexes.length = count;
+
+    // Going through the layout elements in the order they are stored only leaves the writes to the compact arrays scattered
+    for (int32_t elementIndex = 0; elementIndex < count; ++elementIndex) {
+        Clay_LayoutElement *element = &elements[elementIndex];
+        Clay_LayoutConfig *layoutConfig = element->layoutConfig;
+        Clay_Sizing sizing = layoutConfig->sizing;
+        int32_t i = compactIndexes[elementIndex];
+        context->compactDimensions.internalArray[i] = element->dimensions;
+        context->compactMinDimensions.internalArray[i] = element->minDimensions;
+        context->compactSizing.internalArray[i] = sizing;
+        context->compactChildGaps.internalArray[i] = layoutConfig->childGap;
+        context->compactPadding.internalArray[i] = CLAY__INIT(Clay_Dimensions) { (float)(layoutConfig->padding.left + layoutConfig->padding.right), (float)(layoutConfig->padding.top + layoutConfig->padding.bottom) };
+
+        uint8_t flags = layoutConfig->layoutDirection == CLAY_LEFT_TO_RIGHT ? CLAY__COMPACT_LEFT_TO_RIGHT : 0;
+        bool resizable = !Clay__ElementHasConfig(element, CLAY__ELEMENT_CONFIG_TYPE_TEXT) || Clay__FindElementConfigWithType(element, CLAY__ELEMENT_CONFIG_TYPE_TEXT).textElementConfig->wrapMode == CLAY_TEXT_WRAP_WORDS;
+        if (resizable && sizing.width.type != CLAY__SIZING_TYPE_PERCENT && sizing.width.type != CLAY__SIZING_TYPE_FIXED) {
+            flags |= CLAY__COMPACT_RESIZABLE_X;
+        }
+        // Images keep their aspect ratio, so their height is never resized
+        if (resizable && sizing.height.type != CLAY__SIZING_TYPE_PERCENT && sizing.height.type != CLAY__SIZING_TYPE_FIXED && !Clay__ElementHasConfig(element, CLAY__ELEMENT_CONFIG_TYPE_IMAGE)) {
+            flags |= CLAY__COMPACT_RESIZABLE_Y;
+        }
+        Clay_ScrollElementConfig *scrollConfig = Clay__FindElementConfigWithType(element, CLAY__ELEMENT_CONFIG_TYPE_SCROLL).scrollElementConfig;
+        if (scrollConfig && scrollConfig->horizontal) {
+            flags |= CLAY__COMPACT_SCROLL_X;
+        }
+        if (scrollConfig && scrollConfig->vertical) {
+            flags |= CLAY__COMPACT_SCROLL_Y;
+        }
+        context->compactFlags.internalArray[i] = flags;
+    }
+    return true;
+}
+
+// Same as Clay__SizeLayoutRootAlongAxis() for every tree, reading and writing the compact arrays instead of the layout
+// elements. The sizes are copied back to the layout elements at the end.
+void Clay__SizeCompactLayoutAlongAxis(Clay_Context *context, bool xAxis) {
+    Clay_LayoutElement *elements = context->layoutElements.internalArray;
+    int32_t *elementIndexes = context->compactElementIndexes.internalArray;
+    int32_t *compactIndexes = context->compactIndexes.internalArray;
+    int32_t *rootStarts = context->compactRootStarts.internalArray;
+    int32_t *firstChildren = context->compactFirstChildren.internalArray;
+    int32_t *childCounts = context->compactChildCounts.internalArray;
+    int32_t *childGaps = context->compactChildGaps.internalArray;
+    Clay_Dimensions *padding = context->compactPadding.internalArray;
+    Clay_Dimensions *dimensions = context->compactDimensions.internalArray;
+    Clay_Sizing *sizing = context->compactSizing.internalArray;
+    uint8_t *flags = context->compactFlags.internalArray;
+    uint8_t resizableFlag = xAxis ? CLAY__COMPACT_RESIZABLE_X : CLAY__COMPACT_RESIZABLE_Y;
+    uint8_t scrollFlag = xAxis ? CLAY__COMPACT_SCROLL_X : CLAY__COMPACT_SCROLL_Y;
+    Clay__DimensionsView view = { dimensions, context->compactMinDimensions.internalArray, (int32_t)sizeof(Clay_Dimensions) };
     Clay__int32_tArray resizableContainerBuffer = context->openLayoutElementStack;
+    int32_t count = context->compactElementIndexes.length;
+
+    // Text wrapping and aspect ratio scaling change heights between the two passes
+    if (!xAxis) {
+        for (int32_t elementIndex = 0; elementIndex < count; ++elementIndex) {
+            dimensions[compactIndexes[elementIndex]] = elements[elementIndex].dimensions;
+        }
+    }
+
     for (int32_t rootIndex = 0; rootIndex < context->layoutElementTreeRoots.length; ++rootIndex) {
-        bfsBuffer.length = 0;
-        Clay__LayoutElementTreeRoot *root = Clay__LayoutElementTreeRootArray_Get(&context->layoutElementTreeRoots, rootIndex);
-        Clay_LayoutElement *rootElement = Clay_LayoutElementArray_Get(&context->layoutElements, (int)root->layoutElementIndex);
-        Clay__int32_tArray_Add(&bfsBuffer, (int32_t)root->layoutElementIndex);
+        int32_t rootStart = rootStarts[rootIndex];
+        Clay_LayoutElement *rootElement = &elements[elementIndexes[rootStart]];
+        Clay_Sizing rootSizing = sizing[rootStart];
 
         // Size floating containers to their parents
         if (Clay__ElementHasConfig(rootElement, CLAY__ELEMENT_CONFIG_TYPE_FLOATING)) {
             Clay_FloatingElementConfig *floatingElementConfig = Clay__FindElementConfigWithType(rootElement, CLAY__ELEMENT_CONFIG_TYPE_FLOATING).floatingElementConfig;
             Clay_LayoutElementHashMapItem *parentItem = Clay__GetHashMapItem(floatingElementConfig->parentId);
             if (parentItem && parentItem != &Clay_LayoutElementHashMapItem_DEFAULT) {
-                Clay_LayoutElement *parentLayoutElement = parentItem->layoutElement;
-                if (rootElement->layoutConfig->sizing.width.type == CLAY__SIZING_TYPE_GROW) {
-                    rootElement->dimensions.width = parentLayoutElement->dimensions.width;
+                int32_t parentElementIndex = (int32_t)(parentItem->layoutElement - elements);
+                Clay_Dimensions parentDimensions = parentItem->layoutElement->dimensions;
+                if (parentElementIndex >= 0 && parentElementIndex < context->layoutElements.length) {
+                    parentDimensions = dimensions[compactIndexes[parentElementIndex]];
                 }
-                if (rootElement->layoutConfig->sizing.height.type == CLAY__SIZING_TYPE_GROW) {
-                    rootElement->dimensions.height = parentLayoutElement->dimensions.height;
+                if (rootSizing.width.type == CLAY__SIZING_TYPE_GROW) {
+                    dimensions[rootStart].width = parentDimensions.width;
+                }
+                if (rootSizing.height.type == CLAY__SIZING_TYPE_GROW) {
+                    dimensions[rootStart].height = parentDimensions.height;
                 }
             }
         }
 
-        rootElement->dimensions.width = CLAY__MIN(CLAY__MAX(rootElement->dimensions.width, rootElement->layoutConfig->sizing.width.size.minMax.min), rootElement->layoutConfig->sizing.width.size.minMax.max);
-        rootElement->dimensions.height = CLAY__MIN(CLAY__MAX(rootElement->dimensions.height, rootElement->layoutConfig->sizing.height.size.minMax.min), rootElement->layoutConfig->sizing.height.size.minMax.max);
+        dimensions[rootStart].width = CLAY__MIN(CLAY__MAX(dimensions[rootStart].width, rootSizing.width.size.minMax.min), rootSizing.width.size.minMax.max);
+        dimensions[rootStart].height = CLAY__MIN(CLAY__MAX(dimensions[rootStart].height, rootSizing.height.size.minMax.min), rootSizing.height.size.minMax.max);
 
-        for (int32_t i = 0; i < bfsBuffer.length; ++i) {
-            int32_t parentIndex = Clay__int32_tArray_GetValue(&bfsBuffer, i);
-            Clay_LayoutElement *parent = Clay_LayoutElementArray_Get(&context->layoutElements, parentIndex);
-            Clay_LayoutConfig *parentStyleConfig = parent->layoutConfig;
+        for (int32_t parentIndex = rootStart; parentIndex < rootStarts[rootIndex + 1]; ++parentIndex) {
+            int32_t firstChild = firstChildren[parentIndex];
+            int32_t lastChild = firstChild + childCounts[parentIndex];
+            if (firstChild == lastChild) {
+                continue;
+            }
             int32_t growContainerCount = 0;
-            float parentSize = xAxis ? parent->dimensions.width : parent->dimensions.height;
-            float parentPadding = (float)(xAxis ? (parent->layoutConfig->padding.left + parent->layoutConfig->padding.right) : (parent->layoutConfig->padding.top + parent->layoutConfig->padding.bottom));
+            float parentSize = xAxis ? dimensions[parentIndex].width : dimensions[parentIndex].height;
+            float parentPadding = xAxis ? padding[parentIndex].width : padding[parentIndex].height;
             float innerContentSize = 0, growContainerContentSize = 0, totalPaddingAndChildGaps = parentPadding;
-            bool sizingAlongAxis = (xAxis && parentStyleConfig->layoutDirection == CLAY_LEFT_TO_RIGHT) || (!xAxis && parentStyleConfig->layoutDirection == CLAY_TOP_TO_BOTTOM);
+            bool sizingAlongAxis = xAxis == ((flags[parentIndex] & CLAY__COMPACT_LEFT_TO_RIGHT) != 0);
             resizableContainerBuffer.length = 0;
-            float parentChildGap = parentStyleConfig->childGap;
-
-            for (int32_t childOffset = 0; childOffset < parent->childrenOrTextContent.children.length; childOffset++) {
-                int32_t childElementIndex = parent->childrenOrTextContent.children.elements[childOffset];
-                Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, childElementIndex);
-                Clay_SizingAxis childSizing = xAxis ? childElement->layoutConfig->sizing.width : childElement->layoutConfig->sizing.height;
-                float childSize = xAxis ? childElement->dimensions.width : childElement->dimensions.height;
-
-                if (!Clay__ElementHasConfig(childElement, CLAY__ELEMENT_CONFIG_TYPE_TEXT) && childElement->childrenOrTextContent.children.length > 0) {
-                    Clay__int32_tArray_Add(&bfsBuffer, childElementIndex);
-                }
+            float parentChildGap = (float)childGaps[parentIndex];
 
-                if (childSizing.type != CLAY__SIZING_TYPE_PERCENT
-                    && childSizing.type != CLAY__SIZING_TYPE_FIXED
-                    && (!Clay__ElementHasConfig(childElement, CLAY__ELEMENT_CONFIG_TYPE_TEXT) || (Clay__FindElementConfigWithType(childElement, CLAY__ELEMENT_CONFIG_TYPE_TEXT).textElementConfig->wrapMode == CLAY_TEXT_WRAP_WORDS)) // todo too many loops
-                    && (xAxis || !Clay__ElementHasConfig(childElement, CLAY__ELEMENT_CONFIG_TYPE_IMAGE))
-                ) {
-                    Clay__int32_tArray_Add(&resizableContainerBuffer, childElementIndex);
+            for (int32_t childIndex = firstChild; childIndex < lastChild; ++childIndex) {
+                Clay_SizingAxis childSizing = xAxis ? sizing[childIndex].width : sizing[childIndex].height;
+                float childSize = xAxis ? dimensions[childIndex].width : dimensions[childIndex].height;
+                if (flags[childIndex] & resizableFlag) {
+                    Clay__int32_tArray_Add(&resizableContainerBuffer, childIndex);
                 }
-
                 if (sizingAlongAxis) {
                     innerContentSize += (childSizing.type == CLAY__SIZING_TYPE_PERCENT ? 0 : childSize);
                     if (childSizing.type == CLAY__SIZING_TYPE_GROW) {
                         growContainerContentSize += childSize;
                         growContainerCount++;
                     }
-                    if (childOffset > 0) {
+                    if (childIndex > firstChild) {
                         innerContentSize += parentChildGap; // For children after index 0, the childAxisOffset is the gap from the previous child
                         totalPaddingAndChildGaps += parentChildGap;
                     }
@@ -1783,12 +2538,10 @@ void Clay__SizeContainersAlongAxis(bool xAxis) {
             }
 
             // Expand percentage containers to size
-            for (int32_t childOffset = 0; childOffset < parent->childrenOrTextContent.children.length; childOffset++) {
-                int32_t childElementIndex = parent->childrenOrTextContent.children.elements[childOffset];
-                Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, childElementIndex);
-                Clay_SizingAxis childSizing = xAxis ? childElement->layoutConfig->sizing.width : childElement->layoutConfig->sizing.height;
-                float *childSize = xAxis ? &childElement->dimensions.width : &childElement->dimensions.height;
+            for (int32_t childIndex = firstChild; childIndex < lastChild; ++childIndex) {
+                Clay_SizingAxis childSizing = xAxis ? sizing[childIndex].width : sizing[childIndex].height;
                 if (childSizing.type == CLAY__SIZING_TYPE_PERCENT) {
+                    float *childSize = xAxis ? &dimensions[childIndex].width : &dimensions[childIndex].height;
                     *childSize = (parentSize - totalPaddingAndChildGaps) * childSizing.size.percent;
                     if (sizingAlongAxis) {
                         innerContentSize += *childSize;
@@ -1801,54 +2554,41 @@ void Clay__SizeContainersAlongAxis(bool xAxis) {
                 // The content is too large, compress the children as much as possible
                 if (sizeToDistribute < 0) {
                     // If the parent can scroll in the axis direction in this direction, don't compress children, just leave them alone
-                    Clay_ScrollElementConfig *scrollElementConfig = Clay__FindElementConfigWithType(parent, CLAY__ELEMENT_CONFIG_TYPE_SCROLL).scrollElementConfig;
-                    if (scrollElementConfig) {
-                        if (((xAxis && scrollElementConfig->horizontal) || (!xAxis && scrollElementConfig->vertical))) {
-                            continue;
-                        }
+                    if (flags[parentIndex] & scrollFlag) {
+                        continue;
                     }
-                    // Scrolling containers preferentially compress before others
-                    Clay__CompressChildrenAlongAxis(xAxis, -sizeToDistribute, resizableContainerBuffer);
+                    Clay__CompressChildrenAlongAxis(view, xAxis, -sizeToDistribute, resizableContainerBuffer, context->openClipElementStack);
                 // The content is too small, allow SIZING_GROW containers to expand
                 } else if (sizeToDistribute > 0 && growContainerCount > 0) {
                     float targetSize = (sizeToDistribute + growContainerContentSize) / (float)growContainerCount;
                     for (int32_t childOffset = 0; childOffset < resizableContainerBuffer.length; childOffset++) {
-                        Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, Clay__int32_tArray_GetValue(&resizableContainerBuffer, childOffset));
-                        Clay_SizingAxis childSizing = xAxis ? childElement->layoutConfig->sizing.width : childElement->layoutConfig->sizing.height;
+                        int32_t childIndex = resizableContainerBuffer.internalArray[childOffset];
+                        Clay_SizingAxis childSizing = xAxis ? sizing[childIndex].width : sizing[childIndex].height;
                         if (childSizing.type == CLAY__SIZING_TYPE_GROW) {
-                            float *childSize = xAxis ? &childElement->dimensions.width : &childElement->dimensions.height;
-                            float *minSize = xAxis ? &childElement->minDimensions.width : &childElement->minDimensions.height;
-                            if (targetSize < *minSize) {
-                                growContainerContentSize -= *minSize;
+                            float minSize = *Clay__ElementSizeAlongAxis(view, childIndex, xAxis, true);
+                            if (targetSize < minSize) {
+                                growContainerContentSize -= minSize;
                                 Clay__int32_tArray_RemoveSwapback(&resizableContainerBuffer, childOffset);
                                 growContainerCount--;
                                 targetSize = (sizeToDistribute + growContainerContentSize) / (float)growContainerCount;
                                 childOffset = -1;
                                 continue;
                             }
-                            *childSize = targetSize;
+                            *Clay__ElementSizeAlongAxis(view, childIndex, xAxis, false) = targetSize;
                         }
                     }
                 }
             // Sizing along the non layout axis ("off axis")
             } else {
+                // If we're laying out the children of a scroll panel, grow containers expand to the height of the inner content, not the outer container
+                float maxSize = parentSize - parentPadding;
+                if (flags[parentIndex] & scrollFlag) {
+                    maxSize = CLAY__MAX(maxSize, innerContentSize);
+                }
                 for (int32_t childOffset = 0; childOffset < resizableContainerBuffer.length; childOffset++) {
-                    Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, Clay__int32_tArray_GetValue(&resizableContainerBuffer, childOffset));
-                    Clay_SizingAxis childSizing = xAxis ? childElement->layoutConfig->sizing.width : childElement->layoutConfig->sizing.height;
-                    float *childSize = xAxis ? &childElement->dimensions.width : &childElement->dimensions.height;
-
-                    if (!xAxis && Clay__ElementHasConfig(childElement, CLAY__ELEMENT_CONFIG_TYPE_IMAGE)) {
-                        continue; // Currently we don't support resizing aspect ratio images on the Y axis because it would break the ratio
-                    }
-
-                    // If we're laying out the children of a scroll panel, grow containers expand to the height of the inner content, not the outer container
-                    float maxSize = parentSize - parentPadding;
-                    if (Clay__ElementHasConfig(parent, CLAY__ELEMENT_CONFIG_TYPE_SCROLL)) {
-                        Clay_ScrollElementConfig *scrollElementConfig = Clay__FindElementConfigWithType(parent, CLAY__ELEMENT_CONFIG_TYPE_SCROLL).scrollElementConfig;
-                        if (((xAxis && scrollElementConfig->horizontal) || (!xAxis && scrollElementConfig->vertical))) {
-                            maxSize = CLAY__MAX(maxSize, innerContentSize);
-                        }
-                    }
+                    int32_t childIndex = resizableContainerBuffer.internalArray[childOffset];
+                    Clay_SizingAxis childSizing = xAxis ? sizing[childIndex].width : sizing[childIndex].height;
+                    float *childSize = xAxis ? &dimensions[childIndex].width : &dimensions[childIndex].height;
                     if (childSizing.type == CLAY__SIZING_TYPE_FIT) {
                         *childSize = CLAY__MAX(childSizing.size.minMax.min, CLAY__MIN(*childSize, maxSize));
                     } else if (childSizing.type == CLAY__SIZING_TYPE_GROW) {
@@ -1858,6 +2598,10 @@ void Clay__SizeContainersAlongAxis(bool xAxis) {
             }
         }
     }
+
+    for (int32_t elementIndex = 0; elementIndex < count; ++elementIndex) {
+        elements[elementIndex].dimensions = dimensions[compactIndexes[elementIndex]];
+    }
 }
 
 Clay_String Clay__IntToString(int32_t integer) {
@@ -1906,6 +2650,20 @@ void Clay__AddRenderCommand(Clay_RenderCommand renderCommand) {
     }
 }
 
+// Render commands of a tree root laid out in parallel go into that root's slice of the render command array,
+// running out of space there is left for the caller to deal with.
+void Clay__AddLayoutRootRenderCommand(Clay__LayoutRootTask *task, Clay_RenderCommand renderCommand) {
+    if (!task) {
+        Clay__AddRenderCommand(renderCommand);
+        return;
+    }
+    if (task->renderCommands.length == task->renderCommands.capacity) {
+        task->exceededCapacity = true;
+        return;
+    }
+    task->renderCommands.internalArray[task->renderCommands.length++] = renderCommand;
+}
+
 bool Clay__ElementIsOffscreen(Clay_BoundingBox *boundingBox) {
     Clay_Context* context = Clay_GetCurrentContext();
     if (context->disableCulling) {
@@ -1918,610 +2676,967 @@ bool Clay__ElementIsOffscreen(Clay_BoundingBox *boundingBox) {
            (boundingBox->y + boundingBox->height < 0);
 }
 
-void Clay__CalculateFinalLayout(void) {
-    Clay_Context* context = Clay_GetCurrentContext();
-    // Calculate sizing along the X axis
-    Clay__SizeContainersAlongAxis(true);
-
-    // Wrap text
-    for (int32_t textElementIndex = 0; textElementIndex < context->textElementData.length; ++textElementIndex) {
-        Clay__TextElementData *textElementData = Clay__TextElementDataArray_Get(&context->textElementData, textElementIndex);
-        textElementData->wrappedLines = CLAY__INIT(Clay__WrappedTextLineArraySlice) { .length = 0, .internalArray = &context->wrappedTextLines.internalArray[context->wrappedTextLines.length] };
-        Clay_LayoutElement *containerElement = Clay_LayoutElementArray_Get(&context->layoutElements, (int)textElementData->elementIndex);
-        Clay_TextElementConfig *textConfig = Clay__FindElementConfigWithType(containerElement, CLAY__ELEMENT_CONFIG_TYPE_TEXT).textElementConfig;
-        Clay__MeasureTextCacheItem *measureTextCacheItem = Clay__MeasureTextCached(&textElementData->text, textConfig);
-        float lineWidth = 0;
-        float lineHeight = textConfig->lineHeight > 0 ? (float)textConfig->lineHeight : textElementData->preferredDimensions.height;
-        int32_t lineLengthChars = 0;
-        int32_t lineStartOffset = 0;
-        if (!measureTextCacheItem->containsNewlines && textElementData->preferredDimensions.width <= containerElement->dimensions.width) {
-            Clay__WrappedTextLineArray_Add(&context->wrappedTextLines, CLAY__INIT(Clay__WrappedTextLine) { containerElement->dimensions,  textElementData->text });
+// Wraps a single text element into the end of the lines array. Only touches the text element, its container and the
+// lines array, so it is safe to call from several threads as long as each one is given its own lines array.
+// Returns false if the lines array ran out of capacity.
+bool Clay__WrapTextElement(Clay_Context *context, Clay__TextElementData *textElementData, Clay__WrappedTextLineArray *lines) {
+    bool fits = true;
+    textElementData->wrappedLines = CLAY__INIT(Clay__WrappedTextLineArraySlice) { .length = 0, .internalArray = &lines->internalArray[lines->length] };
+    Clay_LayoutElement *containerElement = &context->layoutElements.internalArray[textElementData->elementIndex];
+    Clay_TextElementConfig *textConfig = containerElement->elementConfigs.internalArray[0].config.textElementConfig;
+    float lineWidth = 0;
+    float lineHeight = textConfig->lineHeight > 0 ? (float)textConfig->lineHeight : textElementData->preferredDimensions.height;
+    int32_t lineLengthChars = 0;
+    int32_t lineStartOffset = 0;
+    if (!textElementData->containsNewlines && textElementData->preferredDimensions.width <= containerElement->dimensions.width) {
+        if (lines->length == lines->capacity) {
+            return false;
+        }
+        lines->internalArray[lines->length++] = CLAY__INIT(Clay__WrappedTextLine) { containerElement->dimensions,  textElementData->text };
+        textElementData->wrappedLines.length++;
+        return true;
+    }
+    int32_t wordIndex = textElementData->measuredWordsStartIndex;
+    while (wordIndex != -1) {
+        if (lines->length == lines->capacity) {
+            fits = false;
+            break;
+        }
+        Clay__MeasuredWord *measuredWord = &context->measuredWords.internalArray[wordIndex];
+        // Only word on the line is too large, just render it anyway
+        if (lineLengthChars == 0 && lineWidth + measuredWord->width > containerElement->dimensions.width) {
+            lines->internalArray[lines->length++] = CLAY__INIT(Clay__WrappedTextLine) { { measuredWord->width, lineHeight }, { .length = measuredWord->length, .chars = &textElementData->text.chars[measuredWord->startOffset] } };
             textElementData->wrappedLines.length++;
-            continue;
+            wordIndex = measuredWord->next;
+            lineStartOffset = measuredWord->startOffset + measuredWord->length;
         }
-        int32_t wordIndex = measureTextCacheItem->measuredWordsStartIndex;
-        while (wordIndex != -1) {
-            if (context->wrappedTextLines.length > context->wrappedTextLines.capacity - 1) {
-                break;
-            }
-            Clay__MeasuredWord *measuredWord = Clay__MeasuredWordArray_Get(&context->measuredWords, wordIndex);
-            // Only word on the line is too large, just render it anyway
-            if (lineLengthChars == 0 && lineWidth + measuredWord->width > containerElement->dimensions.width) {
-                Clay__WrappedTextLineArray_Add(&context->wrappedTextLines, CLAY__INIT(Clay__WrappedTextLine) { { measuredWord->width, lineHeight }, { .length = measuredWord->length, .chars = &textElementData->text.chars[measuredWord->startOffset] } });
-                textElementData->wrappedLines.length++;
-                wordIndex = measuredWord->next;
-                lineStartOffset = measuredWord->startOffset + measuredWord->length;
-            }
-            // measuredWord->length == 0 means a newline character
-            else if (measuredWord->length == 0 || lineWidth + measuredWord->width > containerElement->dimensions.width) {
-                // Wrapped text lines list has overflowed, just render out the line
-                Clay__WrappedTextLineArray_Add(&context->wrappedTextLines, CLAY__INIT(Clay__WrappedTextLine) { { lineWidth, lineHeight }, { .length = lineLengthChars, .chars = &textElementData->text.chars[lineStartOffset] } });
-                textElementData->wrappedLines.length++;
-                if (lineLengthChars == 0 || measuredWord->length == 0) {
-                    wordIndex = measuredWord->next;
-                }
-                lineWidth = 0;
-                lineLengthChars = 0;
-                lineStartOffset = measuredWord->startOffset;
-            } else {
-                lineWidth += measuredWord->width;
-                lineLengthChars += measuredWord->length;
+        // measuredWord->length == 0 means a newline character
+        else if (measuredWord->length == 0 || lineWidth + measuredWord->width > containerElement->dimensions.width) {
+            lines->internalArray[lines->length++] = CLAY__INIT(Clay__WrappedTextLine) { { lineWidth, lineHeight }, { .length = lineLengthChars, .chars = &textElementData->text.chars[lineStartOffset] } };
+            textElementData->wrappedLines.length++;
+            if (lineLengthChars == 0 || measuredWord->length == 0) {
                 wordIndex = measuredWord->next;
             }
+            lineWidth = 0;
+            lineLengthChars = 0;
+            lineStartOffset = measuredWord->startOffset;
+        } else {
+            lineWidth += measuredWord->width;
+            lineLengthChars += measuredWord->length;
+            wordIndex = measuredWord->next;
         }
-        if (lineLengthChars > 0) {
-            Clay__WrappedTextLineArray_Add(&context->wrappedTextLines, CLAY__INIT(Clay__WrappedTextLine) { { lineWidth, lineHeight }, {.length = lineLengthChars, .chars = &textElementData->text.chars[lineStartOffset] } });
+    }
+    if (lineLengthChars > 0) {
+        if (lines->length == lines->capacity) {
+            fits = false;
+        } else {
+            lines->internalArray[lines->length++] = CLAY__INIT(Clay__WrappedTextLine) { { lineWidth, lineHeight }, {.length = lineLengthChars, .chars = &textElementData->text.chars[lineStartOffset] } };
             textElementData->wrappedLines.length++;
         }
-        containerElement->dimensions.height = lineHeight * (float)textElementData->wrappedLines.length;
     }
+    containerElement->dimensions.height = lineHeight * (float)textElementData->wrappedLines.length;
+    return fits;
+}
 
-    // Scale vertical image heights according to aspect ratio
-    for (int32_t i = 0; i < context->imageElementPointers.length; ++i) {
-        Clay_LayoutElement* imageElement = Clay_LayoutElementArray_Get(&context->layoutElements, Clay__int32_tArray_GetValue(&context->imageElementPointers, i));
-        Clay_ImageElementConfig *config = Clay__FindElementConfigWithType(imageElement, CLAY__ELEMENT_CONFIG_TYPE_IMAGE).imageElementConfig;
-        imageElement->dimensions.height = (config->sourceDimensions.height / CLAY__MAX(config->sourceDimensions.width, 1)) * imageElement->dimensions.width;
+typedef struct {
+    Clay_Context *context;
+    int32_t taskCount;
+    Clay__WrappedTextLineArray taskLines[CLAY__PARALLEL_TEXT_WRAP_MAX_TASKS];
+    bool taskExceededCapacity[CLAY__PARALLEL_TEXT_WRAP_MAX_TASKS];
+} Clay__WrapTextTaskData;
+
+int32_t Clay__WrapTextTaskFirstElement(int32_t textElementCount, int32_t taskIndex, int32_t taskCount) {
+    return (int32_t)((int64_t)textElementCount * taskIndex / taskCount);
+}
+
+void Clay__WrapTextTask(void *taskData, int32_t taskIndex) {
+    Clay__WrapTextTaskData *data = (Clay__WrapTextTaskData *)taskData;
+    Clay_Context *context = data->context;
+    // Array range errors report through the current context, which may be thread local
+    Clay_SetCurrentContext(context);
+    int32_t firstElement = Clay__WrapTextTaskFirstElement(context->textElementData.length, taskIndex, data->taskCount);
+    int32_t lastElement = Clay__WrapTextTaskFirstElement(context->textElementData.length, taskIndex + 1, data->taskCount);
+    for (int32_t i = firstElement; i < lastElement; ++i) {
+        if (!Clay__WrapTextElement(context, &context->textElementData.internalArray[i], &data->taskLines[taskIndex])) {
+            data->taskExceededCapacity[taskIndex] = true;
+            return;
+        }
     }
+}
 
-    // Propagate effect of text wrapping, image aspect scaling etc. on height of parents
-    Clay__LayoutElementTreeNodeArray dfsBuffer = context->layoutElementTreeNodeArray1;
-    dfsBuffer.length = 0;
-    for (int32_t i = 0; i < context->layoutElementTreeRoots.length; ++i) {
-        Clay__LayoutElementTreeRoot *root = Clay__LayoutElementTreeRootArray_Get(&context->layoutElementTreeRoots, i);
-        context->treeNodeVisited.internalArray[dfsBuffer.length] = false;
-        Clay__LayoutElementTreeNodeArray_Add(&dfsBuffer, CLAY__INIT(Clay__LayoutElementTreeNode) { .layoutElement = Clay_LayoutElementArray_Get(&context->layoutElements, (int)root->layoutElementIndex) });
+// Splits the text elements into contiguous ranges and wraps each range into its own slice of the (still empty)
+// wrappedTextLines array using the user provided parallel for, then compacts the slices back together in order.
+// If a range didn't fit in its slice, everything from that range onwards is left for the serial pass.
+// Returns the index of the first text element that still needs wrapping.
+int32_t Clay__WrapTextParallel(Clay_Context *context, int32_t taskCount) {
+    Clay__WrapTextTaskData data = { .context = context, .taskCount = taskCount };
+    int32_t linesPerTask = context->wrappedTextLines.capacity / taskCount;
+    for (int32_t i = 0; i < taskCount; ++i) {
+        data.taskLines[i] = CLAY__INIT(Clay__WrappedTextLineArray) { .capacity = linesPerTask, .length = 0, .internalArray = &context->wrappedTextLines.internalArray[i * linesPerTask] };
     }
-    while (dfsBuffer.length > 0) {
-        Clay__LayoutElementTreeNode *currentElementTreeNode = Clay__LayoutElementTreeNodeArray_Get(&dfsBuffer, (int)dfsBuffer.length - 1);
-        Clay_LayoutElement *currentElement = currentElementTreeNode->layoutElement;
-        if (!context->treeNodeVisited.internalArray[dfsBuffer.length - 1]) {
-            context->treeNodeVisited.internalArray[dfsBuffer.length - 1] = true;
-            // If the element has no children or is the container for a text element, don't bother inspecting it
-            if (Clay__ElementHasConfig(currentElement, CLAY__ELEMENT_CONFIG_TYPE_TEXT) || currentElement->childrenOrTextContent.children.length == 0) {
-                dfsBuffer.length--;
-                continue;
-            }
-            // Add the children to the DFS buffer (needs to be pushed in reverse so that stack traversal is in correct layout order)
-            for (int32_t i = 0; i < currentElement->childrenOrTextContent.children.length; i++) {
-                context->treeNodeVisited.internalArray[dfsBuffer.length] = false;
-                Clay__LayoutElementTreeNodeArray_Add(&dfsBuffer, CLAY__INIT(Clay__LayoutElementTreeNode) { .layoutElement = Clay_LayoutElementArray_Get(&context->layoutElements, currentElement->childrenOrTextContent.children.elements[i]) });
-            }
-            continue;
-        }
-        dfsBuffer.length--;
+    context->parallelForFunction(Clay__WrapTextTask, &data, taskCount, context->parallelForUserData);
 
-        // DFS node has been visited, this is on the way back up to the root
-        Clay_LayoutConfig *layoutConfig = currentElement->layoutConfig;
-        if (layoutConfig->layoutDirection == CLAY_LEFT_TO_RIGHT) {
-            // Resize any parent containers that have grown in height along their non layout axis
-            for (int32_t j = 0; j < currentElement->childrenOrTextContent.children.length; ++j) {
-                Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, currentElement->childrenOrTextContent.children.elements[j]);
-                float childHeightWithPadding = CLAY__MAX(childElement->dimensions.height + layoutConfig->padding.top + layoutConfig->padding.bottom, currentElement->dimensions.height);
-                currentElement->dimensions.height = CLAY__MIN(CLAY__MAX(childHeightWithPadding, layoutConfig->sizing.height.size.minMax.min), layoutConfig->sizing.height.size.minMax.max);
+    context->wrappedTextLines.length = 0;
+    for (int32_t i = 0; i < taskCount; ++i) {
+        int32_t firstElement = Clay__WrapTextTaskFirstElement(context->textElementData.length, i, taskCount);
+        if (data.taskExceededCapacity[i]) {
+            return firstElement;
+        }
+        Clay__WrappedTextLine *source = data.taskLines[i].internalArray;
+        Clay__WrappedTextLine *destination = &context->wrappedTextLines.internalArray[context->wrappedTextLines.length];
+        if (destination != source) {
+            // Slices are compacted towards the start of the array, so copying forwards never overwrites unread lines
+            for (int32_t j = 0; j < data.taskLines[i].length; ++j) {
+                destination[j] = source[j];
             }
-        } else if (layoutConfig->layoutDirection == CLAY_TOP_TO_BOTTOM) {
-            // Resizing along the layout axis
-            float contentHeight = (float)(layoutConfig->padding.top + layoutConfig->padding.bottom);
-            for (int32_t j = 0; j < currentElement->childrenOrTextContent.children.length; ++j) {
-                Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, currentElement->childrenOrTextContent.children.elements[j]);
-                contentHeight += childElement->dimensions.height;
+            int32_t lastElement = Clay__WrapTextTaskFirstElement(context->textElementData.length, i + 1, taskCount);
+            for (int32_t j = firstElement; j < lastElement; ++j) {
+                Clay__TextElementData *textElementData = &context->textElementData.internalArray[j];
+                textElementData->wrappedLines.internalArray = destination + (textElementData->wrappedLines.internalArray - source);
             }
-            contentHeight += (float)(CLAY__MAX(currentElement->childrenOrTextContent.children.length - 1, 0) * layoutConfig->childGap);
-            currentElement->dimensions.height = CLAY__MIN(CLAY__MAX(contentHeight, layoutConfig->sizing.height.size.minMax.min), layoutConfig->sizing.height.size.minMax.max);
         }
+        context->wrappedTextLines.length += data.taskLines[i].length;
     }
+    return context->textElementData.length;
+}
 
-    // Calculate sizing along the Y axis
-    Clay__SizeContainersAlongAxis(false);
-
-    // Sort tree roots by z-index
-    int32_t sortMax = context->layoutElementTreeRoots.length - 1;
-    while (sortMax > 0) { // todo dumb bubble sort
-        for (int32_t i = 0; i < sortMax; ++i) {
-            Clay__LayoutElementTreeRoot current = *Clay__LayoutElementTreeRootArray_Get(&context->layoutElementTreeRoots, i);
-            Clay__LayoutElementTreeRoot next = *Clay__LayoutElementTreeRootArray_Get(&context->layoutElementTreeRoots, i + 1);
-            if (next.zIndex < current.zIndex) {
-                Clay__LayoutElementTreeRootArray_Set(&context->layoutElementTreeRoots, i, next);
-                Clay__LayoutElementTreeRootArray_Set(&context->layoutElementTreeRoots, i + 1, current);
-            }
+// Positions a single layout tree and generates its render commands, the buffers are scratch space big enough for
+// every element in it. Without a task the render commands are added straight to the context.
+void Clay__PositionLayoutRoot(Clay__LayoutElementTreeRoot *root, Clay__LayoutElementTreeNodeArray dfsBuffer, Clay__boolArray treeNodeVisited, Clay__LayoutRootTask *task) {
+    Clay_Context* context = Clay_GetCurrentContext();
+    dfsBuffer.length = 0;
+    Clay_LayoutElement *rootElement = Clay_LayoutElementArray_Get(&context->layoutElements, (int)root->layoutElementIndex);
+    Clay_Vector2 rootPosition = CLAY__DEFAULT_STRUCT;
+    Clay_LayoutElementHashMapItem *parentHashMapItem = Clay__GetHashMapItem(root->parentId);
+    // Position root floating containers
+    if (Clay__ElementHasConfig(rootElement, CLAY__ELEMENT_CONFIG_TYPE_FLOATING) && parentHashMapItem) {
+        Clay_FloatingElementConfig *config = Clay__FindElementConfigWithType(rootElement, CLAY__ELEMENT_CONFIG_TYPE_FLOATING).floatingElementConfig;
+        Clay_Dimensions rootDimensions = rootElement->dimensions;
+        Clay_BoundingBox parentBoundingBox = parentHashMapItem->boundingBox;
+        // Set X position
+        Clay_Vector2 targetAttachPosition = CLAY__DEFAULT_STRUCT;
+        switch (config->attachPoints.parent) {
+            case CLAY_ATTACH_POINT_LEFT_TOP:
+            case CLAY_ATTACH_POINT_LEFT_CENTER:
+            case CLAY_ATTACH_POINT_LEFT_BOTTOM: targetAttachPosition.x = parentBoundingBox.x; break;
+            case CLAY_ATTACH_POINT_CENTER_TOP:
+            case CLAY_ATTACH_POINT_CENTER_CENTER:
+            case CLAY_ATTACH_POINT_CENTER_BOTTOM: targetAttachPosition.x = parentBoundingBox.x + (parentBoundingBox.width / 2); break;
+            case CLAY_ATTACH_POINT_RIGHT_TOP:
+            case CLAY_ATTACH_POINT_RIGHT_CENTER:
+            case CLAY_ATTACH_POINT_RIGHT_BOTTOM: targetAttachPosition.x = parentBoundingBox.x + parentBoundingBox.width; break;
+        }
+        switch (config->attachPoints.element) {
+            case CLAY_ATTACH_POINT_LEFT_TOP:
+            case CLAY_ATTACH_POINT_LEFT_CENTER:
+            case CLAY_ATTACH_POINT_LEFT_BOTTOM: break;
+            case CLAY_ATTACH_POINT_CENTER_TOP:
+            case CLAY_ATTACH_POINT_CENTER_CENTER:
+            case CLAY_ATTACH_POINT_CENTER_BOTTOM: targetAttachPosition.x -= (rootDimensions.width / 2); break;
+            case CLAY_ATTACH_POINT_RIGHT_TOP:
+            case CLAY_ATTACH_POINT_RIGHT_CENTER:
+            case CLAY_ATTACH_POINT_RIGHT_BOTTOM: targetAttachPosition.x -= rootDimensions.width; break;
+        }
+        switch (config->attachPoints.parent) { // I know I could merge the x and y switch statements, but this is easier to read
+            case CLAY_ATTACH_POINT_LEFT_TOP:
+            case CLAY_ATTACH_POINT_RIGHT_TOP:
+            case CLAY_ATTACH_POINT_CENTER_TOP: targetAttachPosition.y = parentBoundingBox.y; break;
+            case CLAY_ATTACH_POINT_LEFT_CENTER:
+            case CLAY_ATTACH_POINT_CENTER_CENTER:
+            case CLAY_ATTACH_POINT_RIGHT_CENTER: targetAttachPosition.y = parentBoundingBox.y + (parentBoundingBox.height / 2); break;
+            case CLAY_ATTACH_POINT_LEFT_BOTTOM:
+            case CLAY_ATTACH_POINT_CENTER_BOTTOM:
+            case CLAY_ATTACH_POINT_RIGHT_BOTTOM: targetAttachPosition.y = parentBoundingBox.y + parentBoundingBox.height; break;
+        }
+        switch (config->attachPoints.element) {
+            case CLAY_ATTACH_POINT_LEFT_TOP:
+            case CLAY_ATTACH_POINT_RIGHT_TOP:
+            case CLAY_ATTACH_POINT_CENTER_TOP: break;
+            case CLAY_ATTACH_POINT_LEFT_CENTER:
+            case CLAY_ATTACH_POINT_CENTER_CENTER:
+            case CLAY_ATTACH_POINT_RIGHT_CENTER: targetAttachPosition.y -= (rootDimensions.height / 2); break;
+            case CLAY_ATTACH_POINT_LEFT_BOTTOM:
+            case CLAY_ATTACH_POINT_CENTER_BOTTOM:
+            case CLAY_ATTACH_POINT_RIGHT_BOTTOM: targetAttachPosition.y -= rootDimensions.height; break;
         }
-        sortMax--;
+        targetAttachPosition.x += config->offset.x;
+        targetAttachPosition.y += config->offset.y;
+        rootPosition = targetAttachPosition;
     }
-
-    // Calculate final positions and generate render commands
-    context->renderCommands.length = 0;
-    dfsBuffer.length = 0;
-    for (int32_t rootIndex = 0; rootIndex < context->layoutElementTreeRoots.length; ++rootIndex) {
-        dfsBuffer.length = 0;
-        Clay__LayoutElementTreeRoot *root = Clay__LayoutElementTreeRootArray_Get(&context->layoutElementTreeRoots, rootIndex);
-        Clay_LayoutElement *rootElement = Clay_LayoutElementArray_Get(&context->layoutElements, (int)root->layoutElementIndex);
-        Clay_Vector2 rootPosition = CLAY__DEFAULT_STRUCT;
-        Clay_LayoutElementHashMapItem *parentHashMapItem = Clay__GetHashMapItem(root->parentId);
-        // Position root floating containers
-        if (Clay__ElementHasConfig(rootElement, CLAY__ELEMENT_CONFIG_TYPE_FLOATING) && parentHashMapItem) {
-            Clay_FloatingElementConfig *config = Clay__FindElementConfigWithType(rootElement, CLAY__ELEMENT_CONFIG_TYPE_FLOATING).floatingElementConfig;
-            Clay_Dimensions rootDimensions = rootElement->dimensions;
-            Clay_BoundingBox parentBoundingBox = parentHashMapItem->boundingBox;
-            // Set X position
-            Clay_Vector2 targetAttachPosition = CLAY__DEFAULT_STRUCT;
-            switch (config->attachPoints.parent) {
-                case CLAY_ATTACH_POINT_LEFT_TOP:
-                case CLAY_ATTACH_POINT_LEFT_CENTER:
-                case CLAY_ATTACH_POINT_LEFT_BOTTOM: targetAttachPosition.x = parentBoundingBox.x; break;
-                case CLAY_ATTACH_POINT_CENTER_TOP:
-                case CLAY_ATTACH_POINT_CENTER_CENTER:
-                case CLAY_ATTACH_POINT_CENTER_BOTTOM: targetAttachPosition.x = parentBoundingBox.x + (parentBoundingBox.width / 2); break;
-                case CLAY_ATTACH_POINT_RIGHT_TOP:
-                case CLAY_ATTACH_POINT_RIGHT_CENTER:
-                case CLAY_ATTACH_POINT_RIGHT_BOTTOM: targetAttachPosition.x = parentBoundingBox.x + parentBoundingBox.width; break;
-            }
-            switch (config->attachPoints.element) {
-                case CLAY_ATTACH_POINT_LEFT_TOP:
-                case CLAY_ATTACH_POINT_LEFT_CENTER:
-                case CLAY_ATTACH_POINT_LEFT_BOTTOM: break;
-                case CLAY_ATTACH_POINT_CENTER_TOP:
-                case CLAY_ATTACH_POINT_CENTER_CENTER:
-                case CLAY_ATTACH_POINT_CENTER_BOTTOM: targetAttachPosition.x -= (rootDimensions.width / 2); break;
-                case CLAY_ATTACH_POINT_RIGHT_TOP:
-                case CLAY_ATTACH_POINT_RIGHT_CENTER:
-                case CLAY_ATTACH_POINT_RIGHT_BOTTOM: targetAttachPosition.x -= rootDimensions.width; break;
-            }
-            switch (config->attachPoints.parent) { // I know I could merge the x and y switch statements, but this is easier to read
-                case CLAY_ATTACH_POINT_LEFT_TOP:
-                case CLAY_ATTACH_POINT_RIGHT_TOP:
-                case CLAY_ATTACH_POINT_CENTER_TOP: targetAttachPosition.y = parentBoundingBox.y; break;
-                case CLAY_ATTACH_POINT_LEFT_CENTER:
-                case CLAY_ATTACH_POINT_CENTER_CENTER:
-                case CLAY_ATTACH_POINT_RIGHT_CENTER: targetAttachPosition.y = parentBoundingBox.y + (parentBoundingBox.height / 2); break;
-                case CLAY_ATTACH_POINT_LEFT_BOTTOM:
-                case CLAY_ATTACH_POINT_CENTER_BOTTOM:
-                case CLAY_ATTACH_POINT_RIGHT_BOTTOM: targetAttachPosition.y = parentBoundingBox.y + parentBoundingBox.height; break;
-            }
-            switch (config->attachPoints.element) {
-                case CLAY_ATTACH_POINT_LEFT_TOP:
-                case CLAY_ATTACH_POINT_RIGHT_TOP:
-                case CLAY_ATTACH_POINT_CENTER_TOP: break;
-                case CLAY_ATTACH_POINT_LEFT_CENTER:
-                case CLAY_ATTACH_POINT_CENTER_CENTER:
-                case CLAY_ATTACH_POINT_RIGHT_CENTER: targetAttachPosition.y -= (rootDimensions.height / 2); break;
-                case CLAY_ATTACH_POINT_LEFT_BOTTOM:
-                case CLAY_ATTACH_POINT_CENTER_BOTTOM:
-                case CLAY_ATTACH_POINT_RIGHT_BOTTOM: targetAttachPosition.y -= rootDimensions.height; break;
-            }
-            targetAttachPosition.x += config->offset.x;
-            targetAttachPosition.y += config->offset.y;
-            rootPosition = targetAttachPosition;
-        }
-        if (root->clipElementId) {
-            Clay_LayoutElementHashMapItem *clipHashMapItem = Clay__GetHashMapItem(root->clipElementId);
-            if (clipHashMapItem) {
-                // Floating elements that are attached to scrolling contents won't be correctly positioned if external scroll handling is enabled, fix here
-                if (context->externalScrollHandlingEnabled) {
-                    Clay_ScrollElementConfig *scrollConfig = Clay__FindElementConfigWithType(clipHashMapItem->layoutElement, CLAY__ELEMENT_CONFIG_TYPE_SCROLL).scrollElementConfig;
-                    for (int32_t i = 0; i < context->scrollContainerDatas.length; i++) {
-                        Clay__ScrollContainerDataInternal *mapping = Clay__ScrollContainerDataInternalArray_Get(&context->scrollContainerDatas, i);
-                        if (mapping->layoutElement == clipHashMapItem->layoutElement) {
-                            root->pointerOffset = mapping->scrollPosition;
-                            if (scrollConfig->horizontal) {
-                                rootPosition.x += mapping->scrollPosition.x;
-                            }
-                            if (scrollConfig->vertical) {
-                                rootPosition.y += mapping->scrollPosition.y;
-                            }
-                            break;
+    if (root->clipElementId) {
+        Clay_LayoutElementHashMapItem *clipHashMapItem = Clay__GetHashMapItem(root->clipElementId);
+        if (clipHashMapItem) {
+            // Floating elements that are attached to scrolling contents won't be correctly positioned if external scroll handling is enabled, fix here
+            if (context->externalScrollHandlingEnabled) {
+                Clay_ScrollElementConfig *scrollConfig = Clay__FindElementConfigWithType(clipHashMapItem->layoutElement, CLAY__ELEMENT_CONFIG_TYPE_SCROLL).scrollElementConfig;
+                for (int32_t i = 0; i < context->scrollContainerDatas.length; i++) {
+                    Clay__ScrollContainerDataInternal *mapping = Clay__ScrollContainerDataInternalArray_Get(&context->scrollContainerDatas, i);
+                    if (mapping->layoutElement == clipHashMapItem->layoutElement) {
+                        root->pointerOffset = mapping->scrollPosition;
+                        if (scrollConfig->horizontal) {
+                            rootPosition.x += mapping->scrollPosition.x;
                         }
+                        if (scrollConfig->vertical) {
+                            rootPosition.y += mapping->scrollPosition.y;
+                        }
+                        break;
                     }
                 }
-                Clay__AddRenderCommand(CLAY__INIT(Clay_RenderCommand) {
-                    .boundingBox = clipHashMapItem->boundingBox,
-                    .userData = 0,
-                    .id = Clay__HashNumber(rootElement->id, rootElement->childrenOrTextContent.children.length + 10).id, // TODO need a better strategy for managing derived ids
-                    .zIndex = root->zIndex,
-                    .commandType = CLAY_RENDER_COMMAND_TYPE_SCISSOR_START,
-                });
             }
+            Clay__AddLayoutRootRenderCommand(task, CLAY__INIT(Clay_RenderCommand) {
+                .boundingBox = clipHashMapItem->boundingBox,
+                .userData = 0,
+                .id = Clay__HashNumber(rootElement->id, rootElement->childrenOrTextContent.children.length + 10).id, // TODO need a better strategy for managing derived ids
+                .zIndex = root->zIndex,
+                .commandType = CLAY_RENDER_COMMAND_TYPE_SCISSOR_START,
+            });
         }
-        Clay__LayoutElementTreeNodeArray_Add(&dfsBuffer, CLAY__INIT(Clay__LayoutElementTreeNode) { .layoutElement = rootElement, .position = rootPosition, .nextChildOffset = { .x = (float)rootElement->layoutConfig->padding.left, .y = (float)rootElement->layoutConfig->padding.top } });
-
-        context->treeNodeVisited.internalArray[0] = false;
-        while (dfsBuffer.length > 0) {
-            Clay__LayoutElementTreeNode *currentElementTreeNode = Clay__LayoutElementTreeNodeArray_Get(&dfsBuffer, (int)dfsBuffer.length - 1);
-            Clay_LayoutElement *currentElement = currentElementTreeNode->layoutElement;
-            Clay_LayoutConfig *layoutConfig = currentElement->layoutConfig;
-            Clay_Vector2 scrollOffset = CLAY__DEFAULT_STRUCT;
+    }
+    Clay__LayoutElementTreeNodeArray_Add(&dfsBuffer, CLAY__INIT(Clay__LayoutElementTreeNode) { .layoutElement = rootElement, .position = rootPosition, .nextChildOffset = { .x = (float)rootElement->layoutConfig->padding.left, .y = (float)rootElement->layoutConfig->padding.top } });
 
-            // This will only be run a single time for each element in downwards DFS order
-            if (!context->treeNodeVisited.internalArray[dfsBuffer.length - 1]) {
-                context->treeNodeVisited.internalArray[dfsBuffer.length - 1] = true;
+    treeNodeVisited.internalArray[0] = false;
+    while (dfsBuffer.length > 0) {
+        Clay__LayoutElementTreeNode *currentElementTreeNode = Clay__LayoutElementTreeNodeArray_Get(&dfsBuffer, (int)dfsBuffer.length - 1);
+        Clay_LayoutElement *currentElement = currentElementTreeNode->layoutElement;
+        Clay_LayoutConfig *layoutConfig = currentElement->layoutConfig;
+        Clay_Vector2 scrollOffset = CLAY__DEFAULT_STRUCT;
+
+        // This will only be run a single time for each element in downwards DFS order
+        if (!treeNodeVisited.internalArray[dfsBuffer.length - 1]) {
+            treeNodeVisited.internalArray[dfsBuffer.length - 1] = true;
+
+            Clay_BoundingBox currentElementBoundingBox = { currentElementTreeNode->position.x, currentElementTreeNode->position.y, currentElement->dimensions.width, currentElement->dimensions.height };
+            if (Clay__ElementHasConfig(currentElement, CLAY__ELEMENT_CONFIG_TYPE_FLOATING)) {
+                Clay_FloatingElementConfig *floatingElementConfig = Clay__FindElementConfigWithType(currentElement, CLAY__ELEMENT_CONFIG_TYPE_FLOATING).floatingElementConfig;
+                Clay_Dimensions expand = floatingElementConfig->expand;
+                currentElementBoundingBox.x -= expand.width;
+                currentElementBoundingBox.width += expand.width * 2;
+                currentElementBoundingBox.y -= expand.height;
+                currentElementBoundingBox.height += expand.height * 2;
+            }
 
-                Clay_BoundingBox currentElementBoundingBox = { currentElementTreeNode->position.x, currentElementTreeNode->position.y, currentElement->dimensions.width, currentElement->dimensions.height };
-                if (Clay__ElementHasConfig(currentElement, CLAY__ELEMENT_CONFIG_TYPE_FLOATING)) {
-                    Clay_FloatingElementConfig *floatingElementConfig = Clay__FindElementConfigWithType(currentElement, CLAY__ELEMENT_CONFIG_TYPE_FLOATING).floatingElementConfig;
-                    Clay_Dimensions expand = floatingElementConfig->expand;
-                    currentElementBoundingBox.x -= expand.width;
-                    currentElementBoundingBox.width += expand.width * 2;
-                    currentElementBoundingBox.y -= expand.height;
-                    currentElementBoundingBox.height += expand.height * 2;
-                }
+            Clay__ScrollContainerDataInternal *scrollContainerData = CLAY__NULL;
+            // Apply scroll offsets to container
+            if (Clay__ElementHasConfig(currentElement, CLAY__ELEMENT_CONFIG_TYPE_SCROLL)) {
+                Clay_ScrollElementConfig *scrollConfig = Clay__FindElementConfigWithType(currentElement, CLAY__ELEMENT_CONFIG_TYPE_SCROLL).scrollElementConfig;
 
-                Clay__ScrollContainerDataInternal *scrollContainerData = CLAY__NULL;
-                // Apply scroll offsets to container
-                if (Clay__ElementHasConfig(currentElement, CLAY__ELEMENT_CONFIG_TYPE_SCROLL)) {
-                    Clay_ScrollElementConfig *scrollConfig = Clay__FindElementConfigWithType(currentElement, CLAY__ELEMENT_CONFIG_TYPE_SCROLL).scrollElementConfig;
-
-                    // This linear scan could theoretically be slow under very strange conditions, but I can't imagine a real UI with more than a few 10's of scroll containers
-                    for (int32_t i = 0; i < context->scrollContainerDatas.length; i++) {
-                        Clay__ScrollContainerDataInternal *mapping = Clay__ScrollContainerDataInternalArray_Get(&context->scrollContainerDatas, i);
-                        if (mapping->layoutElement == currentElement) {
-                            scrollContainerData = mapping;
-                            mapping->boundingBox = currentElementBoundingBox;
-                            if (scrollConfig->horizontal) {
-                                scrollOffset.x = mapping->scrollPosition.x;
-                            }
-                            if (scrollConfig->vertical) {
-                                scrollOffset.y = mapping->scrollPosition.y;
-                            }
-                            if (context->externalScrollHandlingEnabled) {
-                                scrollOffset = CLAY__INIT(Clay_Vector2) CLAY__DEFAULT_STRUCT;
-                            }
-                            break;
+                // This linear scan could theoretically be slow under very strange conditions, but I can't imagine a real UI with more than a few 10's of scroll containers
+                for (int32_t i = 0; i < context->scrollContainerDatas.length; i++) {
+                    Clay__ScrollContainerDataInternal *mapping = Clay__ScrollContainerDataInternalArray_Get(&context->scrollContainerDatas, i);
+                    if (mapping->layoutElement == currentElement) {
+                        scrollContainerData = mapping;
+                        mapping->boundingBox = currentElementBoundingBox;
+                        if (scrollConfig->horizontal) {
+                            scrollOffset.x = mapping->scrollPosition.x;
                         }
-                    }
-                }
-
-                Clay_LayoutElementHashMapItem *hashMapItem = Clay__GetHashMapItem(currentElement->id);
-                if (hashMapItem) {
-                    hashMapItem->boundingBox = currentElementBoundingBox;
-                    if (hashMapItem->idAlias) {
-                        Clay_LayoutElementHashMapItem *hashMapItemAlias = Clay__GetHashMapItem(hashMapItem->idAlias);
-                        if (hashMapItemAlias) {
-                            hashMapItemAlias->boundingBox = currentElementBoundingBox;
+                        if (scrollConfig->vertical) {
+                            scrollOffset.y = mapping->scrollPosition.y;
+                        }
+                        if (context->externalScrollHandlingEnabled) {
+                            scrollOffset = CLAY__INIT(Clay_Vector2) CLAY__DEFAULT_STRUCT;
                         }
+                        break;
                     }
                 }
+            }
 
-                int32_t sortedConfigIndexes[20];
-                for (int32_t elementConfigIndex = 0; elementConfigIndex < currentElement->elementConfigs.length; ++elementConfigIndex) {
-                    sortedConfigIndexes[elementConfigIndex] = elementConfigIndex;
-                }
-                sortMax = currentElement->elementConfigs.length - 1;
-                while (sortMax > 0) { // todo dumb bubble sort
-                    for (int32_t i = 0; i < sortMax; ++i) {
-                        int32_t current = sortedConfigIndexes[i];
-                        int32_t next = sortedConfigIndexes[i + 1];
-                        Clay__ElementConfigType currentType = Clay__ElementConfigArraySlice_Get(&currentElement->elementConfigs, current)->type;
-                        Clay__ElementConfigType nextType = Clay__ElementConfigArraySlice_Get(&currentElement->elementConfigs, next)->type;
-                        if (nextType == CLAY__ELEMENT_CONFIG_TYPE_SCROLL || currentType == CLAY__ELEMENT_CONFIG_TYPE_BORDER) {
-                            sortedConfigIndexes[i] = next;
-                            sortedConfigIndexes[i + 1] = current;
-                        }
+            Clay_LayoutElementHashMapItem *hashMapItem = Clay__GetLayoutElementHashMapItem(context, currentElement);
+            if (context->retainedLayoutSizing && hashMapItem != &Clay_LayoutElementHashMapItem_DEFAULT) {
+                hashMapItem->retainedFingerprint = currentElement->fingerprint;
+                hashMapItem->retainedIndex = (int32_t)(currentElement - context->layoutElements.internalArray);
+                hashMapItem->retainedGeneration = context->generation + 1;
+            }
+            if (hashMapItem) {
+                hashMapItem->boundingBox = currentElementBoundingBox;
+                if (hashMapItem->idAlias) {
+                    Clay_LayoutElementHashMapItem *hashMapItemAlias = Clay__GetHashMapItem(hashMapItem->idAlias);
+                    if (hashMapItemAlias) {
+                        hashMapItemAlias->boundingBox = currentElementBoundingBox;
                     }
-                    sortMax--;
                 }
+            }
 
-                bool emitRectangle = false;
-                // Create the render commands for this element
-                Clay_SharedElementConfig *sharedConfig = Clay__FindElementConfigWithType(currentElement, CLAY__ELEMENT_CONFIG_TYPE_SHARED).sharedElementConfig;
-                if (sharedConfig && sharedConfig->backgroundColor.a > 0) {
-                   emitRectangle = true;
-                }
-                else if (!sharedConfig) {
-                    emitRectangle = false;
-                    sharedConfig = &Clay_SharedElementConfig_DEFAULT;
+            int32_t sortedConfigIndexes[20];
+            for (int32_t elementConfigIndex = 0; elementConfigIndex < currentElement->elementConfigs.length; ++elementConfigIndex) {
+                sortedConfigIndexes[elementConfigIndex] = elementConfigIndex;
+            }
+            int32_t sortMax = currentElement->elementConfigs.length - 1;
+            while (sortMax > 0) { // todo dumb bubble sort
+                for (int32_t i = 0; i < sortMax; ++i) {
+                    int32_t current = sortedConfigIndexes[i];
+                    int32_t next = sortedConfigIndexes[i + 1];
+                    Clay__ElementConfigType currentType = Clay__ElementConfigArraySlice_Get(&currentElement->elementConfigs, current)->type;
+                    Clay__ElementConfigType nextType = Clay__ElementConfigArraySlice_Get(&currentElement->elementConfigs, next)->type;
+                    if (nextType == CLAY__ELEMENT_CONFIG_TYPE_SCROLL || currentType == CLAY__ELEMENT_CONFIG_TYPE_BORDER) {
+                        sortedConfigIndexes[i] = next;
+                        sortedConfigIndexes[i + 1] = current;
+                    }
                 }
-                for (int32_t elementConfigIndex = 0; elementConfigIndex < currentElement->elementConfigs.length; ++elementConfigIndex) {
-                    Clay_ElementConfig *elementConfig = Clay__ElementConfigArraySlice_Get(&currentElement->elementConfigs, sortedConfigIndexes[elementConfigIndex]);
-                    Clay_RenderCommand renderCommand = {
-                        .boundingBox = currentElementBoundingBox,
-                        .userData = sharedConfig->userData,
-                        .id = currentElement->id,
-                    };
+                sortMax--;
+            }
 
-                    bool offscreen = Clay__ElementIsOffscreen(&currentElementBoundingBox);
-                    // Culling - Don't bother to generate render commands for rectangles entirely outside the screen - this won't stop their children from being rendered if they overflow
-                    bool shouldRender = !offscreen;
-                    switch (elementConfig->type) {
-                        case CLAY__ELEMENT_CONFIG_TYPE_FLOATING:
-                        case CLAY__ELEMENT_CONFIG_TYPE_SHARED:
-                        case CLAY__ELEMENT_CONFIG_TYPE_BORDER: {
-                            shouldRender = false;
-                            break;
-                        }
-                        case CLAY__ELEMENT_CONFIG_TYPE_SCROLL: {
-                            renderCommand.commandType = CLAY_RENDER_COMMAND_TYPE_SCISSOR_START;
-                            break;
-                        }
-                        case CLAY__ELEMENT_CONFIG_TYPE_IMAGE: {
-                            renderCommand.commandType = CLAY_RENDER_COMMAND_TYPE_IMAGE;
-                            renderCommand.renderData = CLAY__INIT(Clay_RenderData) {
-                                .image = {
-                                    .backgroundColor = sharedConfig->backgroundColor,
-                                    .cornerRadius = sharedConfig->cornerRadius,
-                                    .sourceDimensions = elementConfig->config.imageElementConfig->sourceDimensions,
-                                    .imageData = elementConfig->config.imageElementConfig->imageData,
-                               }
-                            };
-                            emitRectangle = false;
+            bool emitRectangle = false;
+            // Create the render commands for this element
+            Clay_SharedElementConfig *sharedConfig = Clay__FindElementConfigWithType(currentElement, CLAY__ELEMENT_CONFIG_TYPE_SHARED).sharedElementConfig;
+            if (sharedConfig && sharedConfig->backgroundColor.a > 0) {
+               emitRectangle = true;
+            }
+            else if (!sharedConfig) {
+                emitRectangle = false;
+                sharedConfig = &Clay_SharedElementConfig_DEFAULT;
+            }
+            for (int32_t elementConfigIndex = 0; elementConfigIndex < currentElement->elementConfigs.length; ++elementConfigIndex) {
+                Clay_ElementConfig *elementConfig = Clay__ElementConfigArraySlice_Get(&currentElement->elementConfigs, sortedConfigIndexes[elementConfigIndex]);
+                Clay_RenderCommand renderCommand = {
+                    .boundingBox = currentElementBoundingBox,
+                    .userData = sharedConfig->userData,
+                    .id = currentElement->id,
+                };
+
+                bool offscreen = Clay__ElementIsOffscreen(&currentElementBoundingBox);
+                // Culling - Don't bother to generate render commands for rectangles entirely outside the screen - this won't stop their children from being rendered if they overflow
+                bool shouldRender = !offscreen;
+                switch (elementConfig->type) {
+                    case CLAY__ELEMENT_CONFIG_TYPE_FLOATING:
+                    case CLAY__ELEMENT_CONFIG_TYPE_SHARED:
+                    case CLAY__ELEMENT_CONFIG_TYPE_BORDER: {
+                        shouldRender = false;
+                        break;
+                    }
+                    case CLAY__ELEMENT_CONFIG_TYPE_SCROLL: {
+                        renderCommand.commandType = CLAY_RENDER_COMMAND_TYPE_SCISSOR_START;
+                        break;
+                    }
+                    case CLAY__ELEMENT_CONFIG_TYPE_IMAGE: {
+                        renderCommand.commandType = CLAY_RENDER_COMMAND_TYPE_IMAGE;
+                        renderCommand.renderData = CLAY__INIT(Clay_RenderData) {
+                            .image = {
+                                .backgroundColor = sharedConfig->backgroundColor,
+                                .cornerRadius = sharedConfig->cornerRadius,
+                                .sourceDimensions = elementConfig->config.imageElementConfig->sourceDimensions,
+                                .imageData = elementConfig->config.imageElementConfig->imageData,
+                           }
+                        };
+                        emitRectangle = false;
+                        break;
+                    }
+                    case CLAY__ELEMENT_CONFIG_TYPE_TEXT: {
+                        if (!shouldRender) {
                             break;
                         }
-                        case CLAY__ELEMENT_CONFIG_TYPE_TEXT: {
-                            if (!shouldRender) {
-                                break;
-                            }
-                            shouldRender = false;
-                            Clay_ElementConfigUnion configUnion = elementConfig->config;
-                            Clay_TextElementConfig *textElementConfig = configUnion.textElementConfig;
-                            float naturalLineHeight = currentElement->childrenOrTextContent.textElementData->preferredDimensions.height;
-                            float finalLineHeight = textElementConfig->lineHeight > 0 ? (float)textElementConfig->lineHeight : naturalLineHeight;
-                            float lineHeightOffset = (finalLineHeight - naturalLineHeight) / 2;
-                            float yPosition = lineHeightOffset;
-                            for (int32_t lineIndex = 0; lineIndex < currentElement->childrenOrTextContent.textElementData->wrappedLines.length; ++lineIndex) {
-                                Clay__WrappedTextLine *wrappedLine = Clay__WrappedTextLineArraySlice_Get(&currentElement->childrenOrTextContent.textElementData->wrappedLines, lineIndex);
-                                if (wrappedLine->line.length == 0) {
-                                    yPosition += finalLineHeight;
-                                    continue;
-                                }
-                                Clay__AddRenderCommand(CLAY__INIT(Clay_RenderCommand) {
-                                    .boundingBox = { currentElementBoundingBox.x, currentElementBoundingBox.y + yPosition, wrappedLine->dimensions.width, wrappedLine->dimensions.height },
-                                    .renderData = { .text = {
-                                        .stringContents = CLAY__INIT(Clay_StringSlice) { .length = wrappedLine->line.length, .chars = wrappedLine->line.chars, .baseChars = currentElement->childrenOrTextContent.textElementData->text.chars },
-                                        .textColor = textElementConfig->textColor,
-                                        .fontId = textElementConfig->fontId,
-                                        .fontSize = textElementConfig->fontSize,
-                                        .letterSpacing = textElementConfig->letterSpacing,
-                                        .lineHeight = textElementConfig->lineHeight,
-                                    }},
-                                    .userData = sharedConfig->userData,
-                                    .id = Clay__HashNumber(lineIndex, currentElement->id).id,
-                                    .zIndex = root->zIndex,
-                                    .commandType = CLAY_RENDER_COMMAND_TYPE_TEXT,
-                                });
+                        shouldRender = false;
+                        Clay_ElementConfigUnion configUnion = elementConfig->config;
+                        Clay_TextElementConfig *textElementConfig = configUnion.textElementConfig;
+                        float naturalLineHeight = currentElement->childrenOrTextContent.textElementData->preferredDimensions.height;
+                        float finalLineHeight = textElementConfig->lineHeight > 0 ? (float)textElementConfig->lineHeight : naturalLineHeight;
+                        float lineHeightOffset = (finalLineHeight - naturalLineHeight) / 2;
+                        float yPosition = lineHeightOffset;
+                        for (int32_t lineIndex = 0; lineIndex < currentElement->childrenOrTextContent.textElementData->wrappedLines.length; ++lineIndex) {
+                            Clay__WrappedTextLine *wrappedLine = Clay__WrappedTextLineArraySlice_Get(&currentElement->childrenOrTextContent.textElementData->wrappedLines, lineIndex);
+                            if (wrappedLine->line.length == 0) {
                                 yPosition += finalLineHeight;
+                                continue;
+                            }
+                            Clay__AddLayoutRootRenderCommand(task, CLAY__INIT(Clay_RenderCommand) {
+                                .boundingBox = { currentElementBoundingBox.x, currentElementBoundingBox.y + yPosition, wrappedLine->dimensions.width, wrappedLine->dimensions.height },
+                                .renderData = { .text = {
+                                    .stringContents = CLAY__INIT(Clay_StringSlice) { .length = wrappedLine->line.length, .chars = wrappedLine->line.chars, .baseChars = currentElement->childrenOrTextContent.textElementData->text.chars },
+                                    .textColor = textElementConfig->textColor,
+                                    .fontId = textElementConfig->fontId,
+                                    .fontSize = textElementConfig->fontSize,
+                                    .letterSpacing = textElementConfig->letterSpacing,
+                                    .lineHeight = textElementConfig->lineHeight,
+                                }},
+                                .userData = sharedConfig->userData,
+                                .id = Clay__HashNumber(lineIndex, currentElement->id).id,
+                                .zIndex = root->zIndex,
+                                .commandType = CLAY_RENDER_COMMAND_TYPE_TEXT,
+                            });
+                            yPosition += finalLineHeight;
 
-                                if (!context->disableCulling && (currentElementBoundingBox.y + yPosition > context->layoutDimensions.height)) {
-                                    break;
-                                }
+                            if (!context->disableCulling && (currentElementBoundingBox.y + yPosition > context->layoutDimensions.height)) {
+                                break;
                             }
-                            break;
-                        }
-                        case CLAY__ELEMENT_CONFIG_TYPE_CUSTOM: {
-                            renderCommand.commandType = CLAY_RENDER_COMMAND_TYPE_CUSTOM;
-                            renderCommand.renderData = CLAY__INIT(Clay_RenderData) {
-                                .custom = {
-                                    .backgroundColor = sharedConfig->backgroundColor,
-                                    .cornerRadius = sharedConfig->cornerRadius,
-                                    .customData = elementConfig->config.customElementConfig->customData,
-                                }
-                            };
-                            emitRectangle = false;
-                            break;
                         }
-                        default: break;
-                    }
-                    if (shouldRender) {
-                        Clay__AddRenderCommand(renderCommand);
-                    }
-                    if (offscreen) {
-                        // NOTE: You may be tempted to try an early return / continue if an element is off screen. Why bother calculating layout for its children, right?
-                        // Unfortunately, a FLOATING_CONTAINER may be defined that attaches to a child or grandchild of this element, which is large enough to still
-                        // be on screen, even if this element isn't. That depends on this element and it's children being laid out correctly (even if they are entirely off screen)
+                        break;
                     }
-                }
-
-                if (emitRectangle) {
-                    Clay__AddRenderCommand(CLAY__INIT(Clay_RenderCommand) {
-                        .boundingBox = currentElementBoundingBox,
-                        .renderData = { .rectangle = {
+                    case CLAY__ELEMENT_CONFIG_TYPE_CUSTOM: {
+                        renderCommand.commandType = CLAY_RENDER_COMMAND_TYPE_CUSTOM;
+                        renderCommand.renderData = CLAY__INIT(Clay_RenderData) {
+                            .custom = {
                                 .backgroundColor = sharedConfig->backgroundColor,
                                 .cornerRadius = sharedConfig->cornerRadius,
-                        }},
-                        .userData = sharedConfig->userData,
-                        .id = currentElement->id,
-                        .zIndex = root->zIndex,
-                        .commandType = CLAY_RENDER_COMMAND_TYPE_RECTANGLE,
-                    });
+                                .customData = elementConfig->config.customElementConfig->customData,
+                            }
+                        };
+                        emitRectangle = false;
+                        break;
+                    }
+                    default: break;
                 }
+                if (shouldRender) {
+                    Clay__AddLayoutRootRenderCommand(task, renderCommand);
+                }
+                if (offscreen) {
+                    // NOTE: You may be tempted to try an early return / continue if an element is off screen. Why bother calculating layout for its children, right?
+                    // Unfortunately, a FLOATING_CONTAINER may be defined that attaches to a child or grandchild of this element, which is large enough to still
+                    // be on screen, even if this element isn't. That depends on this element and it's children being laid out correctly (even if they are entirely off screen)
+                }
+            }
 
-                // Setup initial on-axis alignment
-                if (!Clay__ElementHasConfig(currentElementTreeNode->layoutElement, CLAY__ELEMENT_CONFIG_TYPE_TEXT)) {
-                    Clay_Dimensions contentSize = {0,0};
-                    if (layoutConfig->layoutDirection == CLAY_LEFT_TO_RIGHT) {
-                        for (int32_t i = 0; i < currentElement->childrenOrTextContent.children.length; ++i) {
-                            Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, currentElement->childrenOrTextContent.children.elements[i]);
-                            contentSize.width += childElement->dimensions.width;
-                            contentSize.height = CLAY__MAX(contentSize.height, childElement->dimensions.height);
-                        }
-                        contentSize.width += (float)(CLAY__MAX(currentElement->childrenOrTextContent.children.length - 1, 0) * layoutConfig->childGap);
-                        float extraSpace = currentElement->dimensions.width - (float)(layoutConfig->padding.left + layoutConfig->padding.right) - contentSize.width;
-                        switch (layoutConfig->childAlignment.x) {
-                            case CLAY_ALIGN_X_LEFT: extraSpace = 0; break;
-                            case CLAY_ALIGN_X_CENTER: extraSpace /= 2; break;
-                            default: break;
-                        }
-                        currentElementTreeNode->nextChildOffset.x += extraSpace;
-                    } else {
-                        for (int32_t i = 0; i < currentElement->childrenOrTextContent.children.length; ++i) {
-                            Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, currentElement->childrenOrTextContent.children.elements[i]);
-                            contentSize.width = CLAY__MAX(contentSize.width, childElement->dimensions.width);
-                            contentSize.height += childElement->dimensions.height;
-                        }
-                        contentSize.height += (float)(CLAY__MAX(currentElement->childrenOrTextContent.children.length - 1, 0) * layoutConfig->childGap);
-                        float extraSpace = currentElement->dimensions.height - (float)(layoutConfig->padding.top + layoutConfig->padding.bottom) - contentSize.height;
-                        switch (layoutConfig->childAlignment.y) {
-                            case CLAY_ALIGN_Y_TOP: extraSpace = 0; break;
-                            case CLAY_ALIGN_Y_CENTER: extraSpace /= 2; break;
-                            default: break;
-                        }
-                        currentElementTreeNode->nextChildOffset.y += extraSpace;
-                    }
+            if (emitRectangle) {
+                Clay__AddLayoutRootRenderCommand(task, CLAY__INIT(Clay_RenderCommand) {
+                    .boundingBox = currentElementBoundingBox,
+                    .renderData = { .rectangle = {
+                            .backgroundColor = sharedConfig->backgroundColor,
+                            .cornerRadius = sharedConfig->cornerRadius,
+                    }},
+                    .userData = sharedConfig->userData,
+                    .id = currentElement->id,
+                    .zIndex = root->zIndex,
+                    .commandType = CLAY_RENDER_COMMAND_TYPE_RECTANGLE,
+                });
+            }
 
-                    if (scrollContainerData) {
-                        scrollContainerData->contentSize = CLAY__INIT(Clay_Dimensions) { contentSize.width + (float)(layoutConfig->padding.left + layoutConfig->padding.right), contentSize.height + (float)(layoutConfig->padding.top + layoutConfig->padding.bottom) };
+            // Setup initial on-axis alignment
+            if (!Clay__ElementHasConfig(currentElementTreeNode->layoutElement, CLAY__ELEMENT_CONFIG_TYPE_TEXT)) {
+                Clay_Dimensions contentSize = {0,0};
+                if (layoutConfig->layoutDirection == CLAY_LEFT_TO_RIGHT) {
+                    for (int32_t i = 0; i < currentElement->childrenOrTextContent.children.length; ++i) {
+                        Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, currentElement->childrenOrTextContent.children.elements[i]);
+                        contentSize.width += childElement->dimensions.width;
+                        contentSize.height = CLAY__MAX(contentSize.height, childElement->dimensions.height);
                     }
+                    contentSize.width += (float)(CLAY__MAX(currentElement->childrenOrTextContent.children.length - 1, 0) * layoutConfig->childGap);
+                    float extraSpace = currentElement->dimensions.width - (float)(layoutConfig->padding.left + layoutConfig->padding.right) - contentSize.width;
+                    switch (layoutConfig->childAlignment.x) {
+                        case CLAY_ALIGN_X_LEFT: extraSpace = 0; break;
+                        case CLAY_ALIGN_X_CENTER: extraSpace /= 2; break;
+                        default: break;
+                    }
+                    currentElementTreeNode->nextChildOffset.x += extraSpace;
+                } else {
+                    for (int32_t i = 0; i < currentElement->childrenOrTextContent.children.length; ++i) {
+                        Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, currentElement->childrenOrTextContent.children.elements[i]);
+                        contentSize.width = CLAY__MAX(contentSize.width, childElement->dimensions.width);
+                        contentSize.height += childElement->dimensions.height;
+                    }
+                    contentSize.height += (float)(CLAY__MAX(currentElement->childrenOrTextContent.children.length - 1, 0) * layoutConfig->childGap);
+                    float extraSpace = currentElement->dimensions.height - (float)(layoutConfig->padding.top + layoutConfig->padding.bottom) - contentSize.height;
+                    switch (layoutConfig->childAlignment.y) {
+                        case CLAY_ALIGN_Y_TOP: extraSpace = 0; break;
+                        case CLAY_ALIGN_Y_CENTER: extraSpace /= 2; break;
+                        default: break;
+                    }
+                    currentElementTreeNode->nextChildOffset.y += extraSpace;
+                }
+
+                if (scrollContainerData) {
+                    scrollContainerData->contentSize = CLAY__INIT(Clay_Dimensions) { contentSize.width + (float)(layoutConfig->padding.left + layoutConfig->padding.right), contentSize.height + (float)(layoutConfig->padding.top + layoutConfig->padding.bottom) };
                 }
             }
-            else {
-                // DFS is returning upwards backwards
-                bool closeScrollElement = false;
-                Clay_ScrollElementConfig *scrollConfig = Clay__FindElementConfigWithType(currentElement, CLAY__ELEMENT_CONFIG_TYPE_SCROLL).scrollElementConfig;
-                if (scrollConfig) {
-                    closeScrollElement = true;
-                    for (int32_t i = 0; i < context->scrollContainerDatas.length; i++) {
-                        Clay__ScrollContainerDataInternal *mapping = Clay__ScrollContainerDataInternalArray_Get(&context->scrollContainerDatas, i);
-                        if (mapping->layoutElement == currentElement) {
-                            if (scrollConfig->horizontal) { scrollOffset.x = mapping->scrollPosition.x; }
-                            if (scrollConfig->vertical) { scrollOffset.y = mapping->scrollPosition.y; }
-                            if (context->externalScrollHandlingEnabled) {
-                                scrollOffset = CLAY__INIT(Clay_Vector2) CLAY__DEFAULT_STRUCT;
-                            }
-                            break;
+        }
+        else {
+            // DFS is returning upwards backwards
+            bool closeScrollElement = false;
+            Clay_ScrollElementConfig *scrollConfig = Clay__FindElementConfigWithType(currentElement, CLAY__ELEMENT_CONFIG_TYPE_SCROLL).scrollElementConfig;
+            if (scrollConfig) {
+                closeScrollElement = true;
+                for (int32_t i = 0; i < context->scrollContainerDatas.length; i++) {
+                    Clay__ScrollContainerDataInternal *mapping = Clay__ScrollContainerDataInternalArray_Get(&context->scrollContainerDatas, i);
+                    if (mapping->layoutElement == currentElement) {
+                        if (scrollConfig->horizontal) { scrollOffset.x = mapping->scrollPosition.x; }
+                        if (scrollConfig->vertical) { scrollOffset.y = mapping->scrollPosition.y; }
+                        if (context->externalScrollHandlingEnabled) {
+                            scrollOffset = CLAY__INIT(Clay_Vector2) CLAY__DEFAULT_STRUCT;
                         }
+                        break;
                     }
                 }
+            }
 
-                if (Clay__ElementHasConfig(currentElement, CLAY__ELEMENT_CONFIG_TYPE_BORDER)) {
-                    Clay_LayoutElementHashMapItem *currentElementData = Clay__GetHashMapItem(currentElement->id);
-                    Clay_BoundingBox currentElementBoundingBox = currentElementData->boundingBox;
-
-                    // Culling - Don't bother to generate render commands for rectangles entirely outside the screen - this won't stop their children from being rendered if they overflow
-                    if (!Clay__ElementIsOffscreen(&currentElementBoundingBox)) {
-                        Clay_SharedElementConfig *sharedConfig = Clay__ElementHasConfig(currentElement, CLAY__ELEMENT_CONFIG_TYPE_SHARED) ? Clay__FindElementConfigWithType(currentElement, CLAY__ELEMENT_CONFIG_TYPE_SHARED).sharedElementConfig : &Clay_SharedElementConfig_DEFAULT;
-                        Clay_BorderElementConfig *borderConfig = Clay__FindElementConfigWithType(currentElement, CLAY__ELEMENT_CONFIG_TYPE_BORDER).borderElementConfig;
-                        Clay_RenderCommand renderCommand = {
-                                .boundingBox = currentElementBoundingBox,
-                                .renderData = { .border = {
-                                    .color = borderConfig->color,
-                                    .cornerRadius = sharedConfig->cornerRadius,
-                                    .width = borderConfig->width
-                                }},
-                                .userData = sharedConfig->userData,
-                                .id = Clay__HashNumber(currentElement->id, currentElement->childrenOrTextContent.children.length).id,
-                                .commandType = CLAY_RENDER_COMMAND_TYPE_BORDER,
-                        };
-                        Clay__AddRenderCommand(renderCommand);
-                        if (borderConfig->width.betweenChildren > 0 && borderConfig->color.a > 0) {
-                            float halfGap = layoutConfig->childGap / 2;
-                            Clay_Vector2 borderOffset = { (float)layoutConfig->padding.left - halfGap, (float)layoutConfig->padding.top - halfGap };
-                            if (layoutConfig->layoutDirection == CLAY_LEFT_TO_RIGHT) {
-                                for (int32_t i = 0; i < currentElement->childrenOrTextContent.children.length; ++i) {
-                                    Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, currentElement->childrenOrTextContent.children.elements[i]);
-                                    if (i > 0) {
-                                        Clay__AddRenderCommand(CLAY__INIT(Clay_RenderCommand) {
-                                            .boundingBox = { currentElementBoundingBox.x + borderOffset.x + scrollOffset.x, currentElementBoundingBox.y + scrollOffset.y, (float)borderConfig->width.betweenChildren, currentElement->dimensions.height },
-                                            .renderData = { .rectangle = {
-                                                .backgroundColor = borderConfig->color,
-                                            } },
-                                            .userData = sharedConfig->userData,
-                                            .id = Clay__HashNumber(currentElement->id, currentElement->childrenOrTextContent.children.length + 1 + i).id,
-                                            .commandType = CLAY_RENDER_COMMAND_TYPE_RECTANGLE,
-                                        });
-                                    }
-                                    borderOffset.x += (childElement->dimensions.width + (float)layoutConfig->childGap);
+            if (Clay__ElementHasConfig(currentElement, CLAY__ELEMENT_CONFIG_TYPE_BORDER)) {
+                Clay_LayoutElementHashMapItem *currentElementData = Clay__GetLayoutElementHashMapItem(context, currentElement);
+                Clay_BoundingBox currentElementBoundingBox = currentElementData->boundingBox;
+
+                // Culling - Don't bother to generate render commands for rectangles entirely outside the screen - this won't stop their children from being rendered if they overflow
+                if (!Clay__ElementIsOffscreen(&currentElementBoundingBox)) {
+                    Clay_SharedElementConfig *sharedConfig = Clay__ElementHasConfig(currentElement, CLAY__ELEMENT_CONFIG_TYPE_SHARED) ? Clay__FindElementConfigWithType(currentElement, CLAY__ELEMENT_CONFIG_TYPE_SHARED).sharedElementConfig : &Clay_SharedElementConfig_DEFAULT;
+                    Clay_BorderElementConfig *borderConfig = Clay__FindElementConfigWithType(currentElement, CLAY__ELEMENT_CONFIG_TYPE_BORDER).borderElementConfig;
+                    Clay_RenderCommand renderCommand = {
+                            .boundingBox = currentElementBoundingBox,
+                            .renderData = { .border = {
+                                .color = borderConfig->color,
+                                .cornerRadius = sharedConfig->cornerRadius,
+                                .width = borderConfig->width
+                            }},
+                            .userData = sharedConfig->userData,
+                            .id = Clay__HashNumber(currentElement->id, currentElement->childrenOrTextContent.children.length).id,
+                            .commandType = CLAY_RENDER_COMMAND_TYPE_BORDER,
+                    };
+                    Clay__AddLayoutRootRenderCommand(task, renderCommand);
+                    if (borderConfig->width.betweenChildren > 0 && borderConfig->color.a > 0) {
+                        float halfGap = layoutConfig->childGap / 2;
+                        Clay_Vector2 borderOffset = { (float)layoutConfig->padding.left - halfGap, (float)layoutConfig->padding.top - halfGap };
+                        if (layoutConfig->layoutDirection == CLAY_LEFT_TO_RIGHT) {
+                            for (int32_t i = 0; i < currentElement->childrenOrTextContent.children.length; ++i) {
+                                Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, currentElement->childrenOrTextContent.children.elements[i]);
+                                if (i > 0) {
+                                    Clay__AddLayoutRootRenderCommand(task, CLAY__INIT(Clay_RenderCommand) {
+                                        .boundingBox = { currentElementBoundingBox.x + borderOffset.x + scrollOffset.x, currentElementBoundingBox.y + scrollOffset.y, (float)borderConfig->width.betweenChildren, currentElement->dimensions.height },
+                                        .renderData = { .rectangle = {
+                                            .backgroundColor = borderConfig->color,
+                                        } },
+                                        .userData = sharedConfig->userData,
+                                        .id = Clay__HashNumber(currentElement->id, currentElement->childrenOrTextContent.children.length + 1 + i).id,
+                                        .commandType = CLAY_RENDER_COMMAND_TYPE_RECTANGLE,
+                                    });
                                 }
-                            } else {
-                                for (int32_t i = 0; i < currentElement->childrenOrTextContent.children.length; ++i) {
-                                    Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, currentElement->childrenOrTextContent.children.elements[i]);
-                                    if (i > 0) {
-                                        Clay__AddRenderCommand(CLAY__INIT(Clay_RenderCommand) {
-                                            .boundingBox = { currentElementBoundingBox.x + scrollOffset.x, currentElementBoundingBox.y + borderOffset.y + scrollOffset.y, currentElement->dimensions.width, (float)borderConfig->width.betweenChildren },
-                                            .renderData = { .rectangle = {
-                                                    .backgroundColor = borderConfig->color,
-                                            } },
-                                            .userData = sharedConfig->userData,
-                                            .id = Clay__HashNumber(currentElement->id, currentElement->childrenOrTextContent.children.length + 1 + i).id,
-                                            .commandType = CLAY_RENDER_COMMAND_TYPE_RECTANGLE,
-                                        });
-                                    }
-                                    borderOffset.y += (childElement->dimensions.height + (float)layoutConfig->childGap);
+                                borderOffset.x += (childElement->dimensions.width + (float)layoutConfig->childGap);
+                            }
+                        } else {
+                            for (int32_t i = 0; i < currentElement->childrenOrTextContent.children.length; ++i) {
+                                Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, currentElement->childrenOrTextContent.children.elements[i]);
+                                if (i > 0) {
+                                    Clay__AddLayoutRootRenderCommand(task, CLAY__INIT(Clay_RenderCommand) {
+                                        .boundingBox = { currentElementBoundingBox.x + scrollOffset.x, currentElementBoundingBox.y + borderOffset.y + scrollOffset.y, currentElement->dimensions.width, (float)borderConfig->width.betweenChildren },
+                                        .renderData = { .rectangle = {
+                                                .backgroundColor = borderConfig->color,
+                                        } },
+                                        .userData = sharedConfig->userData,
+                                        .id = Clay__HashNumber(currentElement->id, currentElement->childrenOrTextContent.children.length + 1 + i).id,
+                                        .commandType = CLAY_RENDER_COMMAND_TYPE_RECTANGLE,
+                                    });
                                 }
+                                borderOffset.y += (childElement->dimensions.height + (float)layoutConfig->childGap);
                             }
                         }
                     }
                 }
-                // This exists because the scissor needs to end _after_ borders between elements
-                if (closeScrollElement) {
-                    Clay__AddRenderCommand(CLAY__INIT(Clay_RenderCommand) {
-                        .id = Clay__HashNumber(currentElement->id, rootElement->childrenOrTextContent.children.length + 11).id,
-                        .commandType = CLAY_RENDER_COMMAND_TYPE_SCISSOR_END,
-                    });
+            }
+            // This exists because the scissor needs to end _after_ borders between elements
+            if (closeScrollElement) {
+                Clay__AddLayoutRootRenderCommand(task, CLAY__INIT(Clay_RenderCommand) {
+                    .id = Clay__HashNumber(currentElement->id, rootElement->childrenOrTextContent.children.length + 11).id,
+                    .commandType = CLAY_RENDER_COMMAND_TYPE_SCISSOR_END,
+                });
+            }
+
+            dfsBuffer.length--;
+            continue;
+        }
+
+        // Add children to the DFS buffer
+        if (!Clay__ElementHasConfig(currentElement, CLAY__ELEMENT_CONFIG_TYPE_TEXT)) {
+            dfsBuffer.length += currentElement->childrenOrTextContent.children.length;
+            for (int32_t i = 0; i < currentElement->childrenOrTextContent.children.length; ++i) {
+                Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, currentElement->childrenOrTextContent.children.elements[i]);
+                // Alignment along non layout axis
+                if (layoutConfig->layoutDirection == CLAY_LEFT_TO_RIGHT) {
+                    currentElementTreeNode->nextChildOffset.y = currentElement->layoutConfig->padding.top;
+                    float whiteSpaceAroundChild = currentElement->dimensions.height - (float)(layoutConfig->padding.top + layoutConfig->padding.bottom) - childElement->dimensions.height;
+                    switch (layoutConfig->childAlignment.y) {
+                        case CLAY_ALIGN_Y_TOP: break;
+                        case CLAY_ALIGN_Y_CENTER: currentElementTreeNode->nextChildOffset.y += whiteSpaceAroundChild / 2; break;
+                        case CLAY_ALIGN_Y_BOTTOM: currentElementTreeNode->nextChildOffset.y += whiteSpaceAroundChild; break;
+                    }
+                } else {
+                    currentElementTreeNode->nextChildOffset.x = currentElement->layoutConfig->padding.left;
+                    float whiteSpaceAroundChild = currentElement->dimensions.width - (float)(layoutConfig->padding.left + layoutConfig->padding.right) - childElement->dimensions.width;
+                    switch (layoutConfig->childAlignment.x) {
+                        case CLAY_ALIGN_X_LEFT: break;
+                        case CLAY_ALIGN_X_CENTER: currentElementTreeNode->nextChildOffset.x += whiteSpaceAroundChild / 2; break;
+                        case CLAY_ALIGN_X_RIGHT: currentElementTreeNode->nextChildOffset.x += whiteSpaceAroundChild; break;
+                    }
                 }
 
-                dfsBuffer.length--;
+                Clay_Vector2 childPosition = {
+                    currentElementTreeNode->position.x + currentElementTreeNode->nextChildOffset.x + scrollOffset.x,
+                    currentElementTreeNode->position.y + currentElementTreeNode->nextChildOffset.y + scrollOffset.y,
+                };
+
+                // DFS buffer elements need to be added in reverse because stack traversal happens backwards
+                uint32_t newNodeIndex = dfsBuffer.length - 1 - i;
+                dfsBuffer.internalArray[newNodeIndex] = CLAY__INIT(Clay__LayoutElementTreeNode) {
+                    .layoutElement = childElement,
+                    .position = { childPosition.x, childPosition.y },
+                    .nextChildOffset = { .x = (float)childElement->layoutConfig->padding.left, .y = (float)childElement->layoutConfig->padding.top },
+                };
+                treeNodeVisited.internalArray[newNodeIndex] = false;
+
+                // Update parent offsets
+                if (layoutConfig->layoutDirection == CLAY_LEFT_TO_RIGHT) {
+                    currentElementTreeNode->nextChildOffset.x += childElement->dimensions.width + (float)layoutConfig->childGap;
+                } else {
+                    currentElementTreeNode->nextChildOffset.y += childElement->dimensions.height + (float)layoutConfig->childGap;
+                }
+            }
+        }
+    }
+
+    if (root->clipElementId) {
+        Clay__AddLayoutRootRenderCommand(task, CLAY__INIT(Clay_RenderCommand) { .id = Clay__HashNumber(rootElement->id, rootElement->childrenOrTextContent.children.length + 11).id, .commandType = CLAY_RENDER_COMMAND_TYPE_SCISSOR_END });
+    }
+}
+
+// Finds out which tree roots can be laid out at the same time. A root depends on the roots holding the element it is
+// attached to and its clip element, so roots are given levels where every root only depends on roots of lower levels.
+// The roots of a level can then be laid out in parallel once the previous level is done, giving the same result as
+// laying them out one at a time. Returns false if that isn't possible or wouldn't help.
+bool Clay__ScheduleLayoutRoots(Clay_Context *context) {
+    Clay__LayoutElementTreeRootArray *roots = &context->layoutElementTreeRoots;
+    if (!context->parallelLayoutRoots || !context->parallelForFunction || roots->length < 2) {
+        return false;
+    }
+    Clay__LayoutRootTaskArray *tasks = &context->layoutRootTasks;
+    tasks->length = roots->length;
+    for (int32_t i = 0; i < context->layoutElements.length; ++i) {
+        context->layoutElementRoots.internalArray[i] = -1;
+    }
+    // Find the elements of each tree, the stack never holds more elements than the tree being walked has
+    Clay__int32_tArray stack = context->reusableElementIndexBuffer;
+    int32_t totalElementCount = 0;
+    for (int32_t rootIndex = 0; rootIndex < roots->length; ++rootIndex) {
+        int32_t rootElementIndex = roots->internalArray[rootIndex].layoutElementIndex;
+        Clay__LayoutRootTask *task = &tasks->internalArray[rootIndex];
+        *task = CLAY__INIT(Clay__LayoutRootTask) { .firstElement = totalElementCount };
+        context->layoutRootIndexes.internalArray[rootElementIndex] = rootIndex;
+        stack.length = 0;
+        stack.internalArray[stack.length++] = rootElementIndex;
+        while (stack.length > 0) {
+            int32_t elementIndex = stack.internalArray[--stack.length];
+            Clay_LayoutElement *element = &context->layoutElements.internalArray[elementIndex];
+            // Positioning writes the bounding box of the hash map items found by id, which is only safe if nothing else shares them
+            Clay_LayoutElementHashMapItem *hashMapItem = Clay__GetLayoutElementHashMapItem(context, element);
+            if (hashMapItem->layoutElement != element || (hashMapItem->idAlias && Clay__GetHashMapItem(hashMapItem->idAlias)->layoutElement != element)) {
+                return false;
+            }
+            context->layoutElementRoots.internalArray[elementIndex] = rootElementIndex;
+            task->elementCount++;
+            if (!Clay__ElementHasConfig(element, CLAY__ELEMENT_CONFIG_TYPE_TEXT)) {
+                for (int32_t i = 0; i < element->childrenOrTextContent.children.length; ++i) {
+                    stack.internalArray[stack.length++] = element->childrenOrTextContent.children.elements[i];
+                }
+            }
+        }
+        totalElementCount += task->elementCount;
+    }
+
+    int32_t levelCount = 0;
+    for (int32_t rootIndex = 0; rootIndex < roots->length; ++rootIndex) {
+        Clay__LayoutElementTreeRoot *root = &roots->internalArray[rootIndex];
+        Clay__LayoutRootTask *task = &tasks->internalArray[rootIndex];
+        uint32_t dependencyIds[2] = { root->parentId, root->clipElementId };
+        for (int32_t i = 0; i < 2; ++i) {
+            Clay_LayoutElement *dependency = dependencyIds[i] ? Clay__GetHashMapItem(dependencyIds[i])->layoutElement : CLAY__NULL;
+            if (!dependency) {
+                continue;
+            }
+            // Elements that weren't declared this frame may point anywhere in the element array, nothing lays them out
+            int32_t elementIndex = (int32_t)(dependency - context->layoutElements.internalArray);
+            if (elementIndex < 0 || elementIndex >= context->layoutElements.length || context->layoutElementRoots.internalArray[elementIndex] == -1) {
                 continue;
             }
+            int32_t dependencyRootIndex = context->layoutRootIndexes.internalArray[context->layoutElementRoots.internalArray[elementIndex]];
+            // One at a time this root would see what a later root had the previous frame, only doing that keeps the result
+            if (dependencyRootIndex > rootIndex) {
+                return false;
+            }
+            if (dependencyRootIndex < rootIndex) {
+                task->level = CLAY__MAX(task->level, tasks->internalArray[dependencyRootIndex].level + 1);
+            }
+        }
+        levelCount = CLAY__MAX(levelCount, task->level + 1);
+    }
+    if (levelCount == roots->length) {
+        return false;
+    }
 
-            // Add children to the DFS buffer
-            if (!Clay__ElementHasConfig(currentElement, CLAY__ELEMENT_CONFIG_TYPE_TEXT)) {
-                dfsBuffer.length += currentElement->childrenOrTextContent.children.length;
-                for (int32_t i = 0; i < currentElement->childrenOrTextContent.children.length; ++i) {
-                    Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, currentElement->childrenOrTextContent.children.elements[i]);
-                    // Alignment along non layout axis
-                    if (layoutConfig->layoutDirection == CLAY_LEFT_TO_RIGHT) {
-                        currentElementTreeNode->nextChildOffset.y = currentElement->layoutConfig->padding.top;
-                        float whiteSpaceAroundChild = currentElement->dimensions.height - (float)(layoutConfig->padding.top + layoutConfig->padding.bottom) - childElement->dimensions.height;
-                        switch (layoutConfig->childAlignment.y) {
-                            case CLAY_ALIGN_Y_TOP: break;
-                            case CLAY_ALIGN_Y_CENTER: currentElementTreeNode->nextChildOffset.y += whiteSpaceAroundChild / 2; break;
-                            case CLAY_ALIGN_Y_BOTTOM: currentElementTreeNode->nextChildOffset.y += whiteSpaceAroundChild; break;
-                        }
-                    } else {
-                        currentElementTreeNode->nextChildOffset.x = currentElement->layoutConfig->padding.left;
-                        float whiteSpaceAroundChild = currentElement->dimensions.width - (float)(layoutConfig->padding.left + layoutConfig->padding.right) - childElement->dimensions.width;
-                        switch (layoutConfig->childAlignment.x) {
-                            case CLAY_ALIGN_X_LEFT: break;
-                            case CLAY_ALIGN_X_CENTER: currentElementTreeNode->nextChildOffset.x += whiteSpaceAroundChild / 2; break;
-                            case CLAY_ALIGN_X_RIGHT: currentElementTreeNode->nextChildOffset.x += whiteSpaceAroundChild; break;
-                        }
-                    }
+    // Group the roots by level, keeping their order within each level
+    Clay__int32_tArray levelStarts = context->reusableElementIndexBuffer;
+    for (int32_t i = 0; i <= levelCount; ++i) {
+        levelStarts.internalArray[i] = 0;
+    }
+    for (int32_t rootIndex = 0; rootIndex < roots->length; ++rootIndex) {
+        levelStarts.internalArray[tasks->internalArray[rootIndex].level + 1]++;
+    }
+    for (int32_t i = 1; i <= levelCount; ++i) {
+        levelStarts.internalArray[i] += levelStarts.internalArray[i - 1];
+    }
+    for (int32_t rootIndex = 0; rootIndex < roots->length; ++rootIndex) {
+        context->layoutRootOrder.internalArray[levelStarts.internalArray[tasks->internalArray[rootIndex].level]++] = rootIndex;
+    }
 
-                    Clay_Vector2 childPosition = {
-                        currentElementTreeNode->position.x + currentElementTreeNode->nextChildOffset.x + scrollOffset.x,
-                        currentElementTreeNode->position.y + currentElementTreeNode->nextChildOffset.y + scrollOffset.y,
-                    };
+    // Split the render commands between the roots by how many elements they have, in the order they are generated
+    int32_t renderCommandCapacity = context->renderCommands.capacity - 1; // Clay__AddRenderCommand() never uses the last one
+    for (int32_t rootIndex = 0; rootIndex < roots->length; ++rootIndex) {
+        Clay__LayoutRootTask *task = &tasks->internalArray[rootIndex];
+        int32_t firstRenderCommand = (int32_t)((int64_t)renderCommandCapacity * task->firstElement / totalElementCount);
+        int32_t lastRenderCommand = (int32_t)((int64_t)renderCommandCapacity * (task->firstElement + task->elementCount) / totalElementCount);
+        task->renderCommands = CLAY__INIT(Clay_RenderCommandArray) { .capacity = lastRenderCommand - firstRenderCommand, .length = 0, .internalArray = &context->renderCommands.internalArray[firstRenderCommand] };
+    }
+    return true;
+}
 
-                    // DFS buffer elements need to be added in reverse because stack traversal happens backwards
-                    uint32_t newNodeIndex = dfsBuffer.length - 1 - i;
-                    dfsBuffer.internalArray[newNodeIndex] = CLAY__INIT(Clay__LayoutElementTreeNode) {
-                        .layoutElement = childElement,
-                        .position = { childPosition.x, childPosition.y },
-                        .nextChildOffset = { .x = (float)childElement->layoutConfig->padding.left, .y = (float)childElement->layoutConfig->padding.top },
-                    };
-                    context->treeNodeVisited.internalArray[newNodeIndex] = false;
+typedef struct {
+    Clay_Context *context;
+    bool position; // Otherwise size along the given axis
+    bool xAxis;
+    int32_t *rootIndexes;
+} Clay__LayoutRootTaskData;
+
+Clay__int32_tArray Clay__LayoutRootScratchBuffer(Clay__int32_tArray *buffer, Clay__LayoutRootTask *task) {
+    return CLAY__INIT(Clay__int32_tArray) { .capacity = task->elementCount, .length = 0, .internalArray = &buffer->internalArray[task->firstElement] };
+}
 
-                    // Update parent offsets
-                    if (layoutConfig->layoutDirection == CLAY_LEFT_TO_RIGHT) {
-                        currentElementTreeNode->nextChildOffset.x += childElement->dimensions.width + (float)layoutConfig->childGap;
-                    } else {
-                        currentElementTreeNode->nextChildOffset.y += childElement->dimensions.height + (float)layoutConfig->childGap;
-                    }
+void Clay__LayoutRootTaskFunction(void *taskData, int32_t taskIndex) {
+    Clay__LayoutRootTaskData *data = (Clay__LayoutRootTaskData *)taskData;
+    Clay_Context *context = data->context;
+    // Array range errors report through the current context, which may be thread local
+    Clay_SetCurrentContext(context);
+    int32_t rootIndex = data->rootIndexes[taskIndex];
+    Clay__LayoutElementTreeRoot *root = &context->layoutElementTreeRoots.internalArray[rootIndex];
+    Clay__LayoutRootTask *task = &context->layoutRootTasks.internalArray[rootIndex];
+    if (data->position) {
+        Clay__LayoutElementTreeNodeArray dfsBuffer = { .capacity = task->elementCount, .length = 0, .internalArray = &context->layoutElementTreeNodeArray1.internalArray[task->firstElement] };
+        Clay__boolArray treeNodeVisited = { .capacity = task->elementCount, .length = task->elementCount, .internalArray = &context->treeNodeVisited.internalArray[task->firstElement] };
+        Clay__PositionLayoutRoot(root, dfsBuffer, treeNodeVisited, task);
+    } else {
+        Clay__SizeLayoutRootAlongAxis(root, data->xAxis,
+            Clay__LayoutRootScratchBuffer(&context->layoutElementChildrenBuffer, task),
+            Clay__LayoutRootScratchBuffer(&context->openLayoutElementStack, task),
+            Clay__LayoutRootScratchBuffer(&context->openClipElementStack, task));
+    }
+}
+
+// Runs the task for every root scheduled by Clay__ScheduleLayoutRoots(), one level after the other
+void Clay__RunLayoutRootTasks(Clay_Context *context, Clay__LayoutRootTaskData *data) {
+    Clay__int32_tArray *order = &context->layoutRootOrder;
+    int32_t firstRoot = 0;
+    while (firstRoot < context->layoutElementTreeRoots.length) {
+        int32_t level = context->layoutRootTasks.internalArray[order->internalArray[firstRoot]].level;
+        int32_t lastRoot = firstRoot + 1;
+        while (lastRoot < context->layoutElementTreeRoots.length && context->layoutRootTasks.internalArray[order->internalArray[lastRoot]].level == level) {
+            lastRoot++;
+        }
+        data->rootIndexes = &order->internalArray[firstRoot];
+        if (lastRoot - firstRoot == 1) {
+            Clay__LayoutRootTaskFunction(data, 0);
+        } else {
+            context->parallelForFunction(Clay__LayoutRootTaskFunction, data, lastRoot - firstRoot, context->parallelForUserData);
+        }
+        firstRoot = lastRoot;
+    }
+}
+
+void Clay__SizeContainersAlongAxis(bool xAxis) {
+    Clay_Context* context = Clay_GetCurrentContext();
+    if (Clay__ScheduleLayoutRoots(context)) {
+        Clay__LayoutRootTaskData data = { .context = context, .xAxis = xAxis };
+        Clay__RunLayoutRootTasks(context, &data);
+        return;
+    }
+    // Built once per frame, by the first pass that gets here
+    if (context->compactLayoutSizing && (context->compactElementIndexes.length > 0 || Clay__BuildCompactLayout(context))) {
+        Clay__SizeCompactLayoutAlongAxis(context, xAxis);
+        return;
+    }
+    for (int32_t rootIndex = 0; rootIndex < context->layoutElementTreeRoots.length; ++rootIndex) {
+        Clay__LayoutElementTreeRoot *root = Clay__LayoutElementTreeRootArray_Get(&context->layoutElementTreeRoots, rootIndex);
+        Clay__SizeLayoutRootAlongAxis(root, xAxis, context->layoutElementChildrenBuffer, context->openLayoutElementStack, context->openClipElementStack);
+    }
+}
+
+// Positions the roots scheduled by Clay__ScheduleLayoutRoots() in parallel, then compacts their render commands in order.
+// If a root ran out of space for its commands, it and every root after it need to be positioned again one at a time,
+// which comes out the same as they only depend on the roots before them. Returns the index of the first of those.
+int32_t Clay__PositionLayoutRootsParallel(Clay_Context *context) {
+    Clay__LayoutRootTaskData data = { .context = context, .position = true };
+    Clay__RunLayoutRootTasks(context, &data);
+    context->renderCommands.length = 0;
+    for (int32_t rootIndex = 0; rootIndex < context->layoutElementTreeRoots.length; ++rootIndex) {
+        Clay__LayoutRootTask *task = &context->layoutRootTasks.internalArray[rootIndex];
+        if (task->exceededCapacity) {
+            return rootIndex;
+        }
+        Clay_RenderCommand *destination = &context->renderCommands.internalArray[context->renderCommands.length];
+        if (destination != task->renderCommands.internalArray) {
+            // Slices are compacted towards the start of the array, so copying forwards never overwrites unread commands
+            for (int32_t i = 0; i < task->renderCommands.length; ++i) {
+                destination[i] = task->renderCommands.internalArray[i];
+            }
+        }
+        context->renderCommands.length += task->renderCommands.length;
+    }
+    return context->layoutElementTreeRoots.length;
+}
+
+// Stable sort of the tree roots by z-index, roots with the same z-index keep the order they were declared in.
+// Sorts the root indexes with a bottom up merge sort using scratch buffers that are free once sizing is done,
+// then moves the roots into place one cycle of the permutation at a time.
+void Clay__SortLayoutElementTreeRoots(Clay_Context *context) {
+    Clay__LayoutElementTreeRoot *roots = context->layoutElementTreeRoots.internalArray;
+    int32_t rootCount = context->layoutElementTreeRoots.length;
+    bool sorted = true;
+    for (int32_t i = 1; i < rootCount; ++i) {
+        if (roots[i].zIndex < roots[i - 1].zIndex) {
+            sorted = false;
+            break;
+        }
+    }
+    // Usually all the roots share a z-index, or were declared in order
+    if (sorted) {
+        return;
+    }
+
+    int32_t *source = context->reusableElementIndexBuffer.internalArray;
+    int32_t *destination = context->layoutElementChildrenBuffer.internalArray;
+    for (int32_t i = 0; i < rootCount; ++i) {
+        source[i] = i;
+    }
+    for (int32_t width = 1; width < rootCount; width *= 2) {
+        for (int32_t left = 0; left < rootCount; left += width * 2) {
+            int32_t middle = CLAY__MIN(left + width, rootCount);
+            int32_t right = CLAY__MIN(left + width * 2, rootCount);
+            int32_t i = left, j = middle, k = left;
+            while (i < middle && j < right) {
+                // Only take from the right run when strictly smaller, which keeps the sort stable
+                destination[k++] = roots[source[j]].zIndex < roots[source[i]].zIndex ? source[j++] : source[i++];
+            }
+            while (i < middle) {
+                destination[k++] = source[i++];
+            }
+            while (j < right) {
+                destination[k++] = source[j++];
+            }
+        }
+        int32_t *swap = source;
+        source = destination;
+        destination = swap;
+    }
+
+    // source[i] is now the index of the root that belongs at i, positions already filled are marked with -1
+    for (int32_t start = 0; start < rootCount; ++start) {
+        if (source[start] == -1 || source[start] == start) {
+            continue;
+        }
+        Clay__LayoutElementTreeRoot startRoot = roots[start];
+        int32_t position = start;
+        while (source[position] != start) {
+            int32_t next = source[position];
+            roots[position] = roots[next];
+            source[position] = -1;
+            position = next;
+        }
+        roots[position] = startRoot;
+        source[position] = -1;
+    }
+}
+
+void Clay__CalculateFinalLayout(void) {
+    Clay_Context* context = Clay_GetCurrentContext();
+    // Calculate sizing along the X axis
+    Clay__SizeContainersAlongAxis(true);
+
+    // Wrap text
+    int32_t firstSerialTextElement = 0;
+    int32_t parallelTaskCount = CLAY__MIN(context->textElementData.length / CLAY__PARALLEL_TEXT_WRAP_MIN_ELEMENTS_PER_TASK, CLAY__PARALLEL_TEXT_WRAP_MAX_TASKS);
+    if (context->parallelForFunction && parallelTaskCount > 1) {
+        firstSerialTextElement = Clay__WrapTextParallel(context, parallelTaskCount);
+    }
+    bool wrappedTextLinesExceeded = false;
+    for (int32_t textElementIndex = firstSerialTextElement; textElementIndex < context->textElementData.length; ++textElementIndex) {
+        if (!Clay__WrapTextElement(context, &context->textElementData.internalArray[textElementIndex], &context->wrappedTextLines) && !wrappedTextLinesExceeded) {
+            wrappedTextLinesExceeded = true;
+            context->errorHandler.errorHandlerFunction(CLAY__INIT(Clay_ErrorData) {
+                .errorType = CLAY_ERROR_TYPE_ELEMENTS_CAPACITY_EXCEEDED,
+                .errorText = CLAY_STRING("Clay ran out of capacity while wrapping text elements. Try using Clay_SetMaxElementCount() with a higher value."),
+                .userData = context->errorHandler.userData });
+        }
+    }
+
+    // Scale vertical image heights according to aspect ratio
+    for (int32_t i = 0; i < context->imageElementPointers.length; ++i) {
+        Clay_LayoutElement* imageElement = Clay_LayoutElementArray_Get(&context->layoutElements, Clay__int32_tArray_GetValue(&context->imageElementPointers, i));
+        Clay_ImageElementConfig *config = Clay__FindElementConfigWithType(imageElement, CLAY__ELEMENT_CONFIG_TYPE_IMAGE).imageElementConfig;
+        imageElement->dimensions.height = (config->sourceDimensions.height / CLAY__MAX(config->sourceDimensions.width, 1)) * imageElement->dimensions.width;
+    }
+
+    // Propagate effect of text wrapping, image aspect scaling etc. on height of parents
+    Clay__LayoutElementTreeNodeArray dfsBuffer = context->layoutElementTreeNodeArray1;
+    dfsBuffer.length = 0;
+    for (int32_t i = 0; i < context->layoutElementTreeRoots.length; ++i) {
+        Clay__LayoutElementTreeRoot *root = Clay__LayoutElementTreeRootArray_Get(&context->layoutElementTreeRoots, i);
+        context->treeNodeVisited.internalArray[dfsBuffer.length] = false;
+        Clay__LayoutElementTreeNodeArray_Add(&dfsBuffer, CLAY__INIT(Clay__LayoutElementTreeNode) { .layoutElement = Clay_LayoutElementArray_Get(&context->layoutElements, (int)root->layoutElementIndex) });
+    }
+    while (dfsBuffer.length > 0) {
+        Clay__LayoutElementTreeNode *currentElementTreeNode = Clay__LayoutElementTreeNodeArray_Get(&dfsBuffer, (int)dfsBuffer.length - 1);
+        Clay_LayoutElement *currentElement = currentElementTreeNode->layoutElement;
+        if (!context->treeNodeVisited.internalArray[dfsBuffer.length - 1]) {
+            context->treeNodeVisited.internalArray[dfsBuffer.length - 1] = true;
+            // If the element has no children or is the container for a text element, don't bother inspecting it
+            if (Clay__ElementHasConfig(currentElement, CLAY__ELEMENT_CONFIG_TYPE_TEXT) || currentElement->childrenOrTextContent.children.length == 0) {
+                dfsBuffer.length--;
+                continue;
+            }
+            // Add the children to the DFS buffer (needs to be pushed in reverse so that stack traversal is in correct layout order)
+            for (int32_t i = 0; i < currentElement->childrenOrTextContent.children.length; i++) {
+                int32_t childIndex = currentElement->childrenOrTextContent.children.elements[i];
+                Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, childIndex);
+                if (context->retainedLayoutSizing && !Clay__ElementHasConfig(childElement, CLAY__ELEMENT_CONFIG_TYPE_TEXT) && childElement->childrenOrTextContent.children.length > 0 && Clay__RestoreRetainedPropagatedHeights(context, childIndex)) {
+                    continue;
                 }
+                context->treeNodeVisited.internalArray[dfsBuffer.length] = false;
+                Clay__LayoutElementTreeNodeArray_Add(&dfsBuffer, CLAY__INIT(Clay__LayoutElementTreeNode) { .layoutElement = childElement });
             }
+            continue;
         }
+        dfsBuffer.length--;
 
-        if (root->clipElementId) {
-            Clay__AddRenderCommand(CLAY__INIT(Clay_RenderCommand) { .id = Clay__HashNumber(rootElement->id, rootElement->childrenOrTextContent.children.length + 11).id, .commandType = CLAY_RENDER_COMMAND_TYPE_SCISSOR_END });
+        // DFS node has been visited, this is on the way back up to the root
+        Clay_LayoutConfig *layoutConfig = currentElement->layoutConfig;
+        if (layoutConfig->layoutDirection == CLAY_LEFT_TO_RIGHT) {
+            // Resize any parent containers that have grown in height along their non layout axis
+            for (int32_t j = 0; j < currentElement->childrenOrTextContent.children.length; ++j) {
+                Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, currentElement->childrenOrTextContent.children.elements[j]);
+                float childHeightWithPadding = CLAY__MAX(childElement->dimensions.height + layoutConfig->padding.top + layoutConfig->padding.bottom, currentElement->dimensions.height);
+                currentElement->dimensions.height = CLAY__MIN(CLAY__MAX(childHeightWithPadding, layoutConfig->sizing.height.size.minMax.min), layoutConfig->sizing.height.size.minMax.max);
+            }
+        } else if (layoutConfig->layoutDirection == CLAY_TOP_TO_BOTTOM) {
+            // Resizing along the layout axis
+            float contentHeight = (float)(layoutConfig->padding.top + layoutConfig->padding.bottom);
+            for (int32_t j = 0; j < currentElement->childrenOrTextContent.children.length; ++j) {
+                Clay_LayoutElement *childElement = Clay_LayoutElementArray_Get(&context->layoutElements, currentElement->childrenOrTextContent.children.elements[j]);
+                contentHeight += childElement->dimensions.height;
+            }
+            contentHeight += (float)(CLAY__MAX(currentElement->childrenOrTextContent.children.length - 1, 0) * layoutConfig->childGap);
+            currentElement->dimensions.height = CLAY__MIN(CLAY__MAX(contentHeight, layoutConfig->sizing.height.size.minMax.min), layoutConfig->sizing.height.size.minMax.max);
         }
     }
+
+    if (context->retainedLayoutSizing) {
+        Clay__RetainSizes(context, &context->retainedPropagatedDimensions[context->generation & 1]);
+    }
+
+    // Calculate sizing along the Y axis
+    Clay__SizeContainersAlongAxis(false);
+    if (context->retainedLayoutSizing) {
+        Clay__RetainSizes(context, &context->retainedDimensions[context->generation & 1]);
+    }
+
+    // Sort tree roots by z-index
+    Clay__SortLayoutElementTreeRoots(context);
+
+    // Calculate final positions and generate render commands
+    context->renderCommands.length = 0;
+    int32_t firstSerialRoot = 0;
+    if (Clay__ScheduleLayoutRoots(context)) {
+        firstSerialRoot = Clay__PositionLayoutRootsParallel(context);
+    }
+    for (int32_t rootIndex = firstSerialRoot; rootIndex < context->layoutElementTreeRoots.length; ++rootIndex) {
+        Clay__PositionLayoutRoot(Clay__LayoutElementTreeRootArray_Get(&context->layoutElementTreeRoots, rootIndex), dfsBuffer, context->treeNodeVisited, CLAY__NULL);
+    }
 }
 
 Clay_ElementId Clay__AttachId(Clay_ElementId elementId) {
@@ -2532,7 +3647,7 @@ Clay_ElementId Clay__AttachId(Clay_ElementId elementId) {
     Clay_LayoutElement *openLayoutElement = Clay__GetOpenLayoutElement();
     uint32_t idAlias = openLayoutElement->id;
     openLayoutElement->id = elementId.id;
-    Clay__AddHashMapItem(elementId, openLayoutElement, idAlias);
+    Clay__AddLayoutElementHashMapItem(elementId, openLayoutElement, idAlias);
     Clay__StringArray_Add(&context->layoutElementIdStrings, elementId.stringId);
     return elementId;
 }
@@ -2614,7 +3729,7 @@ Clay__RenderDebugLayoutData Clay__RenderDebugLayoutElementsList(int32_t initialR
             }
 
             context->treeNodeVisited.internalArray[dfsBuffer.length - 1] = true;
-            Clay_LayoutElementHashMapItem *currentElementData = Clay__GetHashMapItem(currentElement->id);
+            Clay_LayoutElementHashMapItem *currentElementData = Clay__GetLayoutElementHashMapItem(context, currentElement);
             bool offscreen = Clay__ElementIsOffscreen(&currentElementData->boundingBox);
             if (context->debugSelectedElementId == currentElement->id) {
                 layoutData.selectedElementRowIndex = layoutData.rowCount;
@@ -3211,21 +4326,47 @@ bool Clay__Array_AddCapacityCheck(int32_t length, int32_t capacity)
 
 // PUBLIC API FROM HERE ---------------------------------------
 
+// The options Clay_Initialize() uses: the ones of the current context, or the defaults
+Clay_ContextOptions Clay__CurrentContextOptions(void) {
+    Clay_Context* currentContext = Clay_GetCurrentContext();
+    if (currentContext) {
+        return CLAY__INIT(Clay_ContextOptions) {
+            .maxElementCount = currentContext->maxElementCount,
+            .maxMeasureTextCacheWordCount = currentContext->maxMeasureTextCacheWordCount,
+            .doubleBufferRenderCommands = currentContext->doubleBufferRenderCommands,
+            .parallelLayoutRoots = currentContext->parallelLayoutRoots,
+            .compactLayoutSizing = currentContext->compactLayoutSizing,
+            .retainedLayoutSizing = currentContext->retainedLayoutSizing,
+            .pointerHitTestGrid = currentContext->pointerHitTestGrid,
+        };
+    }
+    return CLAY__INIT(Clay_ContextOptions) {
+        .maxElementCount = Clay__defaultMaxElementCount,
+        .maxMeasureTextCacheWordCount = Clay__defaultMaxMeasureTextWordCacheCount,
+    };
+}
+
 CLAY_WASM_EXPORT("Clay_MinMemorySize")
 uint32_t Clay_MinMemorySize(void) {
+    return Clay_MinMemorySizeWithOptions(Clay__CurrentContextOptions());
+}
+
+// Arena size needed by Clay_InitializeWithOptions() for the same options
+CLAY_WASM_EXPORT("Clay_MinMemorySizeWithOptions")
+uint32_t Clay_MinMemorySizeWithOptions(Clay_ContextOptions options) {
     Clay_Context fakeContext = {
-        .maxElementCount = Clay__defaultMaxElementCount,
-        .maxMeasureTextCacheWordCount = Clay__defaultMaxMeasureTextWordCacheCount,
+        .maxElementCount = options.maxElementCount,
+        .maxMeasureTextCacheWordCount = options.maxMeasureTextCacheWordCount,
+        .doubleBufferRenderCommands = options.doubleBufferRenderCommands,
+        .parallelLayoutRoots = options.parallelLayoutRoots,
+        .compactLayoutSizing = options.compactLayoutSizing,
+        .retainedLayoutSizing = options.retainedLayoutSizing,
+        .pointerHitTestGrid = options.pointerHitTestGrid,
         .internalArena = {
             .capacity = SIZE_MAX,
             .memory = NULL,
         }
     };
-    Clay_Context* currentContext = Clay_GetCurrentContext();
-    if (currentContext) {
-        fakeContext.maxElementCount = currentContext->maxElementCount;
-        fakeContext.maxMeasureTextCacheWordCount = currentContext->maxElementCount;
-    }
     // Reserve space in the arena for the context, important for calculating min memory size correctly
     Clay__Context_Allocate_Arena(&fakeContext.internalArena);
     Clay__InitializePersistentMemory(&fakeContext);
@@ -3255,11 +4396,144 @@ void Clay_SetQueryScrollOffsetFunction(Clay_Vector2 (*queryScrollOffsetFunction)
 }
 #endif
 
+// parallelForFunction must call taskFunction(taskData, i) once for every i in [0, taskCount), possibly from other threads,
+// and only return once all of them have finished. Pass NULL to do all the work on the calling thread again.
+void Clay_SetParallelForFunction(void (*parallelForFunction)(void (*taskFunction)(void *taskData, int32_t taskIndex), void *taskData, int32_t taskCount, void *userData), void *userData) {
+    Clay_Context* context = Clay_GetCurrentContext();
+    context->parallelForFunction = parallelForFunction;
+    context->parallelForUserData = userData;
+}
+
 CLAY_WASM_EXPORT("Clay_SetLayoutDimensions")
 void Clay_SetLayoutDimensions(Clay_Dimensions dimensions) {
     Clay_GetCurrentContext()->layoutDimensions = dimensions;
 }
 
+void Clay__AddPointerOverElement(Clay_Context *context, Clay_LayoutElementHashMapItem *mapItem) {
+    if (mapItem->onHoverFunction) {
+        mapItem->onHoverFunction(mapItem->elementId, context->pointerInfo, mapItem->hoverFunctionUserData);
+    }
+    Clay__ElementIdArray_Add(&context->pointerOverIds, mapItem->elementId);
+    if (mapItem->idAlias != 0) {
+        Clay__ElementIdArray_Add(&context->pointerOverIds, CLAY__INIT(Clay_ElementId) { .id = mapItem->idAlias });
+    }
+}
+
+// Roots under the pointer that capture it hide the roots below them
+bool Clay__RootCapturesPointer(Clay_Context *context, Clay__LayoutElementTreeRoot *root) {
+    Clay_LayoutElement *rootElement = Clay_LayoutElementArray_Get(&context->layoutElements, root->layoutElementIndex);
+    return Clay__ElementHasConfig(rootElement, CLAY__ELEMENT_CONFIG_TYPE_FLOATING) &&
+        Clay__FindElementConfigWithType(rootElement, CLAY__ELEMENT_CONFIG_TYPE_FLOATING).floatingElementConfig->pointerCaptureMode == CLAY_POINTER_CAPTURE_MODE_CAPTURE;
+}
+
+// Clamped, so boxes and positions outside the layout use the cells at its edges
+int32_t Clay__PointerGridColumn(float position, float cellSize, int32_t columns) {
+    float column = position / cellSize;
+    if (!(column >= 0)) {
+        return 0;
+    }
+    return column >= (float)columns ? columns - 1 : (int32_t)column;
+}
+
+// Sorts the targets recorded by Clay_SetPointerState() into the cells they overlap, keeping the order they were tested in
+void Clay__BuildPointerGrid(Clay_Context *context) {
+    int32_t columns = 1;
+    while (columns < CLAY__POINTER_GRID_MAX_COLUMNS && columns * columns * 4 < context->pointerTargets.length) {
+        columns *= 2;
+    }
+    Clay_Dimensions cellSize = { CLAY__MAX(context->layoutDimensions.width, 1) / (float)columns, CLAY__MAX(context->layoutDimensions.height, 1) / (float)columns };
+    int32_t *cells = context->pointerGridCells.internalArray;
+    int32_t cellCount = columns * columns;
+    context->pointerGridCells.length = cellCount + 1;
+    for (int32_t i = 0; i <= cellCount; ++i) {
+        cells[i] = 0;
+    }
+    context->pointerGridLargeTargets.length = 0;
+    // Count the targets of each cell one slot ahead, so the prefix sum gives where each cell starts
+    int32_t entriesLeft = context->pointerGridEntries.capacity;
+    for (int32_t i = 0; i < context->pointerTargets.length; ++i) {
+        Clay__PointerTarget *target = &context->pointerTargets.internalArray[i];
+        Clay_BoundingBox box = target->boundingBox;
+        int32_t left = Clay__PointerGridColumn(box.x, cellSize.width, columns);
+        int32_t right = Clay__PointerGridColumn(box.x + box.width, cellSize.width, columns);
+        int32_t top = Clay__PointerGridColumn(box.y, cellSize.height, columns);
+        int32_t bottom = Clay__PointerGridColumn(box.y + box.height, cellSize.height, columns);
+        int32_t covered = CLAY__MAX(right - left + 1, 0) * CLAY__MAX(bottom - top + 1, 0);
+        target->inGrid = covered <= CLAY__POINTER_GRID_MAX_TARGET_CELLS && covered <= entriesLeft;
+        if (!target->inGrid) {
+            context->pointerGridLargeTargets.internalArray[context->pointerGridLargeTargets.length++] = i;
+            continue;
+        }
+        entriesLeft -= covered;
+        for (int32_t y = top; y <= bottom; ++y) {
+            for (int32_t x = left; x <= right; ++x) {
+                cells[y * columns + x + 1]++;
+            }
+        }
+    }
+    for (int32_t i = 0; i < cellCount; ++i) {
+        cells[i + 1] += cells[i];
+    }
+    // Filling moves the start of each cell to its end, which is where the next one starts
+    int32_t *entries = context->pointerGridEntries.internalArray;
+    for (int32_t i = 0; i < context->pointerTargets.length; ++i) {
+        Clay__PointerTarget *target = &context->pointerTargets.internalArray[i];
+        if (!target->inGrid) {
+            continue;
+        }
+        Clay_BoundingBox box = target->boundingBox;
+        int32_t left = Clay__PointerGridColumn(box.x, cellSize.width, columns);
+        int32_t right = Clay__PointerGridColumn(box.x + box.width, cellSize.width, columns);
+        int32_t top = Clay__PointerGridColumn(box.y, cellSize.height, columns);
+        int32_t bottom = Clay__PointerGridColumn(box.y + box.height, cellSize.height, columns);
+        for (int32_t y = top; y <= bottom; ++y) {
+            for (int32_t x = left; x <= right; ++x) {
+                entries[cells[y * columns + x]++] = i;
+            }
+        }
+    }
+    for (int32_t i = cellCount; i > 0; --i) {
+        cells[i] = cells[i - 1];
+    }
+    cells[0] = 0;
+    context->pointerGridEntries.length = cells[cellCount];
+    context->pointerGridColumns = columns;
+    context->pointerGridCellSize = cellSize;
+    context->pointerGridState = CLAY__POINTER_GRID_BUILT;
+}
+
+// Same results as the depth first search in Clay_SetPointerState(), only testing the targets of the cell under the pointer
+void Clay__SetPointerOverFromGrid(Clay_Context *context, Clay_Vector2 position) {
+    int32_t columns = context->pointerGridColumns;
+    int32_t cell = Clay__PointerGridColumn(position.y, context->pointerGridCellSize.height, columns) * columns + Clay__PointerGridColumn(position.x, context->pointerGridCellSize.width, columns);
+    int32_t *entries = context->pointerGridEntries.internalArray;
+    int32_t *largeTargets = context->pointerGridLargeTargets.internalArray;
+    int32_t entry = context->pointerGridCells.internalArray[cell];
+    int32_t entriesEnd = context->pointerGridCells.internalArray[cell + 1];
+    int32_t largeTarget = 0;
+    int32_t previousRootIndex = -1;
+    // Both lists are in testing order, merging them keeps it
+    while (entry < entriesEnd || largeTarget < context->pointerGridLargeTargets.length) {
+        int32_t targetIndex;
+        if (largeTarget == context->pointerGridLargeTargets.length || (entry < entriesEnd && entries[entry] < largeTargets[largeTarget])) {
+            targetIndex = entries[entry++];
+        } else {
+            targetIndex = largeTargets[largeTarget++];
+        }
+        Clay__PointerTarget *target = &context->pointerTargets.internalArray[targetIndex];
+        if (!Clay__PointIsInsideRect(position, target->boundingBox)) {
+            continue;
+        }
+        if (target->rootIndex != previousRootIndex) {
+            if (previousRootIndex != -1 && Clay__RootCapturesPointer(context, Clay__LayoutElementTreeRootArray_Get(&context->layoutElementTreeRoots, previousRootIndex))) {
+                break;
+            }
+            previousRootIndex = target->rootIndex;
+        }
+        Clay__AddPointerOverElement(context, target->hashMapItem);
+    }
+}
+
 CLAY_WASM_EXPORT("Clay_SetPointerState")
 void Clay_SetPointerState(Clay_Vector2 position, bool isPointerDown) {
     Clay_Context* context = Clay_GetCurrentContext();
@@ -3268,53 +4542,68 @@ void Clay_SetPointerState(Clay_Vector2 position, bool isPointerDown) {
     }
     context->pointerInfo.position = position;
     context->pointerOverIds.length = 0;
-    Clay__int32_tArray dfsBuffer = context->layoutElementChildrenBuffer;
-    for (int32_t rootIndex = context->layoutElementTreeRoots.length - 1; rootIndex >= 0; --rootIndex) {
-        dfsBuffer.length = 0;
-        Clay__LayoutElementTreeRoot *root = Clay__LayoutElementTreeRootArray_Get(&context->layoutElementTreeRoots, rootIndex);
-        Clay__int32_tArray_Add(&dfsBuffer, (int32_t)root->layoutElementIndex);
-        context->treeNodeVisited.internalArray[0] = false;
-        bool found = false;
-        while (dfsBuffer.length > 0) {
-            if (context->treeNodeVisited.internalArray[dfsBuffer.length - 1]) {
-                dfsBuffer.length--;
-                continue;
-            }
-            context->treeNodeVisited.internalArray[dfsBuffer.length - 1] = true;
-            Clay_LayoutElement *currentElement = Clay_LayoutElementArray_Get(&context->layoutElements, Clay__int32_tArray_GetValue(&dfsBuffer, (int)dfsBuffer.length - 1));
-            Clay_LayoutElementHashMapItem *mapItem = Clay__GetHashMapItem(currentElement->id); // TODO think of a way around this, maybe the fact that it's essentially a binary tree limits the cost, but the worst case is not great
-            Clay_BoundingBox elementBox = mapItem->boundingBox;
-            elementBox.x -= root->pointerOffset.x;
-            elementBox.y -= root->pointerOffset.y;
-            if (mapItem) {
-                if ((Clay__PointIsInsideRect(position, elementBox))) {
-                    if (mapItem->onHoverFunction) {
-                        mapItem->onHoverFunction(mapItem->elementId, context->pointerInfo, mapItem->hoverFunctionUserData);
+    if (context->pointerHitTestGrid && context->pointerGridState == CLAY__POINTER_GRID_RECORDED) {
+        Clay__BuildPointerGrid(context);
+    }
+    if (context->pointerHitTestGrid && context->pointerGridState == CLAY__POINTER_GRID_BUILT) {
+        Clay__SetPointerOverFromGrid(context, position);
+    } else {
+        // The first test against a layout records what it tests for the grid, going through all roots to do so
+        bool recording = context->pointerHitTestGrid && context->pointerGridState == CLAY__POINTER_GRID_EMPTY;
+        bool captured = false;
+        context->pointerTargets.length = 0;
+        Clay__int32_tArray dfsBuffer = context->layoutElementChildrenBuffer;
+        for (int32_t rootIndex = context->layoutElementTreeRoots.length - 1; rootIndex >= 0; --rootIndex) {
+            dfsBuffer.length = 0;
+            Clay__LayoutElementTreeRoot *root = Clay__LayoutElementTreeRootArray_Get(&context->layoutElementTreeRoots, rootIndex);
+            Clay__int32_tArray_Add(&dfsBuffer, (int32_t)root->layoutElementIndex);
+            context->treeNodeVisited.internalArray[0] = false;
+            bool found = false;
+            while (dfsBuffer.length > 0) {
+                if (context->treeNodeVisited.internalArray[dfsBuffer.length - 1]) {
+                    dfsBuffer.length--;
+                    continue;
+                }
+                context->treeNodeVisited.internalArray[dfsBuffer.length - 1] = true;
+                Clay_LayoutElement *currentElement = Clay_LayoutElementArray_Get(&context->layoutElements, Clay__int32_tArray_GetValue(&dfsBuffer, (int)dfsBuffer.length - 1));
+                Clay_LayoutElementHashMapItem *mapItem = Clay__GetLayoutElementHashMapItem(context, currentElement);
+                Clay_BoundingBox elementBox = mapItem->boundingBox;
+                elementBox.x -= root->pointerOffset.x;
+                elementBox.y -= root->pointerOffset.y;
+                if (mapItem) {
+                    if (recording) {
+                        if (context->pointerTargets.length < context->pointerTargets.capacity) {
+                            context->pointerTargets.internalArray[context->pointerTargets.length++] = CLAY__INIT(Clay__PointerTarget) { .boundingBox = elementBox, .hashMapItem = mapItem, .rootIndex = rootIndex };
+                        } else {
+                            recording = false;
+                        }
                     }
-                    Clay__ElementIdArray_Add(&context->pointerOverIds, mapItem->elementId);
-                    found = true;
-
-                    if (mapItem->idAlias != 0) {
-                        Clay__ElementIdArray_Add(&context->pointerOverIds, CLAY__INIT(Clay_ElementId) { .id = mapItem->idAlias });
+                    if (!captured && (Clay__PointIsInsideRect(position, elementBox))) {
+                        Clay__AddPointerOverElement(context, mapItem);
+                        found = true;
                     }
-                }
-                if (Clay__ElementHasConfig(currentElement, CLAY__ELEMENT_CONFIG_TYPE_TEXT)) {
+                    if (Clay__ElementHasConfig(currentElement, CLAY__ELEMENT_CONFIG_TYPE_TEXT)) {
+                        dfsBuffer.length--;
+                        continue;
+                    }
+                    for (int32_t i = currentElement->childrenOrTextContent.children.length - 1; i >= 0; --i) {
+                        Clay__int32_tArray_Add(&dfsBuffer, currentElement->childrenOrTextContent.children.elements[i]);
+                        context->treeNodeVisited.internalArray[dfsBuffer.length - 1] = false; // TODO needs to be ranged checked
+                    }
+                } else {
                     dfsBuffer.length--;
-                    continue;
                 }
-                for (int32_t i = currentElement->childrenOrTextContent.children.length - 1; i >= 0; --i) {
-                    Clay__int32_tArray_Add(&dfsBuffer, currentElement->childrenOrTextContent.children.elements[i]);
-                    context->treeNodeVisited.internalArray[dfsBuffer.length - 1] = false; // TODO needs to be ranged checked
+            }
+
+            if (found && Clay__RootCapturesPointer(context, root)) {
+                captured = true;
+                if (!recording) {
+                    break;
                 }
-            } else {
-                dfsBuffer.length--;
             }
         }
-
-        Clay_LayoutElement *rootElement = Clay_LayoutElementArray_Get(&context->layoutElements, root->layoutElementIndex);
-        if (found && Clay__ElementHasConfig(rootElement, CLAY__ELEMENT_CONFIG_TYPE_FLOATING) &&
-                Clay__FindElementConfigWithType(rootElement, CLAY__ELEMENT_CONFIG_TYPE_FLOATING).floatingElementConfig->pointerCaptureMode == CLAY_POINTER_CAPTURE_MODE_CAPTURE) {
-            break;
+        if (recording) {
+            context->pointerGridState = CLAY__POINTER_GRID_RECORDED;
         }
     }
 
@@ -3335,13 +4624,24 @@ void Clay_SetPointerState(Clay_Vector2 position, bool isPointerDown) {
 
 CLAY_WASM_EXPORT("Clay_Initialize")
 Clay_Context* Clay_Initialize(Clay_Arena arena, Clay_Dimensions layoutDimensions, Clay_ErrorHandler errorHandler) {
+    // DEFAULTS
+    return Clay_InitializeWithOptions(arena, layoutDimensions, errorHandler, Clay__CurrentContextOptions());
+}
+
+// Same as Clay_Initialize(), with explicit options instead of the ones of the current context.
+// The arena must be at least Clay_MinMemorySizeWithOptions() bytes for the same options.
+CLAY_WASM_EXPORT("Clay_InitializeWithOptions")
+Clay_Context* Clay_InitializeWithOptions(Clay_Arena arena, Clay_Dimensions layoutDimensions, Clay_ErrorHandler errorHandler, Clay_ContextOptions options) {
     Clay_Context *context = Clay__Context_Allocate_Arena(&arena);
     if (context == NULL) return NULL;
-    // DEFAULTS
-    Clay_Context *oldContext = Clay_GetCurrentContext();
     *context = CLAY__INIT(Clay_Context) {
-        .maxElementCount = oldContext ? oldContext->maxElementCount : Clay__defaultMaxElementCount,
-        .maxMeasureTextCacheWordCount = oldContext ? oldContext->maxMeasureTextCacheWordCount : Clay__defaultMaxMeasureTextWordCacheCount,
+        .maxElementCount = options.maxElementCount,
+        .maxMeasureTextCacheWordCount = options.maxMeasureTextCacheWordCount,
+        .doubleBufferRenderCommands = options.doubleBufferRenderCommands,
+        .parallelLayoutRoots = options.parallelLayoutRoots,
+        .compactLayoutSizing = options.compactLayoutSizing,
+        .retainedLayoutSizing = options.retainedLayoutSizing,
+        .pointerHitTestGrid = options.pointerHitTestGrid,
         .errorHandler = errorHandler.errorHandlerFunction ? errorHandler : CLAY__INIT(Clay_ErrorHandler) { Clay__ErrorHandlerFunctionDefault },
         .layoutDimensions = layoutDimensions,
         .internalArena = arena,
@@ -3350,7 +4650,7 @@ Clay_Context* Clay_Initialize(Clay_Arena arena, Clay_Dimensions layoutDimensions
     Clay__InitializePersistentMemory(context);
     Clay__InitializeEphemeralMemory(context);
     for (int32_t i = 0; i < context->layoutElementsHashMap.capacity; ++i) {
-        context->layoutElementsHashMap.internalArray[i] = -1;
+        context->layoutElementsHashMap.internalArray[i].itemIndex = -1;
     }
     for (int32_t i = 0; i < context->measureTextHashMap.capacity; ++i) {
         context->measureTextHashMap.internalArray[i] = 0;
@@ -3488,6 +4788,7 @@ CLAY_WASM_EXPORT("Clay_BeginLayout")
 void Clay_BeginLayout(void) {
     Clay_Context* context = Clay_GetCurrentContext();
     Clay__InitializeEphemeralMemory(context);
+    context->pointerGridState = CLAY__POINTER_GRID_DECLARING;
     context->generation++;
     context->dynamicElementIndex = 0;
     // Set up the root container that covers the entire window
@@ -3507,6 +4808,14 @@ void Clay_BeginLayout(void) {
 
 CLAY_WASM_EXPORT("Clay_EndLayout")
 Clay_RenderCommandArray Clay_EndLayout(void) {
+    Clay_EndLayoutDeclaration();
+    return Clay_FinishLayout();
+}
+
+// First half of Clay_EndLayout(): closes the root element and declares the debug view.
+// This is the last step that can call the measure text function.
+CLAY_WASM_EXPORT("Clay_EndLayoutDeclaration")
+void Clay_EndLayoutDeclaration(void) {
     Clay_Context* context = Clay_GetCurrentContext();
     Clay__CloseElement();
     if (context->debugModeEnabled) {
@@ -3514,6 +4823,14 @@ Clay_RenderCommandArray Clay_EndLayout(void) {
         Clay__RenderDebugView();
         context->warningsEnabled = true;
     }
+}
+
+// Second half of Clay_EndLayout(): sizes, wraps and positions the declared elements and generates the render commands.
+// Only the error handler and the parallel for function are called from here, so it can run on another thread as long
+// as nothing else touches the context meanwhile. Define CLAY_THREAD_LOCAL_CONTEXT if other threads keep using clay.
+CLAY_WASM_EXPORT("Clay_FinishLayout")
+Clay_RenderCommandArray Clay_FinishLayout(void) {
+    Clay_Context* context = Clay_GetCurrentContext();
     if (context->booleanWarnings.maxElementsExceeded) {
         Clay_String message = CLAY_STRING("Clay Error: Layout elements exceeded Clay__maxElementCount");
         Clay__AddRenderCommand(CLAY__INIT(Clay_RenderCommand ) {
@@ -3523,6 +4840,7 @@ Clay_RenderCommandArray Clay_EndLayout(void) {
         });
     } else {
         Clay__CalculateFinalLayout();
+        context->pointerGridState = CLAY__POINTER_GRID_EMPTY;
     }
     return context->renderCommands;
 }
@@ -3564,7 +4882,7 @@ void Clay_OnHover(void (*onHoverFunction)(Clay_ElementId elementId, Clay_Pointer
     if (openLayoutElement->id == 0) {
         Clay__GenerateIdForAnonymousElement(openLayoutElement);
     }
-    Clay_LayoutElementHashMapItem *hashMapItem = Clay__GetHashMapItem(openLayoutElement->id);
+    Clay_LayoutElementHashMapItem *hashMapItem = Clay__GetLayoutElementHashMapItem(context, openLayoutElement);
     hashMapItem->onHoverFunction = onHoverFunction;
     hashMapItem->hoverFunctionUserData = userData;
 }
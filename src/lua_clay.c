@@ -1,4 +1,5 @@
 #include <string.h>
+#include <stdlib.h>
 
 #define LUA_LIB
 
@@ -7,19 +8,161 @@
 #include <lualib.h>
 
 #define CLAY_IMPLEMENTATION
+/* clay.endLayoutAsync finishes layouts on another thread while this one keeps using clay */
+#define CLAY_THREAD_LOCAL_CONTEXT
 
 #include "clay.h"
 
+struct StringCache;
+
+struct StringCache *
+clay_lua_newStringCache(void);
+
 void
-clay_lua_initStringCache(void);
+clay_lua_freeStringCache(struct StringCache *cache);
 
 const char *
-clay_lua_storeString(const char *text, size_t len);
+clay_lua_storeString(struct StringCache *cache, const char *text, size_t len);
+
+int
+clay_lua_startWorkers(int count);
+
+void
+clay_lua_stopWorkers(void);
+
+int
+clay_lua_workerCount(void);
+
+void
+clay_lua_parallelFor(void (*task)(void *data, int32_t index), void *data, int32_t count, void *userData);
+
+void *
+clay_lua_allocArena(size_t size, int hugePages, size_t *mappedSize);
+
+void
+clay_lua_freeArena(void *memory, size_t mappedSize);
+
+void *
+clay_lua_runInBackground(void (*fn)(void *data), void *data);
+
+void
+clay_lua_waitBackground(void *job);
+
+#define CLAY_LUA_CONTEXT "clay.Context"
+
+/* What ran out of space during a frame, for contexts that grow on their own */
+#define CLAY_LUA_OVERFLOW_ELEMENTS 1
+#define CLAY_LUA_OVERFLOW_WORDS 2
+
+/* autoGrow stops doubling past this, at that point something is likely generating elements forever */
+#define CLAY_LUA_MAX_GROWN_COUNT (1 << 24)
+
+struct ContextData
+{
+  Clay_Context *clay;
+  void *memory;
+  /* Length of the mapping backing memory, 0 if it came from malloc */
+  size_t mappedSize;
+  int hugePages;
+  int doubleBuffer;
+  int parallelRoots;
+  int compactSizing;
+  int retainedSizing;
+  int hitTestGrid;
+  int autoGrow;
+  int overflow;
+  /* The thread currently running clay on this context, callbacks must use its stack */
+  lua_State *L;
+  int measureTextRef;
+  int hoverRef;
+  /* Render commands of the last finished layout */
+  int commandsRef;
+  Clay_RenderCommandArray commands;
+  /* Between beginLayout and endLayout, which may span several coroutine resumes */
+  int building;
+  /* Pointer and scroll input received while building, applied once the layout ends */
+  int pendingPointer;
+  Clay_Vector2 pointerPosition;
+  int pointerDown;
+  int pendingScroll;
+  int scrollDrag;
+  Clay_Vector2 scrollDelta;
+  float scrollTime;
+  /* Set from clay.endLayoutAsync until the result is collected, job is NULL if it ran in place */
+  int pending;
+  void *job;
+  Clay_RenderCommandArray pendingCommands;
+  /* The first error of the background layout, raised once back on the Lua thread */
+  int pendingError;
+  Clay_ErrorData error;
+  struct StringCache *strings;
+  /* clay.cached entries used this frame and the last one, keyed by id */
+  int cacheRef;
+  int previousCacheRef;
+  /* The innermost clay.cached call recording its elements, NULL if none */
+  struct Recording *recording;
+  /* The state of each clay.virtualList with rows of different heights, declared this frame and the last one, by id */
+  int virtualListsRef;
+  int previousVirtualListsRef;
+};
+
+/* Strings that can outlive a context, like the ones behind clay.id handles */
+static struct StringCache *sharedStrings;
+
+static struct ContextData *currentContext;
+
+static void
+clay_lua_sync(lua_State *L, struct ContextData *data);
+
+/*
+ * Every function that can end up calling back into Lua, or that touches the
+ * context memory, goes through here first.
+ * Layouts can be built from coroutines, so the thread that created the context
+ * may not be the one running, or may not even exist anymore.
+ * A layout still finishing in the background is waited for.
+ */
+static void
+clay_lua_enter(lua_State *L)
+{
+  if (!currentContext) return;
+  currentContext->L = L;
+  if (currentContext->pending) clay_lua_sync(L, currentContext);
+}
+
+static struct StringCache *
+clay_lua_strings(void)
+{
+  return currentContext ? currentContext->strings : sharedStrings;
+}
 
 static void
 clay_lua_handleError(Clay_ErrorData error)
 {
-  lua_State *L = error.userData;
+  struct ContextData *data = error.userData;
+  lua_State *L = data->L;
+  if (data->pending)
+  {
+    /* Running off the Lua thread, leave it for clay_lua_sync */
+    if (!data->pendingError) data->error = error;
+    data->pendingError = 1;
+    return;
+  }
+  if (data->autoGrow)
+  {
+    /* Raising here would longjmp through clay, let it finish the frame and grow afterwards */
+    switch (error.errorType)
+    {
+      case CLAY_ERROR_TYPE_ARENA_CAPACITY_EXCEEDED:
+      case CLAY_ERROR_TYPE_ELEMENTS_CAPACITY_EXCEEDED:
+        data->overflow |= CLAY_LUA_OVERFLOW_ELEMENTS;
+        return;
+      case CLAY_ERROR_TYPE_TEXT_MEASUREMENT_CAPACITY_EXCEEDED:
+        data->overflow |= CLAY_LUA_OVERFLOW_WORDS;
+        return;
+      default:
+        break;
+    }
+  }
   lua_pushliteral(L, "Clay Error: ");
   switch (error.errorType)
   {
@@ -74,42 +217,331 @@ clay_lua_handleError(Clay_ErrorData error)
   lua_error(L);
 }
 
+static struct ContextData *
+clay_lua_checkContext(lua_State *L, int idx)
+{
+  return luaL_checkudata(L, idx, CLAY_LUA_CONTEXT);
+}
+
+static void
+clay_lua_makeCurrent(lua_State *L, int idx)
+{
+  struct ContextData *data = lua_isnoneornil(L, idx) ? NULL : clay_lua_checkContext(L, idx);
+  currentContext = data;
+  Clay_SetCurrentContext(data ? data->clay : NULL);
+  /* Keep the current context alive even if Lua drops every other reference to it */
+  lua_pushvalue(L, idx);
+  lua_setfield(L, LUA_REGISTRYINDEX, "clay.currentContext");
+}
+
+static Clay_Dimensions
+clay_lua_measureText(Clay_StringSlice str, Clay_TextElementConfig *config, void *userData);
+
+static void
+clay_lua_setMeasureTextFunction(lua_State *L, struct ContextData *data, int idx)
+{
+  luaL_unref(L, LUA_REGISTRYINDEX, data->measureTextRef);
+  lua_pushvalue(L, idx);
+  data->measureTextRef = luaL_ref(L, LUA_REGISTRYINDEX);
+}
+
+/*
+ * Allocates an arena sized exactly for the given limits and starts a clay context in it.
+ * Clay makes the new context the current one.
+ */
+static int
+clay_lua_allocContext(struct ContextData *data, Clay_Dimensions dimensions, int32_t maxElements, int32_t maxMeasureWords)
+{
+  Clay_ContextOptions options = (Clay_ContextOptions) { maxElements, maxMeasureWords, data->doubleBuffer, data->parallelRoots, data->compactSizing, data->retainedSizing, data->hitTestGrid };
+  uint32_t size = Clay_MinMemorySizeWithOptions(options);
+  void *memory = clay_lua_allocArena(size, data->hugePages, &data->mappedSize);
+  if (!memory) return 0;
+  data->memory = memory;
+  Clay_Arena arena = Clay_CreateArenaWithCapacityAndMemory(size, memory);
+  data->clay = Clay_InitializeWithOptions(arena, dimensions, (Clay_ErrorHandler) { clay_lua_handleError, data }, options);
+  data->commands = (Clay_RenderCommandArray) {0};
+  return 1;
+}
+
+/*
+ * Moves the context to a new arena sized for the given limits.
+ * Clay can't resize an arena in place, so this starts over carrying the state
+ * that lives between frames: dimensions, pointer, debug flags and callbacks.
+ * Scroll positions and the text measurement cache are reset.
+ * Must not be called while a layout is being built.
+ */
+static void
+clay_lua_reallocate(lua_State *L, struct ContextData *data, int32_t maxElements, int32_t maxMeasureWords)
+{
+  if (data->building)
+  {
+    luaL_error(L, "Can't change the limits of a context while a layout is being built");
+    return;
+  }
+  Clay_Context *old = data->clay;
+  void *oldMemory = data->memory;
+  size_t oldMappedSize = data->mappedSize;
+  if (!clay_lua_allocContext(data, old->layoutDimensions, maxElements, maxMeasureWords))
+  {
+    data->mappedSize = oldMappedSize;
+    luaL_error(L, "Not enough memory for %d elements", (int)maxElements);
+    return;
+  }
+  Clay_Context *clay = data->clay;
+  clay->pointerInfo = old->pointerInfo;
+  clay->warningsEnabled = old->warningsEnabled;
+  clay->debugModeEnabled = old->debugModeEnabled;
+  clay->disableCulling = old->disableCulling;
+  clay->externalScrollHandlingEnabled = old->externalScrollHandlingEnabled;
+  clay->measureTextUserData = old->measureTextUserData;
+  clay->queryScrollOffsetUserData = old->queryScrollOffsetUserData;
+  clay->parallelForFunction = old->parallelForFunction;
+  clay->parallelForUserData = old->parallelForUserData;
+  Clay_SetCurrentContext(currentContext ? currentContext->clay : NULL);
+  clay_lua_freeArena(oldMemory, oldMappedSize);
+}
+
+static int32_t
+clay_lua_doubleCount(lua_State *L, int32_t count)
+{
+  if (count >= CLAY_LUA_MAX_GROWN_COUNT)
+  {
+    luaL_error(L, "Clay Error: [Elements Capacity Exceeded] Can't grow past %d elements", (int)count);
+  }
+  return count * 2;
+}
+
+/*
+ * Doubles whatever limit the last frame of a growing context ran out of.
+ * Returns whether the context was given a new arena, in which case the
+ * frame was incomplete and should be laid out again.
+ */
+static int
+clay_lua_grow(lua_State *L, struct ContextData *data)
+{
+  if (!data || !data->autoGrow) return 0;
+  Clay_Context *clay = data->clay;
+  int overflow = data->overflow;
+  /* clay stops adding elements once full without always reporting it */
+  if (clay->booleanWarnings.maxElementsExceeded) overflow |= CLAY_LUA_OVERFLOW_ELEMENTS;
+  data->overflow = 0;
+  if (!overflow) return 0;
+  int32_t maxElements = clay->maxElementCount;
+  int32_t maxMeasureWords = clay->maxMeasureTextCacheWordCount;
+  if (overflow & CLAY_LUA_OVERFLOW_ELEMENTS) maxElements = clay_lua_doubleCount(L, maxElements);
+  if (overflow & CLAY_LUA_OVERFLOW_WORDS) maxMeasureWords = clay_lua_doubleCount(L, maxMeasureWords);
+  clay_lua_reallocate(L, data, maxElements, maxMeasureWords);
+  return 1;
+}
+
+static int32_t
+clay_lua_optCount(lua_State *L, int opts, const char *name, int32_t value)
+{
+  if (!lua_istable(L, opts)) return value;
+  lua_getfield(L, opts, name);
+  if (!lua_isnil(L, -1))
+  {
+    value = (int32_t)luaL_checkinteger(L, -1);
+    if (value <= 0) luaL_error(L, "%s must be positive", name);
+  }
+  lua_pop(L, 1);
+  return value;
+}
+
+/*
+ * Creates a context userdata and leaves it on top of the stack.
+ * Clay makes every new context the current one, so this does too.
+ */
+static struct ContextData *
+clay_lua_newContext(lua_State *L, float w, float h, int opts)
+{
+  struct ContextData *data = lua_newuserdata(L, sizeof *data);
+  int ctx = lua_gettop(L);
+  int32_t maxElements = clay_lua_optCount(L, opts, "maxElements", Clay__defaultMaxElementCount);
+  int32_t maxMeasureWords = clay_lua_optCount(L, opts, "maxMeasureWords", CLAY__MAX(Clay__defaultMaxMeasureTextWordCacheCount, maxElements * 2));
+  data->L = L;
+  data->measureTextRef = LUA_NOREF;
+  data->hoverRef = LUA_NOREF;
+  data->commandsRef = LUA_NOREF;
+  data->cacheRef = LUA_NOREF;
+  data->previousCacheRef = LUA_NOREF;
+  data->recording = NULL;
+  data->virtualListsRef = LUA_NOREF;
+  data->previousVirtualListsRef = LUA_NOREF;
+  data->building = 0;
+  data->pendingPointer = 0;
+  data->pendingScroll = 0;
+  data->pending = 0;
+  data->job = NULL;
+  data->pendingError = 0;
+  data->memory = NULL;
+  data->strings = NULL;
+  data->clay = NULL;
+  data->overflow = 0;
+  if (lua_istable(L, opts))
+  {
+    lua_getfield(L, opts, "hugePages");
+    data->hugePages = lua_toboolean(L, -1);
+    lua_getfield(L, opts, "autoGrow");
+    data->autoGrow = lua_toboolean(L, -1);
+    lua_getfield(L, opts, "doubleBuffer");
+    data->doubleBuffer = lua_toboolean(L, -1);
+    lua_getfield(L, opts, "parallelRoots");
+    data->parallelRoots = lua_toboolean(L, -1);
+    lua_getfield(L, opts, "compactSizing");
+    data->compactSizing = lua_toboolean(L, -1);
+    lua_getfield(L, opts, "retainedSizing");
+    data->retainedSizing = lua_toboolean(L, -1);
+    lua_getfield(L, opts, "hitTestGrid");
+    data->hitTestGrid = lua_toboolean(L, -1);
+    lua_pop(L, 7);
+  }
+  else
+  {
+    data->hugePages = 0;
+    data->autoGrow = 0;
+    data->doubleBuffer = 0;
+    data->parallelRoots = 0;
+    data->compactSizing = 0;
+    data->retainedSizing = 0;
+    data->hitTestGrid = 0;
+  }
+  /* Set the metatable first so __gc cleans up if anything below fails */
+  luaL_getmetatable(L, CLAY_LUA_CONTEXT);
+  lua_setmetatable(L, ctx);
+  if (!clay_lua_allocContext(data, (Clay_Dimensions) { w, h }, maxElements, maxMeasureWords))
+  {
+    luaL_error(L, "Not enough memory for %d elements", (int)maxElements);
+  }
+  data->strings = clay_lua_newStringCache();
+  lua_newtable(L);
+  data->hoverRef = luaL_ref(L, LUA_REGISTRYINDEX);
+  lua_newtable(L);
+  data->commandsRef = luaL_ref(L, LUA_REGISTRYINDEX);
+  lua_newtable(L);
+  data->cacheRef = luaL_ref(L, LUA_REGISTRYINDEX);
+  lua_newtable(L);
+  data->previousCacheRef = luaL_ref(L, LUA_REGISTRYINDEX);
+  lua_newtable(L);
+  data->virtualListsRef = luaL_ref(L, LUA_REGISTRYINDEX);
+  lua_newtable(L);
+  data->previousVirtualListsRef = luaL_ref(L, LUA_REGISTRYINDEX);
+  clay_lua_makeCurrent(L, ctx);
+  Clay_SetMeasureTextFunction(clay_lua_measureText, data);
+  if (clay_lua_workerCount() > 0) Clay_SetParallelForFunction(clay_lua_parallelFor, NULL);
+  if (lua_istable(L, opts))
+  {
+    lua_getfield(L, opts, "measureText");
+    if (lua_isfunction(L, -1)) clay_lua_setMeasureTextFunction(L, data, lua_gettop(L));
+    lua_pop(L, 1);
+  }
+  return data;
+}
+
+static int
+l_context__gc(lua_State *L)
+{
+  struct ContextData *data = clay_lua_checkContext(L, 1);
+  if (data->job) clay_lua_waitBackground(data->job);
+  data->job = NULL;
+  data->pending = 0;
+  if (currentContext == data)
+  {
+    currentContext = NULL;
+    Clay_SetCurrentContext(NULL);
+  }
+  luaL_unref(L, LUA_REGISTRYINDEX, data->measureTextRef);
+  data->measureTextRef = LUA_NOREF;
+  luaL_unref(L, LUA_REGISTRYINDEX, data->hoverRef);
+  data->hoverRef = LUA_NOREF;
+  luaL_unref(L, LUA_REGISTRYINDEX, data->commandsRef);
+  data->commandsRef = LUA_NOREF;
+  luaL_unref(L, LUA_REGISTRYINDEX, data->cacheRef);
+  data->cacheRef = LUA_NOREF;
+  luaL_unref(L, LUA_REGISTRYINDEX, data->previousCacheRef);
+  data->previousCacheRef = LUA_NOREF;
+  luaL_unref(L, LUA_REGISTRYINDEX, data->virtualListsRef);
+  data->virtualListsRef = LUA_NOREF;
+  luaL_unref(L, LUA_REGISTRYINDEX, data->previousVirtualListsRef);
+  data->previousVirtualListsRef = LUA_NOREF;
+  if (data->strings) clay_lua_freeStringCache(data->strings);
+  data->strings = NULL;
+  clay_lua_freeArena(data->memory, data->mappedSize);
+  data->memory = NULL;
+  data->clay = NULL;
+  return 0;
+}
+
+/*
+ * clay.setCurrentContext(context)
+ * context:setCurrent()
+ *
+ * Makes the context the target of every other clay function.
+ */
 static int
 l_setCurrentContext(lua_State *L)
 {
-  Clay_Context *ctx = lua_touserdata(L, 1);
-  Clay_SetCurrentContext(ctx);
+  clay_lua_makeCurrent(L, 1);
   return 0;
 }
 
+/*
+ * clay.getCurrentContext()
+ */
 static int
 l_getCurrentContext(lua_State *L)
 {
-  lua_pushlightuserdata(L, Clay_GetCurrentContext());
-  int ctx = lua_gettop(L);
-  lua_newtable(L);
-  int meta = lua_gettop(L);
-  lua_pushvalue(L, meta);
-  lua_setfield(L, meta, "__index");
-  lua_pushboolean(L, 0);
-  lua_setfield(L, meta, "__metatable");
-  lua_pushcfunction(L, l_setCurrentContext);
-  lua_setfield(L, meta, "setCurrent");
-  lua_pushvalue(L, meta);
-  lua_setmetatable(L, ctx);
-  lua_pushvalue(L, ctx);
+  lua_getfield(L, LUA_REGISTRYINDEX, "clay.currentContext");
   return 1;
 }
 
+/*
+ * clay.newContext(width, height, [options])
+ *
+ * Creates a new context with its own memory, string cache and
+ * measure text function, and makes it the current one.
+ * Everything is released when the context is garbage collected.
+ *
+ * Options:
+ *   measureText: the measure text function for this context
+ *   maxElements: how many elements a layout can have (default 8192)
+ *   maxMeasureWords: how many measured words are cached (default twice maxElements, at least 16384)
+ *   hugePages: back the arena with huge pages where the system supports it
+ *   autoGrow: instead of raising an error when a limit is hit, finish the frame
+ *             and double the limit for the next one (see clay.layout)
+ *   doubleBuffer: keep the raw render commands of a frame valid while the next one
+ *                 is declared (see clay.getRenderCommandBuffer)
+ *   parallelRoots: lay out the root and independent floating elements at the same time
+ *                  on the worker threads (see clay.setWorkerCount)
+ *   compactSizing: copy what sizing needs into compact arrays before sizing,
+ *                  faster for layouts with tens of thousands of elements
+ *   retainedSizing: reuse the sizes of the previous frame for parts of the layout
+ *                   declared the same way, faster for mostly static layouts
+ *   hitTestGrid: index the elements of each layout in a grid the first time the pointer
+ *                is tested against it, so clay.setPointerState is faster when called
+ *                more than once per frame
+ */
+static int
+l_newContext(lua_State *L)
+{
+  float w = (float)lua_tonumber(L, 1);
+  float h = (float)lua_tonumber(L, 2);
+  clay_lua_newContext(L, w, h, 3);
+  return 1;
+}
+
+/*
+ * clay.initialize(width, height, [options])
+ *
+ * Same as clay.newContext, kept for code written against a single context.
+ */
 static int
 l_initialize(lua_State *L)
 {
-  uint32_t size = Clay_MinMemorySize();
-  Clay_Arena arena = Clay_CreateArenaWithCapacityAndMemory(size, malloc(size));
   float w = (float)lua_tonumber(L, 1);
   float h = (float)lua_tonumber(L, 2);
-  Clay_Initialize(arena, (Clay_Dimensions) { w, h }, (Clay_ErrorHandler) { clay_lua_handleError, L });
-  return 0;
+  clay_lua_newContext(L, w, h, 3);
+  return 1;
 }
 
 static int
@@ -117,20 +549,41 @@ l_setLayoutDimensions(lua_State *L)
 {
   float w = (float)lua_tonumber(L, 1);
   float h = (float)lua_tonumber(L, 2);
+  clay_lua_enter(L);
   Clay_SetLayoutDimensions((Clay_Dimensions){w, h});
   return 0;
 }
 
+/*
+ * clay.setPointerState(x, y, isDown)
+ *
+ * While a layout is being built the elements to hit test are incomplete,
+ * so the last state received is applied once it ends instead.
+ */
 static int
 l_setPointerState(lua_State *L)
 {
   float x = (float)lua_tonumber(L, 1);
   float y = (float)lua_tonumber(L, 2);
   int isdown = lua_toboolean(L, 3);
+  if (currentContext && currentContext->building)
+  {
+    currentContext->pendingPointer = 1;
+    currentContext->pointerPosition = (Clay_Vector2){x, y};
+    currentContext->pointerDown = isdown;
+    return 0;
+  }
+  clay_lua_enter(L);
   Clay_SetPointerState((Clay_Vector2){x, y}, isdown);
   return 0;
 }
 
+/*
+ * clay.updateScrollContainers(enableDrag, dx, dy, dt)
+ *
+ * Like clay.setPointerState, waits for the layout being built to end.
+ * Deltas received meanwhile are added together.
+ */
 static int
 l_updateScrollContainers(lua_State *L)
 {
@@ -138,14 +591,70 @@ l_updateScrollContainers(lua_State *L)
   float x = (float)lua_tonumber(L, 2);
   float y = (float)lua_tonumber(L, 3);
   float dt = (float)lua_tonumber(L, 4);
+  if (currentContext && currentContext->building)
+  {
+    struct ContextData *data = currentContext;
+    if (!data->pendingScroll)
+    {
+      data->scrollDelta = (Clay_Vector2){0, 0};
+      data->scrollTime = 0;
+    }
+    data->pendingScroll = 1;
+    data->scrollDrag = drag;
+    data->scrollDelta.x += x;
+    data->scrollDelta.y += y;
+    data->scrollTime += dt;
+    return 0;
+  }
+  clay_lua_enter(L);
   Clay_UpdateScrollContainers(drag, (Clay_Vector2){x, y}, dt);
   return 0;
 }
 
+/* Applies the input deferred by clay.setPointerState and clay.updateScrollContainers */
+static void
+clay_lua_applyPendingInput(struct ContextData *data)
+{
+  if (data->pendingPointer)
+  {
+    data->pendingPointer = 0;
+    Clay_SetPointerState(data->pointerPosition, data->pointerDown);
+  }
+  if (data->pendingScroll)
+  {
+    data->pendingScroll = 0;
+    Clay_UpdateScrollContainers(data->scrollDrag, data->scrollDelta, data->scrollTime);
+  }
+}
+
+/* Starts a layout, forgetting the hover callbacks of the previous one */
+static void
+clay_lua_beginLayout(lua_State *L)
+{
+  clay_lua_enter(L);
+  if (currentContext)
+  {
+    lua_newtable(L);
+    lua_rawseti(L, LUA_REGISTRYINDEX, currentContext->hoverRef);
+    /* clay.cached entries not used during the last frame are dropped */
+    lua_rawgeti(L, LUA_REGISTRYINDEX, currentContext->cacheRef);
+    lua_rawseti(L, LUA_REGISTRYINDEX, currentContext->previousCacheRef);
+    lua_newtable(L);
+    lua_rawseti(L, LUA_REGISTRYINDEX, currentContext->cacheRef);
+    /* So are the clay.virtualList states, their row heights are freed once collected */
+    lua_rawgeti(L, LUA_REGISTRYINDEX, currentContext->virtualListsRef);
+    lua_rawseti(L, LUA_REGISTRYINDEX, currentContext->previousVirtualListsRef);
+    lua_newtable(L);
+    lua_rawseti(L, LUA_REGISTRYINDEX, currentContext->virtualListsRef);
+    currentContext->building = 1;
+  }
+  Clay_BeginLayout();
+}
+
 static int
 l_beginLayout(lua_State *L)
 {
-  Clay_BeginLayout();
+  clay_lua_beginLayout(L);
   return 0;
 }
 
@@ -364,12 +873,15 @@ clay_lua_build_render_command(lua_State *L, Clay_RenderCommand *data)
   lua_pushvalue(L, cmd);
 }
 
+/*
+ * Pushes the render commands of a layout that just ended.
+ * Returns whether the context had to grow, meaning the commands are from an incomplete frame.
+ */
 static int
-l_endLayout(lua_State *L)
+clay_lua_pushCommands(lua_State *L, struct ContextData *data, Clay_RenderCommandArray commands)
 {
   lua_newtable(L);
   int list = lua_gettop(L);
-  Clay_RenderCommandArray commands = Clay_EndLayout();
   for (int i = 0; i < commands.length; ++i)
   {
     int top = lua_gettop(L);
@@ -377,21 +889,296 @@ l_endLayout(lua_State *L)
     lua_rawseti(L, list, i + 1);
     lua_settop(L, top);
   }
+  if (!data) return 0;
+  data->building = 0;
+  data->commands = commands;
   lua_pushvalue(L, list);
+  lua_rawseti(L, LUA_REGISTRYINDEX, data->commandsRef);
+  clay_lua_applyPendingInput(data);
+  /* Growing frees the arena the commands live in, so only after they were copied */
+  return clay_lua_grow(L, data);
+}
+
+static int
+clay_lua_endLayout(lua_State *L)
+{
+  struct ContextData *data = currentContext;
+  clay_lua_enter(L);
+  return clay_lua_pushCommands(L, data, Clay_EndLayout());
+}
+
+static int
+l_endLayout(lua_State *L)
+{
+  clay_lua_endLayout(L);
+  return 1;
+}
+
+static void
+clay_lua_finishLayout(void *userData)
+{
+  struct ContextData *data = userData;
+  Clay_SetCurrentContext(data->clay);
+  data->pendingCommands = Clay_FinishLayout();
+}
+
+/* Collects the result of clay.endLayoutAsync, raising the error it ran into if any */
+static void
+clay_lua_sync(lua_State *L, struct ContextData *data)
+{
+  if (data->job) clay_lua_waitBackground(data->job);
+  data->job = NULL;
+  data->pending = 0;
+  /* Same order as clay.endLayout: autoGrow records overflows, other errors don't get to the commands */
+  if (data->pendingError)
+  {
+    data->pendingError = 0;
+    clay_lua_handleError(data->error);
+  }
+  int top = lua_gettop(L);
+  clay_lua_pushCommands(L, data, data->pendingCommands);
+  lua_settop(L, top);
+}
+
+/*
+ * clay.endLayoutAsync()
+ *
+ * Like clay.endLayout, but the layout is sized, wrapped and turned into render commands
+ * on a background thread while Lua keeps running. Text was already measured while
+ * declaring it, so no Lua function is called from there.
+ * Collect the commands with clay.fetchCommands(). Any other clay function that needs
+ * the context waits for the layout to finish first.
+ */
+static int
+l_endLayoutAsync(lua_State *L)
+{
+  struct ContextData *data = currentContext;
+  if (!data)
+  {
+    luaL_error(L, "there is no current context, call clay.initialize first");
+  }
+  clay_lua_enter(L);
+  Clay_EndLayoutDeclaration();
+  data->pending = 1;
+  data->pendingError = 0;
+  data->job = clay_lua_runInBackground(clay_lua_finishLayout, data);
+  if (!data->job) clay_lua_finishLayout(data);
+  return 0;
+}
+
+/*
+ * clay.fetchCommands()
+ *
+ * Waits for the layout started by clay.endLayoutAsync and returns its render commands.
+ * Without one in flight, returns the commands of the last layout like clay.getRenderCommands.
+ */
+static int
+l_fetchCommands(lua_State *L)
+{
+  if (!currentContext)
+  {
+    lua_newtable(L);
+    return 1;
+  }
+  clay_lua_enter(L);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, currentContext->commandsRef);
+  return 1;
+}
+
+/*
+ * clay.getRenderCommands()
+ *
+ * Returns the render commands of the last layout that ended.
+ * Declaring a big layout can be spread across several coroutine resumes,
+ * as long as the coroutine only yields between clay calls:
+ *
+ * local builder = coroutine.wrap(function ()
+ *   while true do
+ *     clay.beginLayout()
+ *     for i, item in ipairs(items) do
+ *       clay.openElement()
+ *       -- ...
+ *       clay.closeElement()
+ *       if i % 1000 == 0 then coroutine.yield() end
+ *     end
+ *     clay.endLayout()
+ *     coroutine.yield()
+ *   end
+ * end)
+ *
+ * function love.update() builder() end
+ * function love.draw() render(clay.getRenderCommands()) end
+ *
+ * Yielding from the children function of clay() doesn't work, as it is called from C.
+ */
+static int
+l_getRenderCommands(lua_State *L)
+{
+  if (!currentContext)
+  {
+    lua_newtable(L);
+    return 1;
+  }
+  lua_rawgeti(L, LUA_REGISTRYINDEX, currentContext->commandsRef);
+  return 1;
+}
+
+/*
+ * clay.getRenderCommandBuffer()
+ *
+ * Returns a pointer (light userdata) to the Clay_RenderCommand array of the last layout
+ * that ended and its length, for renderers that read it directly, like through the LuaJIT FFI.
+ * Unlike the tables from clay.endLayout, nothing is copied.
+ * The array is valid until the next clay.beginLayout, or with the doubleBuffer option
+ * until the one after it, so it can be drawn while the next frame is being declared.
+ */
+static int
+l_getRenderCommandBuffer(lua_State *L)
+{
+  clay_lua_enter(L);
+  if (!currentContext || currentContext->commands.length == 0)
+  {
+    lua_pushnil(L);
+    lua_pushnumber(L, 0);
+    return 2;
+  }
+  lua_pushlightuserdata(L, currentContext->commands.internalArray);
+  lua_pushnumber(L, currentContext->commands.length);
+  return 2;
+}
+
+/*
+ * clay.isBuildingLayout()
+ *
+ * Whether clay.beginLayout was called without the matching clay.endLayout yet.
+ */
+static int
+l_isBuildingLayout(lua_State *L)
+{
+  lua_pushboolean(L, currentContext && currentContext->building);
   return 1;
 }
 
+/*
+ * clay.layout(fn, ...)
+ *
+ * Begins a layout, calls fn(...) to declare the elements and returns the render commands.
+ * When an autoGrow context runs out of space, the layout is declared again with the
+ * bigger limits, so the returned commands are always for the complete frame.
+ */
+static int
+l_layout(lua_State *L)
+{
+  luaL_checktype(L, 1, LUA_TFUNCTION);
+  int args = lua_gettop(L);
+  for (;;)
+  {
+    clay_lua_beginLayout(L);
+    struct ContextData *data = currentContext;
+    for (int i = 1; i <= args; ++i) lua_pushvalue(L, i);
+    if (lua_pcall(L, args - 1, 0, 0) != 0)
+    {
+      /* The layout is abandoned, the next clay.beginLayout starts over */
+      if (data)
+      {
+        data->building = 0;
+        data->pendingPointer = 0;
+        data->pendingScroll = 0;
+      }
+      lua_error(L);
+    }
+    if (!clay_lua_endLayout(L)) return 1;
+    lua_settop(L, args);
+  }
+}
+
+#define CLAY_LUA_RECORDING "clay.Recording"
+
+/* The element declarations made during a clay.cached call, stored one after the other as an op byte and its payload */
+struct Recording
+{
+  char *ops;
+  size_t length;
+  size_t capacity;
+  /* The recording of the enclosing clay.cached call, everything recorded here is recorded there too */
+  struct Recording *parent;
+  /* Table of the clay.onHover callbacks recorded so far, LUA_NOREF until there is one */
+  int hoversRef;
+  int32_t hoverCount;
+};
+
+enum
+{
+  CLAY_LUA_RECORD_OPEN,
+  CLAY_LUA_RECORD_CONFIGURE, /* Followed by a Clay_ElementDeclaration */
+  CLAY_LUA_RECORD_CLOSE,
+  CLAY_LUA_RECORD_TEXT, /* Followed by a struct RecordedText */
+  CLAY_LUA_RECORD_LOCAL_ID, /* Followed by a struct RecordedLocalId, applies to the next configure */
+  CLAY_LUA_RECORD_HOVER /* Followed by the int32_t index of the callback in the hovers table */
+};
+
+struct RecordedText
+{
+  Clay_String text;
+  Clay_TextElementConfig config;
+};
+
+/* Local ids depend on the parent the elements are declared in, so they are hashed again on replay */
+struct RecordedLocalId
+{
+  Clay_String key;
+  uint32_t index;
+  /* Whether it is the floating parentId instead of the id of the element */
+  int floatingParent;
+};
+
+static void
+clay_lua_appendRecording(lua_State *L, struct Recording *recording, const void *bytes, size_t size)
+{
+  if (recording->length + size > recording->capacity)
+  {
+    size_t capacity = recording->capacity ? recording->capacity : 256;
+    while (capacity < recording->length + size) capacity *= 2;
+    char *ops = realloc(recording->ops, capacity);
+    if (!ops)
+    {
+      luaL_error(L, "Not enough memory to record the elements of clay.cached");
+      return;
+    }
+    recording->ops = ops;
+    recording->capacity = capacity;
+  }
+  memcpy(recording->ops + recording->length, bytes, size);
+  recording->length += size;
+}
+
+/* Adds an op to every clay.cached call that is recording */
+static void
+clay_lua_record(lua_State *L, char op, const void *payload, size_t size)
+{
+  if (!currentContext) return;
+  for (struct Recording *recording = currentContext->recording; recording; recording = recording->parent)
+  {
+    clay_lua_appendRecording(L, recording, &op, 1);
+    if (size > 0) clay_lua_appendRecording(L, recording, payload, size);
+  }
+}
+
 static int
 l_openElement(lua_State *L)
 {
+  clay_lua_enter(L);
   Clay__OpenElement();
+  clay_lua_record(L, CLAY_LUA_RECORD_OPEN, NULL, 0);
   return 0;
 }
 
 static int
 l_closeElement(lua_State *L)
 {
+  clay_lua_enter(L);
   Clay__CloseElement();
+  clay_lua_record(L, CLAY_LUA_RECORD_CLOSE, NULL, 0);
   return 0;
 }
 
@@ -553,10 +1340,182 @@ clay_lua_build_element_floatingAttatchTo(lua_State *L, int idx, Clay_FloatingAtt
 static Clay_String
 clay_lua_toString(lua_State *L, int idx)
 {
-  size_t len;
-  const char *str = lua_tolstring(L, idx, &len);
-  Clay_String text = (Clay_String){(int32_t)len, clay_lua_storeString(str, len)};
-  return text;
+  size_t len;
+  const char *str = lua_tolstring(L, idx, &len);
+  Clay_String text = (Clay_String){(int32_t)len, clay_lua_storeString(clay_lua_strings(), str, len)};
+  return text;
+}
+
+#define CLAY_LUA_ELEMENT_ID "clay.ElementId"
+
+static Clay_ElementId *
+clay_lua_toElementIdHandle(lua_State *L, int idx)
+{
+  if (!lua_isuserdata(L, idx) || !lua_getmetatable(L, idx)) return NULL;
+
+  luaL_getmetatable(L, CLAY_LUA_ELEMENT_ID);
+  int isHandle = lua_rawequal(L, -1, -2);
+  lua_pop(L, 2);
+  return isHandle ? lua_touserdata(L, idx) : NULL;
+}
+
+static uint32_t
+clay_lua_localIdSeed(lua_State *L)
+{
+  clay_lua_enter(L);
+  if (Clay_GetCurrentContext()->openLayoutElementStack.length < 2)
+  {
+    luaL_error(L, "local ids can only be used inside an element");
+  }
+  return Clay__GetParentElementId();
+}
+
+/*
+ * Ids can be given as:
+ *   "Name"                          -> CLAY_ID("Name")
+ *   { "Name", index }               -> CLAY_IDI("Name", index)
+ *   { "Name", index, local = true } -> CLAY_IDI_LOCAL("Name", index)
+ *   a handle from clay.id / clay.idi
+ */
+static Clay_ElementId
+clay_lua_toElementId(lua_State *L, int idx)
+{
+  Clay_ElementId *handle = clay_lua_toElementIdHandle(L, idx);
+  if (handle) return *handle;
+
+  if (lua_istable(L, idx))
+  {
+    uint32_t seed = 0;
+    lua_rawgeti(L, idx, 1);
+    Clay_String key = clay_lua_toString(L, -1);
+    lua_rawgeti(L, idx, 2);
+    uint32_t index = (uint32_t)lua_tonumber(L, -1);
+    lua_getfield(L, idx, "local");
+    if (lua_toboolean(L, -1)) seed = clay_lua_localIdSeed(L);
+    lua_pop(L, 3);
+    return Clay__HashString(key, index, seed);
+  }
+
+  Clay_String key = clay_lua_toString(L, idx);
+  return Clay__HashString(key, 0, 0);
+}
+
+/* An id in the configuration of an element, local ones are recorded by name for clay.cached */
+static Clay_ElementId
+clay_lua_toConfiguredElementId(lua_State *L, int idx, int floatingParent)
+{
+  Clay_ElementId id = clay_lua_toElementId(L, idx);
+  if (!currentContext || !currentContext->recording || !lua_istable(L, idx)) return id;
+
+  lua_getfield(L, idx, "local");
+  int local = lua_toboolean(L, -1);
+  lua_pop(L, 1);
+  if (local)
+  {
+    struct RecordedLocalId recorded = { id.stringId, id.offset, floatingParent };
+    clay_lua_record(L, CLAY_LUA_RECORD_LOCAL_ID, &recorded, sizeof recorded);
+  }
+  return id;
+}
+
+static void
+clay_lua_pushElementId(lua_State *L, Clay_ElementId id)
+{
+  Clay_ElementId *handle = lua_newuserdata(L, sizeof *handle);
+  *handle = id;
+  luaL_getmetatable(L, CLAY_LUA_ELEMENT_ID);
+  lua_setmetatable(L, -2);
+}
+
+/* Interns the name in the shared string cache so ids can keep pointing at it. */
+static Clay_String
+clay_lua_toSharedString(lua_State *L, int idx)
+{
+  size_t len;
+  const char *str = luaL_checklstring(L, idx, &len);
+  return (Clay_String){(int32_t)len, clay_lua_storeString(sharedStrings, str, len)};
+}
+
+/*
+ * clay.id(name)
+ *
+ * Equivalent to CLAY_ID(name).
+ * Hashes the name once and returns a handle that can be used as the id
+ * of an element or passed to any function that takes an id, so hot paths
+ * don't need to hash the same string every frame.
+ */
+static int
+l_id(lua_State *L)
+{
+  Clay_String key = clay_lua_toSharedString(L, 1);
+  clay_lua_pushElementId(L, Clay__HashString(key, 0, 0));
+  return 1;
+}
+
+/*
+ * clay.idi(name, index)
+ *
+ * Equivalent to CLAY_IDI(name, index).
+ */
+static int
+l_idi(lua_State *L)
+{
+  Clay_String key = clay_lua_toSharedString(L, 1);
+  uint32_t index = (uint32_t)lua_tonumber(L, 2);
+  clay_lua_pushElementId(L, Clay__HashString(key, index, 0));
+  return 1;
+}
+
+static int
+l_elementId__index(lua_State *L)
+{
+  Clay_ElementId *id = lua_touserdata(L, 1);
+  const char *index = lua_tostring(L, 2);
+  if (index == NULL)
+  {
+    lua_pushnil(L);
+  }
+  else if (strcmp(index, "id") == 0)
+  {
+    lua_pushnumber(L, id->id);
+  }
+  else if (strcmp(index, "offset") == 0)
+  {
+    lua_pushnumber(L, id->offset);
+  }
+  else if (strcmp(index, "baseId") == 0)
+  {
+    lua_pushnumber(L, id->baseId);
+  }
+  else if (strcmp(index, "stringId") == 0)
+  {
+    lua_pushlstring(L, id->stringId.chars, id->stringId.length);
+  }
+  else
+  {
+    lua_pushnil(L);
+  }
+  return 1;
+}
+
+static int
+l_elementId__eq(lua_State *L)
+{
+  Clay_ElementId *a = lua_touserdata(L, 1);
+  Clay_ElementId *b = lua_touserdata(L, 2);
+  lua_pushboolean(L, a->id == b->id);
+  return 1;
+}
+
+static int
+l_elementId__tostring(lua_State *L)
+{
+  Clay_ElementId *id = lua_touserdata(L, 1);
+  lua_pushliteral(L, "ElementId(");
+  lua_pushlstring(L, id->stringId.chars, id->stringId.length);
+  lua_pushfstring(L, ", %d)", (int)id->offset);
+  lua_concat(L, 3);
+  return 1;
 }
 
 static void
@@ -564,8 +1523,7 @@ clay_lua_build_element_parentId(lua_State *L, int idx, uint32_t *parentId)
 {
   if (lua_isnil(L, idx)) return;
 
-  Clay_String key = clay_lua_toString(L, idx);
-  *parentId = Clay_GetElementId(key).id;
+  *parentId = clay_lua_toConfiguredElementId(L, idx, 1).id;
 }
 
 static void
@@ -673,8 +1631,7 @@ clay_lua_build_element_id(lua_State *L, int idx, Clay_ElementId *id)
   lua_getfield(L, idx, "id");
   if (lua_isnil(L, -1)) return;
 
-  Clay_String key = clay_lua_toString(L, -1);
-  *id = Clay__HashString(key, 0, 0);
+  *id = clay_lua_toConfiguredElementId(L, lua_gettop(L), 0);
 }
 
 static void
@@ -971,7 +1928,9 @@ l_configureOpenElement(lua_State *L)
 {
   Clay_ElementDeclaration config = (Clay_ElementDeclaration){0};
   clay_lua_configure_element(L, 1, &config);
+  clay_lua_enter(L);
   Clay__ConfigureOpenElement(config);
+  clay_lua_record(L, CLAY_LUA_RECORD_CONFIGURE, &config, sizeof config);
   return 0;
 }
 
@@ -1028,89 +1987,182 @@ clay_lua_build_textConfig(lua_State *L, Clay_TextElementConfig *config)
 static int
 l_resetMeasureTextCache(lua_State *L)
 {
+  clay_lua_enter(L);
   Clay_ResetMeasureTextCache();
   return 0;
 }
 
+/*
+ * clay.setMaxElementCount(count)
+ *
+ * Changes the limit of the current context, giving it a new arena.
+ * Without a context, sets the default for the next one created.
+ */
 static int
 l_setMaxElementCount(lua_State *L)
 {
-  Clay_SetMaxElementCount((int32_t)lua_tonumber(L, 1));
+  int32_t count = (int32_t)luaL_checkinteger(L, 1);
+  luaL_argcheck(L, count > 0, 1, "count must be positive");
+  clay_lua_enter(L);
+  if (!currentContext)
+  {
+    Clay_SetMaxElementCount(count);
+    return 0;
+  }
+  Clay_Context *clay = currentContext->clay;
+  if (count != clay->maxElementCount) clay_lua_reallocate(L, currentContext, count, clay->maxMeasureTextCacheWordCount);
   return 0;
 }
 
+/*
+ * clay.setMaxMeasureTextCacheWordCount(count)
+ *
+ * Same as clay.setMaxElementCount, for the measured words cache.
+ */
 static int
 l_setMaxMeasureTextCacheWordCount(lua_State *L)
 {
-  Clay_SetMaxMeasureTextCacheWordCount((int32_t)lua_tonumber(L, 1));
+  int32_t count = (int32_t)luaL_checkinteger(L, 1);
+  luaL_argcheck(L, count > 0, 1, "count must be positive");
+  clay_lua_enter(L);
+  if (!currentContext)
+  {
+    Clay_SetMaxMeasureTextCacheWordCount(count);
+    return 0;
+  }
+  Clay_Context *clay = currentContext->clay;
+  if (count != clay->maxMeasureTextCacheWordCount) clay_lua_reallocate(L, currentContext, clay->maxElementCount, count);
   return 0;
 }
 
+/*
+ * clay.setWorkerCount(count)
+ *
+ * Starts count worker threads and lets clay use them to wrap text
+ * elements in parallel. Only pays off for layouts with a lot of text.
+ * Passing 0 stops the workers and goes back to wrapping on the calling thread.
+ * Returns the number of workers actually started.
+ */
+static int
+l_setWorkerCount(lua_State *L)
+{
+  clay_lua_enter(L);
+  int count = clay_lua_startWorkers((int)lua_tonumber(L, 1));
+  if (Clay_GetCurrentContext())
+  {
+    Clay_SetParallelForFunction(count > 0 ? clay_lua_parallelFor : NULL, NULL);
+  }
+  lua_pushnumber(L, count);
+  return 1;
+}
+
 /*
  * clay.hovered()
  */
 static int
 l_hovered(lua_State *L)
 {
+  clay_lua_enter(L);
   lua_pushboolean(L, Clay_Hovered());
   return 1;
 }
 
-struct HoverData
-{
-  lua_State *L;
-  int ref;
-};
-
-void
+/*
+ * Hover callbacks live in a table of the context indexed by element id,
+ * replaced on every layout. Clay keeps the function pointer of an element
+ * across frames, so elements that stop calling clay.onHover find nothing there.
+ */
+static void
 clay_lua_onHover(Clay_ElementId elementId, Clay_PointerData pointerData, intptr_t userData)
 {
-  struct HoverData *data = (struct HoverData *)userData;
+  struct ContextData *data = (struct ContextData *)userData;
   lua_State *L = data->L;
-  int ref = data->ref;
-  lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
-  lua_pushlstring(L, elementId.stringId.chars, elementId.stringId.length);
-  lua_pushnumber(L, pointerData.position.x);
-  lua_pushnumber(L, pointerData.position.y);
-  switch (pointerData.state)
-  {
-    case CLAY_POINTER_DATA_PRESSED_THIS_FRAME:
-    {
-      lua_pushliteral(L, "pressed this frame");
-    };
-    case CLAY_POINTER_DATA_PRESSED:
-    {
-      lua_pushliteral(L, "pressed");
-    };
-    case CLAY_POINTER_DATA_RELEASED_THIS_FRAME:
-    {
-      lua_pushliteral(L, "released this frame");
-    };
-    case CLAY_POINTER_DATA_RELEASED:
+  int top = lua_gettop(L);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, data->hoverRef);
+  lua_pushnumber(L, elementId.id);
+  lua_rawget(L, -2);
+  if (lua_isfunction(L, -1))
+  {
+    lua_pushlstring(L, elementId.stringId.chars, elementId.stringId.length);
+    lua_pushnumber(L, pointerData.position.x);
+    lua_pushnumber(L, pointerData.position.y);
+    switch (pointerData.state)
     {
-      lua_pushliteral(L, "released");
-    };
-    default:
+      case CLAY_POINTER_DATA_PRESSED_THIS_FRAME:
+      {
+        lua_pushliteral(L, "pressed this frame");
+        break;
+      }
+      case CLAY_POINTER_DATA_PRESSED:
+      {
+        lua_pushliteral(L, "pressed");
+        break;
+      }
+      case CLAY_POINTER_DATA_RELEASED_THIS_FRAME:
+      {
+        lua_pushliteral(L, "released this frame");
+        break;
+      }
+      case CLAY_POINTER_DATA_RELEASED:
+      {
+        lua_pushliteral(L, "released");
+        break;
+      }
+      default:
+      {
+        lua_pushliteral(L, "unknown");
+        break;
+      }
+    }
+    lua_call(L, 4, 0);
+  }
+  lua_settop(L, top);
+}
+
+/* Registers the function at idx as the hover callback of the open element, recording it for clay.cached */
+static void
+clay_lua_hover(lua_State *L, int idx)
+{
+  Clay_OnHover(clay_lua_onHover, (intptr_t)currentContext);
+  if (currentContext->clay->booleanWarnings.maxElementsExceeded) return;
+  lua_rawgeti(L, LUA_REGISTRYINDEX, currentContext->hoverRef);
+  lua_pushnumber(L, Clay__GetOpenLayoutElement()->id);
+  lua_pushvalue(L, idx);
+  lua_rawset(L, -3);
+  lua_pop(L, 1);
+  for (struct Recording *recording = currentContext->recording; recording; recording = recording->parent)
+  {
+    if (recording->hoversRef == LUA_NOREF)
     {
-      lua_pushliteral(L, "unknown");
-      break;
+      lua_newtable(L);
+      recording->hoversRef = luaL_ref(L, LUA_REGISTRYINDEX);
     }
+    lua_rawgeti(L, LUA_REGISTRYINDEX, recording->hoversRef);
+    int32_t slot = ++recording->hoverCount;
+    lua_pushvalue(L, idx);
+    lua_rawseti(L, -2, slot);
+    lua_pop(L, 1);
+    char op = CLAY_LUA_RECORD_HOVER;
+    clay_lua_appendRecording(L, recording, &op, 1);
+    clay_lua_appendRecording(L, recording, &slot, sizeof slot);
   }
-  lua_call(L, 4, 0);
 }
 
 /*
  * clay.onHover(callback)
+ *
+ * Calls callback(id, x, y, state) when the pointer is over the open element.
  */
 static int
 l_onHover(lua_State *L)
 {
-  struct HoverData *data = lua_newuserdata(L, sizeof*data);
-  lua_pushvalue(L, -1);
-  luaL_ref(L, -1);
-  data->L = L;
-  data->ref = luaL_ref(L, 1);
-  Clay_OnHover(clay_lua_onHover, (intptr_t)data);
+  luaL_checktype(L, 1, LUA_TFUNCTION);
+  if (!currentContext)
+  {
+    luaL_error(L, "there is no current context, call clay.initialize first");
+  }
+  clay_lua_enter(L);
+  clay_lua_hover(L, 1);
   return 0;
 }
 
@@ -1118,21 +2170,54 @@ l_onHover(lua_State *L)
  * clay.pointerOver(id)
  *
  * Checks if the mouse is over the element with the specific id.
+ * The id can be a string or a handle returned by clay.id.
  */
 static int
 l_pointerOver(lua_State *L)
 {
-  Clay_String key = clay_lua_toString(L, 1);
-  Clay_ElementId id = Clay_GetElementId(key);
+  Clay_ElementId id = clay_lua_toElementId(L, 1);
+  clay_lua_enter(L);
   lua_pushboolean(L, Clay_PointerOver(id));
   return 1;
 }
 
+/*
+ * clay.hoveredIds()
+ *
+ * Returns the ids (as numbers) of every element under the mouse, in the order clay found them:
+ * elements of the topmost layer first, and parents before their children.
+ * Cheaper than calling clay.pointerOver for many ids, build a set from it instead.
+ * The numbers match the id field of handles returned by clay.id and clay.idi.
+ *
+ * Example:
+ *
+ * local hovered = {}
+ * for _, id in ipairs(clay.hoveredIds()) do hovered[id] = true end
+ * if hovered[buttonId.id] then
+ *   -- ...
+ * end
+ */
+static int
+l_hoveredIds(lua_State *L)
+{
+  clay_lua_enter(L);
+  Clay_Context *context = Clay_GetCurrentContext();
+  int32_t count = context ? context->pointerOverIds.length : 0;
+  lua_createtable(L, count, 0);
+  for (int32_t i = 0; i < count; ++i)
+  {
+    lua_pushnumber(L, context->pointerOverIds.internalArray[i].id);
+    lua_rawseti(L, -2, i + 1);
+  }
+  return 1;
+}
+
 static int
 l_scrollPosition__index(lua_State *L)
 {
   Clay_Vector2 *vec = lua_touserdata(L, 1);
   const char *index = lua_tostring(L, 2);
+  clay_lua_enter(L);
   if (strcmp(index, "x") == 0)
   {
     lua_pushnumber(L, vec->x);
@@ -1153,6 +2238,7 @@ l_scrollPosition__newindex(lua_State *L)
 {
   Clay_Vector2 *vec = lua_touserdata(L, 1);
   const char *index = lua_tostring(L, 2);
+  clay_lua_enter(L);
   if (strcmp(index, "x") == 0)
   {
     vec->x = (float)lua_tonumber(L, 3);
@@ -1173,8 +2259,8 @@ l_scrollPosition__newindex(lua_State *L)
 static int
 l_getScrollContainerData(lua_State *L)
 {
-  Clay_String key = clay_lua_toString(L, 1);
-  Clay_ElementId id = Clay_GetElementId(key);
+  Clay_ElementId id = clay_lua_toElementId(L, 1);
+  clay_lua_enter(L);
   Clay_ScrollContainerData data = Clay_GetScrollContainerData(id);
   lua_newtable(L);
   int scroll = lua_gettop(L);
@@ -1260,45 +2346,43 @@ l_text(lua_State *L)
 {
   Clay_String text = clay_lua_toString(L, 1);
   Clay_TextElementConfig *config = &Clay_TextElementConfig_DEFAULT;
+  clay_lua_enter(L);
   if (lua_istable(L, 2))
   {
-    lua_getfield(L, 2, "__data__");
-    if (lua_isuserdata(L, -1))
-    {
-      config = lua_touserdata(L, -1);
-    }
-    else
-    {
-      config = lua_newuserdata(L, sizeof(Clay_TextElementConfig));
-    }
-    lua_pushvalue(L, -1);
-    lua_setfield(L, 2, "__data__");
-    *config = (Clay_TextElementConfig){0};
-    clay_lua_build_element_textConfig(L, 2, config);
+    Clay_TextElementConfig built = (Clay_TextElementConfig){0};
+    clay_lua_build_element_textConfig(L, 2, &built);
+    /* Copied into the arena like CLAY_TEXT_CONFIG does, the table may be collected before the layout ends */
+    config = Clay__StoreTextElementConfig(built);
   }
   CLAY_TEXT(text, config);
+  if (currentContext && currentContext->recording)
+  {
+    struct RecordedText recorded = { text, *config };
+    clay_lua_record(L, CLAY_LUA_RECORD_TEXT, &recorded, sizeof recorded);
+  }
   return 0;
 }
 
-static struct {
-  lua_State *L;
-  int ref;
-} MeasureTextData;
-
 static Clay_Dimensions
-clay_lua_measureText(Clay_StringSlice str, Clay_TextElementConfig *config, void *_)
+clay_lua_measureText(Clay_StringSlice str, Clay_TextElementConfig *config, void *userData)
 {
-  lua_State *L = MeasureTextData.L;
+  struct ContextData *data = userData;
+  lua_State *L = data->L;
+  int top = lua_gettop(L);
   Clay_Dimensions result = (Clay_Dimensions){0};
   clay_lua_build_textConfig(L, config);
   int conf = lua_gettop(L);
-  lua_rawgeti(L, LUA_REGISTRYINDEX, MeasureTextData.ref);
-  if (lua_isnil(L, -1)) return result;
-  lua_pushlstring(L, str.chars, str.length);
-  lua_pushvalue(L, conf);
-  lua_call(L, 2, 2);
-  result.width = (float)lua_tonumber(L, -2);
-  result.height = (float)lua_tonumber(L, -1);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, data->measureTextRef);
+  if (!lua_isnil(L, -1))
+  {
+    lua_pushlstring(L, str.chars, str.length);
+    lua_pushvalue(L, conf);
+    lua_call(L, 2, 2);
+    result.width = (float)lua_tonumber(L, -2);
+    result.height = (float)lua_tonumber(L, -1);
+  }
+  /* This runs once per measured word, don't let the stack grow */
+  lua_settop(L, top);
   return result;
 }
 
@@ -1324,12 +2408,38 @@ l_setMeasureTextFunction(lua_State *L)
   {
     luaL_error(L, "measure text function cannot be nil");
   }
-  MeasureTextData.L = L;
-  MeasureTextData.ref = luaL_ref(L, 1);
-  Clay_SetMeasureTextFunction(clay_lua_measureText, 0);
+  if (!currentContext)
+  {
+    luaL_error(L, "there is no current context, call clay.initialize first");
+  }
+  clay_lua_setMeasureTextFunction(L, currentContext, 1);
   return 0;
 }
 
+/* Opens an element, recording it for clay.cached */
+static void
+clay_lua_open(lua_State *L)
+{
+  Clay__OpenElement();
+  clay_lua_record(L, CLAY_LUA_RECORD_OPEN, NULL, 0);
+}
+
+/* Configures the open element, recording it for clay.cached */
+static void
+clay_lua_configure(lua_State *L, Clay_ElementDeclaration *config)
+{
+  Clay__ConfigureOpenElement(*config);
+  clay_lua_record(L, CLAY_LUA_RECORD_CONFIGURE, config, sizeof *config);
+}
+
+/* Closes the open element, recording it for clay.cached */
+static void
+clay_lua_close(lua_State *L)
+{
+  Clay__CloseElement();
+  clay_lua_record(L, CLAY_LUA_RECORD_CLOSE, NULL, 0);
+}
+
 /*
  * clay(config, [function])
  *
@@ -1353,47 +2463,561 @@ l_setMeasureTextFunction(lua_State *L)
 static int
 l__call(lua_State *L)
 {
-  Clay__OpenElement();
+  clay_lua_enter(L);
+  clay_lua_open(L);
   Clay_ElementDeclaration config = (Clay_ElementDeclaration){0};
   clay_lua_configure_element(L, 2, &config);
-  Clay__ConfigureOpenElement(config);
-  if (lua_isfunction(L, 3)) lua_pcall(L, 0, 0, 3);
-  Clay__CloseElement();
+  clay_lua_configure(L, &config);
+  if (lua_isfunction(L, 3))
+  {
+    lua_pushvalue(L, 3);
+    lua_call(L, 0, 0);
+    /* The children may have run from another coroutine */
+    clay_lua_enter(L);
+  }
+  clay_lua_close(L);
+  return 0;
+}
+
+#define CLAY_LUA_VIRTUAL_LIST "clay.VirtualList"
+
+/* What a clay.virtualList without a fixed rowHeight remembers between frames */
+struct VirtualList
+{
+  int32_t count;
+  int32_t capacity;
+  /* The last measured height of each row, or the estimate if it was never shown */
+  float *heights;
+  char *measured;
+  /* Fenwick tree over heights (1 based), so the height of the first n rows takes O(log n) */
+  double *tree;
+  float estimate;
+  /* The rows declared the last time the list was, and the first of them that was in view */
+  int32_t first;
+  int32_t length;
+  int32_t anchor;
+};
+
+static void
+clay_lua_virtualListAdd(struct VirtualList *list, int32_t row, float delta)
+{
+  for (int32_t i = row + 1; i <= list->count; i += i & -i) list->tree[i] += delta;
+}
+
+/* The height of the first n rows, without gaps */
+static double
+clay_lua_virtualListHeight(struct VirtualList *list, int32_t n)
+{
+  double height = 0;
+  for (int32_t i = n; i > 0; i -= i & -i) height += list->tree[i];
+  return height;
+}
+
+/* The row at offset, as the number of rows (and the gap after each) that end before it */
+static int32_t
+clay_lua_virtualListFind(struct VirtualList *list, float offset, float gap)
+{
+  int32_t step = 1;
+  while (step * 2 <= list->count) step *= 2;
+  int32_t row = 0;
+  double height = 0;
+  for (; step > 0; step /= 2)
+  {
+    int32_t next = row + step;
+    if (next <= list->count && height + list->tree[next] + next * gap <= offset)
+    {
+      row = next;
+      height += list->tree[next];
+    }
+  }
+  return row;
+}
+
+/* Rows added to the list start with the estimate, a new estimate applies to the rows never shown */
+static void
+clay_lua_resizeVirtualList(lua_State *L, struct VirtualList *list, int32_t count, float estimate)
+{
+  if (count > list->capacity)
+  {
+    int32_t capacity = list->capacity * 2 > count ? list->capacity * 2 : count;
+    float *heights = realloc(list->heights, capacity * sizeof *heights);
+    if (heights) list->heights = heights;
+    char *measured = realloc(list->measured, capacity * sizeof *measured);
+    if (measured) list->measured = measured;
+    double *tree = realloc(list->tree, (capacity + 1) * sizeof *tree);
+    if (tree) list->tree = tree;
+    if (!heights || !measured || !tree) luaL_error(L, "Not enough memory for %d rows", (int)count);
+    list->capacity = capacity;
+    list->tree[0] = 0;
+  }
+  int rebuild = estimate != list->estimate;
+  list->estimate = estimate;
+  /* Entries only cover rows before them, so the ones kept stay valid when growing or shrinking */
+  for (int32_t i = list->count + 1; i <= count; ++i)
+  {
+    list->heights[i - 1] = estimate;
+    list->measured[i - 1] = 0;
+    if (!rebuild) list->tree[i] = estimate + clay_lua_virtualListHeight(list, i - 1) - clay_lua_virtualListHeight(list, i - (i & -i));
+  }
+  list->count = count;
+  if (!rebuild) return;
+  for (int32_t i = 0; i < count; ++i)
+  {
+    if (!list->measured[i]) list->heights[i] = estimate;
+  }
+  /* Rebuilt in O(n), each entry adds itself to the next one covering it */
+  for (int32_t i = 1; i <= count; ++i) list->tree[i] = list->heights[i - 1];
+  for (int32_t i = 1; i <= count; ++i)
+  {
+    int32_t next = i + (i & -i);
+    if (next <= count) list->tree[next] += list->tree[i];
+  }
+}
+
+static int
+l_virtualList__gc(lua_State *L)
+{
+  struct VirtualList *list = luaL_checkudata(L, 1, CLAY_LUA_VIRTUAL_LIST);
+  free(list->heights);
+  free(list->measured);
+  free(list->tree);
+  list->heights = NULL;
+  list->measured = NULL;
+  list->tree = NULL;
+  list->count = list->capacity = 0;
+  return 0;
+}
+
+/*
+ * The state of the list with this id in the current context, created the first time it is declared
+ * and kept while it is declared every frame.
+ */
+static struct VirtualList *
+clay_lua_getVirtualList(lua_State *L, Clay_ElementId id)
+{
+  lua_rawgeti(L, LUA_REGISTRYINDEX, currentContext->virtualListsRef);
+  int lists = lua_gettop(L);
+  lua_pushnumber(L, id.id);
+  lua_rawget(L, lists);
+  struct VirtualList *list = lua_touserdata(L, -1);
+  if (!list)
+  {
+    /* Declared during the last frame, keep it for the next one */
+    lua_pop(L, 1);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, currentContext->previousVirtualListsRef);
+    lua_pushnumber(L, id.id);
+    lua_rawget(L, -2);
+    list = lua_touserdata(L, -1);
+  }
+  if (!list)
+  {
+    lua_pop(L, 1);
+    list = lua_newuserdata(L, sizeof *list);
+    memset(list, 0, sizeof *list);
+    luaL_getmetatable(L, CLAY_LUA_VIRTUAL_LIST);
+    lua_setmetatable(L, -2);
+  }
+  lua_pushnumber(L, id.id);
+  lua_pushvalue(L, -2);
+  lua_rawset(L, lists);
+  lua_settop(L, lists - 1);
+  return list;
+}
+
+/* Rows get the same ids every frame by their place in the list, so the ids in use stay bounded */
+static Clay_ElementId
+clay_lua_virtualListRowId(Clay_ElementId id, int32_t slot)
+{
+  static const char key[] = "Clay__VirtualListRow";
+  return Clay__HashString((Clay_String){ sizeof key - 1, key }, (uint32_t)slot, id.id);
+}
+
+/* Empty element standing in for rows of a virtual list that are not declared */
+static void
+clay_lua_virtualListSpacer(lua_State *L, float height)
+{
+  Clay_ElementDeclaration config = (Clay_ElementDeclaration){0};
+  config.layout.sizing.height = CLAY_SIZING_FIXED(height);
+  clay_lua_open(L);
+  clay_lua_configure(L, &config);
+  clay_lua_close(L);
+}
+
+/*
+ * clay.virtualList(id, options, rowFn)
+ *
+ * A vertical scroll container with options.count rows,
+ * that only calls rowFn(index) for the rows in view (index starts at 1).
+ * The rest are replaced by spacers, so long lists only cost as much as what is shown.
+ * Each row is wrapped in an element that grows to the list width.
+ *
+ * Options:
+ *   count: how many rows the list has
+ *   rowHeight: the height of every row
+ *   estimatedRowHeight: used instead of rowHeight when rows have different heights,
+ *     rows are assumed to be this tall until they are shown, then their height from
+ *     the last frame is remembered by index. The scroll position is adjusted when
+ *     rows above the visible ones turn out taller or shorter, so the view doesn't jump.
+ *     The heights are forgotten once the list is not declared for a whole frame.
+ *   overscan: how many rows to declare above and below the visible ones (default 2)
+ *   anything else is the configuration of the container, like in clay(config),
+ *   with the layout direction always top to bottom and vertical scroll always enabled
+ *
+ * The rows declared depend on the scroll position, so it raises an error inside clay.cached.
+ *
+ * Example:
+ *
+ * clay.virtualList("Log", { count = #lines, rowHeight = 20, layout = { sizing = "grow" } }, function (i)
+ *   clay.text(lines[i])
+ * end)
+ *
+ * clay.virtualList("Chat", { count = #messages, estimatedRowHeight = 40 }, function (i)
+ *   clay.text(messages[i], { wrapMode = clay.TEXT_WRAP_WORDS })
+ * end)
+ */
+static int
+l_virtualList(lua_State *L)
+{
+  luaL_checktype(L, 2, LUA_TTABLE);
+  luaL_checktype(L, 3, LUA_TFUNCTION);
+  lua_getfield(L, 2, "count");
+  int32_t count = (int32_t)lua_tonumber(L, -1);
+  lua_getfield(L, 2, "rowHeight");
+  float rowHeight = (float)lua_tonumber(L, -1);
+  lua_getfield(L, 2, "estimatedRowHeight");
+  float estimate = (float)lua_tonumber(L, -1);
+  lua_getfield(L, 2, "overscan");
+  int32_t overscan = lua_isnumber(L, -1) ? (int32_t)lua_tonumber(L, -1) : 2;
+  lua_pop(L, 4);
+  luaL_argcheck(L, rowHeight > 0 || estimate > 0, 2, "rowHeight or estimatedRowHeight must be greater than 0");
+  if (count < 0) count = 0;
+  if (overscan < 0) overscan = 0;
+
+  clay_lua_enter(L);
+  if (!currentContext)
+  {
+    luaL_error(L, "there is no current context, call clay.initialize first");
+  }
+  /* A replay would declare the rows that were in view when it was recorded */
+  if (currentContext->recording)
+  {
+    luaL_error(L, "clay.virtualList can't be declared inside clay.cached");
+  }
+  clay_lua_open(L);
+  /* Local ids are relative to the open element, so it must be open first */
+  Clay_ElementId id = clay_lua_toElementId(L, 1);
+  Clay_ElementDeclaration config = (Clay_ElementDeclaration){0};
+  clay_lua_configure_element(L, 2, &config);
+  config.id = id;
+  config.layout.layoutDirection = CLAY_TOP_TO_BOTTOM;
+  config.scroll.vertical = true;
+  clay_lua_configure(L, &config);
+
+  /* Only valid once the container is declared, before that its scroll data may point to an element of the last frame */
+  Clay_ScrollContainerData scroll = Clay_GetScrollContainerData(id);
+  float gap = config.layout.childGap;
+  struct VirtualList *list = NULL;
+  if (rowHeight <= 0)
+  {
+    list = clay_lua_getVirtualList(L, id);
+    clay_lua_resizeVirtualList(L, list, count, estimate);
+    /* The rows declared last time were laid out since, take their actual heights */
+    for (int32_t slot = 0; slot < list->length && list->first + slot < count; ++slot)
+    {
+      Clay_ElementData element = Clay_GetElementData(clay_lua_virtualListRowId(id, slot));
+      if (!element.found) continue;
+      int32_t row = list->first + slot;
+      float delta = element.boundingBox.height - list->heights[row];
+      list->measured[row] = 1;
+      if (delta == 0) continue;
+      list->heights[row] += delta;
+      clay_lua_virtualListAdd(list, row, delta);
+      /* Keep what is in view in place when rows above it change */
+      if (row < list->anchor && scroll.found) scroll.scrollPosition->y -= delta;
+    }
+  }
+
+  float viewport = scroll.scrollContainerDimensions.height;
+  /* Not laid out yet, the window is an upper bound of the visible height */
+  if (viewport <= 0) viewport = Clay_GetCurrentContext()->layoutDimensions.height;
+  float offset = (scroll.found ? -scroll.scrollPosition->y : 0) - config.layout.padding.top;
+  if (offset < 0) offset = 0;
+  float stride = rowHeight + gap;
+  int32_t anchor = list ? clay_lua_virtualListFind(list, offset, gap) : (int32_t)(offset / stride);
+  int32_t first = anchor - overscan;
+  int32_t last = (list ? clay_lua_virtualListFind(list, offset + viewport, gap) : (int32_t)((offset + viewport) / stride)) + 1 + overscan;
+  if (first < 0) first = 0;
+  if (first > count) first = count;
+  if (last > count) last = count;
+  if (last < first) last = first;
+  if (list)
+  {
+    list->first = first;
+    list->length = last - first;
+    list->anchor = anchor;
+  }
+
+  /* The gap after a spacer stands for the gap after the last row it replaces */
+  if (first > 0)
+  {
+    float height = list ? (float)clay_lua_virtualListHeight(list, first) + first * gap : first * stride;
+    clay_lua_virtualListSpacer(L, height - gap);
+  }
+  Clay_ElementDeclaration row = (Clay_ElementDeclaration){0};
+  row.layout.sizing.width = CLAY_SIZING_GROW(0);
+  if (!list) row.layout.sizing.height = CLAY_SIZING_FIXED(rowHeight);
+  for (int32_t i = first; i < last; ++i)
+  {
+    /* Measured next frame, by the position of the row among the ones declared */
+    if (list) row.id = clay_lua_virtualListRowId(id, i - first);
+    clay_lua_open(L);
+    clay_lua_configure(L, &row);
+    lua_pushvalue(L, 3);
+    lua_pushnumber(L, i + 1);
+    lua_call(L, 1, 0);
+    /* The row may have been declared from another coroutine */
+    clay_lua_enter(L);
+    clay_lua_close(L);
+  }
+  if (last < count)
+  {
+    float height = list
+      ? (float)(clay_lua_virtualListHeight(list, count) - clay_lua_virtualListHeight(list, last)) + (count - last) * gap
+      : (count - last) * stride;
+    clay_lua_virtualListSpacer(L, height - gap);
+  }
+  clay_lua_close(L);
+  return 0;
+}
+
+/*
+ * Declares the recorded elements again, they are recorded by the enclosing clay.cached calls too.
+ * hovers is the index of the table with the recorded clay.onHover callbacks.
+ */
+static void
+clay_lua_replay(lua_State *L, struct Recording *recording, int hovers)
+{
+  Clay_ElementId localIds[2];
+  int hasLocalId[2] = { 0, 0 };
+  size_t i = 0;
+  while (i < recording->length)
+  {
+    switch (recording->ops[i++])
+    {
+      case CLAY_LUA_RECORD_OPEN:
+      {
+        clay_lua_open(L);
+        break;
+      }
+      case CLAY_LUA_RECORD_CONFIGURE:
+      {
+        Clay_ElementDeclaration config;
+        memcpy(&config, recording->ops + i, sizeof config);
+        i += sizeof config;
+        if (hasLocalId[0]) config.id = localIds[0];
+        if (hasLocalId[1]) config.floating.parentId = localIds[1].id;
+        hasLocalId[0] = hasLocalId[1] = 0;
+        clay_lua_configure(L, &config);
+        break;
+      }
+      case CLAY_LUA_RECORD_CLOSE:
+      {
+        clay_lua_close(L);
+        break;
+      }
+      case CLAY_LUA_RECORD_TEXT:
+      {
+        struct RecordedText recorded;
+        memcpy(&recorded, recording->ops + i, sizeof recorded);
+        i += sizeof recorded;
+        Clay__OpenTextElement(recorded.text, Clay__StoreTextElementConfig(recorded.config));
+        clay_lua_record(L, CLAY_LUA_RECORD_TEXT, &recorded, sizeof recorded);
+        break;
+      }
+      case CLAY_LUA_RECORD_LOCAL_ID:
+      {
+        struct RecordedLocalId recorded;
+        memcpy(&recorded, recording->ops + i, sizeof recorded);
+        i += sizeof recorded;
+        localIds[recorded.floatingParent] = Clay__HashString(recorded.key, recorded.index, Clay__GetParentElementId());
+        hasLocalId[recorded.floatingParent] = 1;
+        clay_lua_record(L, CLAY_LUA_RECORD_LOCAL_ID, &recorded, sizeof recorded);
+        break;
+      }
+      case CLAY_LUA_RECORD_HOVER:
+      {
+        int32_t slot;
+        memcpy(&slot, recording->ops + i, sizeof slot);
+        i += sizeof slot;
+        lua_rawgeti(L, hovers, slot);
+        clay_lua_hover(L, lua_gettop(L));
+        lua_pop(L, 1);
+        break;
+      }
+    }
+  }
+}
+
+static int
+l_recording__gc(lua_State *L)
+{
+  struct Recording *recording = luaL_checkudata(L, 1, CLAY_LUA_RECORDING);
+  free(recording->ops);
+  recording->ops = NULL;
+  recording->length = recording->capacity = 0;
   return 0;
 }
 
+/*
+ * clay.cached(id, deps, fn, ...)
+ *
+ * Calls fn(...) to declare elements and records what it declared.
+ * On the next frames, as long as deps is the same value (compared with rawequal),
+ * fn is not called and the recorded elements are declared again instead.
+ * id takes the same forms as element ids and tells the cached parts of a frame apart.
+ * Elements, texts and clay.onHover callbacks are recorded, anything else fn does
+ * only happens on the frames it runs. Local ids are hashed again against the parent
+ * the elements are replayed in. Recordings not used for a frame are dropped.
+ * clay.virtualList can't be used inside fn, as it declares different rows as it scrolls.
+ * Returns true if the recording was replayed.
+ *
+ * Example:
+ *
+ * clay.cached("Inventory", inventory.version, drawInventory, inventory)
+ */
+static int
+l_cached(lua_State *L)
+{
+  luaL_checktype(L, 3, LUA_TFUNCTION);
+  clay_lua_enter(L);
+  if (!currentContext)
+  {
+    luaL_error(L, "there is no current context, call clay.initialize first");
+  }
+  struct ContextData *data = currentContext;
+  int args = lua_gettop(L);
+  lua_pushnumber(L, clay_lua_toElementId(L, 1).id);
+  int key = lua_gettop(L);
+  lua_rawgeti(L, LUA_REGISTRYINDEX, data->cacheRef);
+  int cache = lua_gettop(L);
+  lua_pushvalue(L, key);
+  lua_rawget(L, cache);
+  if (lua_isnil(L, -1))
+  {
+    /* Used during the last frame, keep it for the next one */
+    lua_pop(L, 1);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, data->previousCacheRef);
+    lua_pushvalue(L, key);
+    lua_rawget(L, -2);
+    lua_pushvalue(L, key);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, cache);
+  }
+  int entry = lua_gettop(L);
+  if (lua_istable(L, entry))
+  {
+    lua_rawgeti(L, entry, 1);
+    if (lua_rawequal(L, -1, 2))
+    {
+      lua_rawgeti(L, entry, 2);
+      lua_rawgeti(L, entry, 3);
+      clay_lua_replay(L, lua_touserdata(L, -2), lua_gettop(L));
+      lua_pushboolean(L, 1);
+      return 1;
+    }
+  }
+
+  struct Recording *recording = lua_newuserdata(L, sizeof *recording);
+  recording->ops = NULL;
+  recording->length = recording->capacity = 0;
+  recording->parent = data->recording;
+  recording->hoversRef = LUA_NOREF;
+  recording->hoverCount = 0;
+  luaL_getmetatable(L, CLAY_LUA_RECORDING);
+  lua_setmetatable(L, -2);
+  int record = lua_gettop(L);
+  data->recording = recording;
+  for (int i = 3; i <= args; ++i) lua_pushvalue(L, i);
+  int status = lua_pcall(L, args - 3, 0, 0);
+  data->recording = recording->parent;
+  /* The hover callbacks are kept in the cache entry, next to the recording */
+  if (recording->hoversRef == LUA_NOREF)
+  {
+    lua_newtable(L);
+  }
+  else
+  {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, recording->hoversRef);
+    luaL_unref(L, LUA_REGISTRYINDEX, recording->hoversRef);
+    recording->hoversRef = LUA_NOREF;
+  }
+  int hovers = lua_gettop(L);
+  if (status != 0)
+  {
+    lua_pushvalue(L, hovers - 1);
+    lua_error(L);
+  }
+  /* The elements may have been declared from another coroutine */
+  clay_lua_enter(L);
+
+  lua_pushvalue(L, key);
+  lua_createtable(L, 3, 0);
+  lua_pushvalue(L, 2);
+  lua_rawseti(L, -2, 1);
+  lua_pushvalue(L, record);
+  lua_rawseti(L, -2, 2);
+  lua_pushvalue(L, hovers);
+  lua_rawseti(L, -2, 3);
+  lua_rawset(L, cache);
+  lua_pushboolean(L, 0);
+  return 1;
+}
+
 #define CLAY_LUA_FN(name) lua_pushcfunction(L, l_ ## name); lua_setfield(L, clay, #name)
 #define CLAY_LUA_CONST(name) lua_pushnumber(L, CLAY_ ## name); lua_setfield(L, clay, #name)
 
 LUALIB_API int
 luaopen_clay(lua_State *L)
 {
-  clay_lua_initStringCache();
+  if (!sharedStrings) sharedStrings = clay_lua_newStringCache();
   lua_newtable(L);
   int clay = lua_gettop(L);
   lua_pushvalue(L, -1);
   lua_setfield(L, LUA_REGISTRYINDEX, "clay");
   /* Functions */
   CLAY_LUA_FN(initialize);
+  CLAY_LUA_FN(newContext);
   CLAY_LUA_FN(getCurrentContext);
   CLAY_LUA_FN(setCurrentContext);
   CLAY_LUA_FN(setLayoutDimensions);
   CLAY_LUA_FN(setPointerState);
   CLAY_LUA_FN(updateScrollContainers); 
   CLAY_LUA_FN(beginLayout); 
-  CLAY_LUA_FN(endLayout); 
+  CLAY_LUA_FN(endLayout);
+  CLAY_LUA_FN(layout); 
+  CLAY_LUA_FN(getRenderCommands);
+  CLAY_LUA_FN(getRenderCommandBuffer);
+  CLAY_LUA_FN(endLayoutAsync);
+  CLAY_LUA_FN(fetchCommands);
+  CLAY_LUA_FN(isBuildingLayout);
   CLAY_LUA_FN(openElement); 
   CLAY_LUA_FN(closeElement); 
   CLAY_LUA_FN(configureOpenElement); 
   CLAY_LUA_FN(resetMeasureTextCache); 
   CLAY_LUA_FN(setMaxElementCount); 
   CLAY_LUA_FN(setMaxMeasureTextCacheWordCount);
+  CLAY_LUA_FN(setWorkerCount);
   CLAY_LUA_FN(setMeasureTextFunction);
   CLAY_LUA_FN(hovered);
   CLAY_LUA_FN(onHover);
   CLAY_LUA_FN(pointerOver);
+  CLAY_LUA_FN(hoveredIds);
   CLAY_LUA_FN(getScrollContainerData);
   CLAY_LUA_FN(text);
+  CLAY_LUA_FN(cached);
+  CLAY_LUA_FN(virtualList);
+  CLAY_LUA_FN(id);
+  CLAY_LUA_FN(idi);
   /* Constants */
   CLAY_LUA_CONST(LEFT_TO_RIGHT);
   CLAY_LUA_CONST(TOP_TO_BOTTOM);
@@ -1420,6 +3044,38 @@ luaopen_clay(lua_State *L)
   CLAY_LUA_CONST(ATTACH_TO_ROOT);
   CLAY_LUA_CONST(ATTACH_TO_ELEMENT_WITH_ID);  
 
+  luaL_newmetatable(L, CLAY_LUA_CONTEXT);
+  int context = lua_gettop(L);
+  lua_newtable(L);
+  lua_pushcfunction(L, l_setCurrentContext);
+  lua_setfield(L, -2, "setCurrent");
+  lua_setfield(L, context, "__index");
+  lua_pushcfunction(L, l_context__gc);
+  lua_setfield(L, context, "__gc");
+  lua_pushboolean(L, 0);
+  lua_setfield(L, context, "__metatable");
+
+  luaL_newmetatable(L, CLAY_LUA_RECORDING);
+  lua_pushcfunction(L, l_recording__gc);
+  lua_setfield(L, -2, "__gc");
+  lua_pop(L, 1);
+
+  luaL_newmetatable(L, CLAY_LUA_VIRTUAL_LIST);
+  lua_pushcfunction(L, l_virtualList__gc);
+  lua_setfield(L, -2, "__gc");
+  lua_pop(L, 1);
+
+  luaL_newmetatable(L, CLAY_LUA_ELEMENT_ID);
+  int elementId = lua_gettop(L);
+  lua_pushcfunction(L, l_elementId__index);
+  lua_setfield(L, elementId, "__index");
+  lua_pushcfunction(L, l_elementId__eq);
+  lua_setfield(L, elementId, "__eq");
+  lua_pushcfunction(L, l_elementId__tostring);
+  lua_setfield(L, elementId, "__tostring");
+  lua_pushboolean(L, 0);
+  lua_setfield(L, elementId, "__metatable");
+
   lua_newtable(L);
   int meta = lua_gettop(L);
   lua_pushboolean(L, 0);
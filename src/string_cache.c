@@ -1,5 +1,6 @@
 #include "clay.h"
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
 struct CacheNode {
@@ -9,7 +10,9 @@ struct CacheNode {
  size_t len;
 };
 
-struct CacheNode root = {NULL, NULL, "", 0 };
+struct StringCache {
+ struct CacheNode root;
+};
 
 static int
 compare_strings(const char *s1, size_t len1, const char *s2, size_t len2)
@@ -19,42 +22,62 @@ compare_strings(const char *s1, size_t len1, const char *s2, size_t len2)
   return strncmp(s1, s2, len1);
 }
 
+static struct CacheNode *
+new_node(const char *text, size_t size)
+{
+  struct CacheNode *node = malloc(sizeof(struct CacheNode));
+  char *str = malloc(size + 1);
+  strncpy(str, text, size);
+  str[size] = '\0';
+  node->left = node->right = NULL;
+  node->string = str;
+  node->len = size;
+  return node;
+}
+
 static const char *
 find_in_node(const char *text, size_t size, struct CacheNode *node)
 {
-  char *str;
   int cmp = compare_strings(text, size, node->string, node->len);
   if (cmp == 0) return node->string;
   if (cmp < 0)
   {
     if (node->left) return find_in_node(text, size, node->left);
-    node->left = malloc(sizeof(struct CacheNode));
-    str = malloc(size + 1);
-    strncpy(str, text, size);
-    str[size] = '\0';
-    node->left->left = node->left->right = NULL;
-    node->left->string = str;
-    node->left->len = size;
-    return str;
+    node->left = new_node(text, size);
+    return node->left->string;
   }
   if (node->right) return find_in_node(text, size, node->right);
-  node->right = malloc(sizeof(struct CacheNode));
-  str = malloc(size + 1);
-  strncpy(str, text, size);
-  str[size] = '\0';
-  node->right->left = node->right->right = NULL;
-  node->right->string = str;
-  node->right->len = size;
-  return str;
+  node->right = new_node(text, size);
+  return node->right->string;
+}
+
+static void
+free_node(struct CacheNode *node)
+{
+  if (node->left) free_node(node->left);
+  if (node->right) free_node(node->right);
+  free(node->string);
+  free(node);
+}
+
+struct StringCache *
+clay_lua_newStringCache(void)
+{
+  struct StringCache *cache = malloc(sizeof(struct StringCache));
+  cache->root = (struct CacheNode){NULL, NULL, "", 0 };
+  return cache;
 }
 
 void
-clay_lua_initStringCache(void)
+clay_lua_freeStringCache(struct StringCache *cache)
 {
+  if (cache->root.left) free_node(cache->root.left);
+  if (cache->root.right) free_node(cache->root.right);
+  free(cache);
 }
 
 const char *
-clay_lua_storeString(const char *text, size_t len)
+clay_lua_storeString(struct StringCache *cache, const char *text, size_t len)
 {
-  return find_in_node(text, len, &root);
+  return find_in_node(text, len, &cache->root);
 }
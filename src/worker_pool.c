@@ -0,0 +1,282 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+
+typedef HANDLE worker_thread;
+typedef CRITICAL_SECTION worker_mutex;
+typedef CONDITION_VARIABLE worker_cond;
+
+#define worker_mutex_init(m) InitializeCriticalSection(m)
+#define worker_mutex_lock(m) EnterCriticalSection(m)
+#define worker_mutex_unlock(m) LeaveCriticalSection(m)
+#define worker_cond_init(c) InitializeConditionVariable(c)
+#define worker_cond_wait(c, m) SleepConditionVariableCS(c, m, INFINITE)
+#define worker_cond_broadcast(c) WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+
+typedef pthread_t worker_thread;
+typedef pthread_mutex_t worker_mutex;
+typedef pthread_cond_t worker_cond;
+
+#define worker_mutex_init(m) pthread_mutex_init(m, NULL)
+#define worker_mutex_lock(m) pthread_mutex_lock(m)
+#define worker_mutex_unlock(m) pthread_mutex_unlock(m)
+#define worker_cond_init(c) pthread_cond_init(c, NULL)
+#define worker_cond_wait(c, m) pthread_cond_wait(c, m)
+#define worker_cond_broadcast(c) pthread_cond_broadcast(c)
+#endif
+
+#define WORKER_POOL_MAX_THREADS 64
+
+struct WorkerPool {
+  worker_mutex lock;
+  worker_mutex dispatch;
+  worker_cond wake;
+  worker_cond done;
+  worker_thread threads[WORKER_POOL_MAX_THREADS];
+  int initialized;
+  int count;
+  int stopping;
+  void (*task)(void *data, int32_t index);
+  void *data;
+  int32_t taskCount;
+  int32_t nextTask;
+  int32_t finishedTasks;
+};
+
+static struct WorkerPool pool;
+
+/* Runs tasks until there are none left to take, must be called with the lock held */
+static void
+run_tasks(void)
+{
+  while (pool.nextTask < pool.taskCount)
+  {
+    int32_t index = pool.nextTask++;
+    worker_mutex_unlock(&pool.lock);
+    pool.task(pool.data, index);
+    worker_mutex_lock(&pool.lock);
+    pool.finishedTasks++;
+    if (pool.finishedTasks == pool.taskCount) worker_cond_broadcast(&pool.done);
+  }
+}
+
+static void
+worker_loop(void)
+{
+  worker_mutex_lock(&pool.lock);
+  for (;;)
+  {
+    while (!pool.stopping && pool.nextTask >= pool.taskCount)
+    {
+      worker_cond_wait(&pool.wake, &pool.lock);
+    }
+    if (pool.stopping) break;
+    run_tasks();
+  }
+  worker_mutex_unlock(&pool.lock);
+}
+
+#ifdef _WIN32
+static unsigned __stdcall
+worker_main(void *unused)
+{
+  (void) unused;
+  worker_loop();
+  return 0;
+}
+#else
+static void *
+worker_main(void *unused)
+{
+  (void) unused;
+  worker_loop();
+  return NULL;
+}
+#endif
+
+/*
+ * The locks are never destroyed, a layout finishing on a background thread
+ * may be dispatching tasks while the main thread stops or restarts the workers.
+ */
+static void
+init_pool(void)
+{
+  if (pool.initialized) return;
+  worker_mutex_init(&pool.lock);
+  worker_mutex_init(&pool.dispatch);
+  worker_cond_init(&pool.wake);
+  worker_cond_init(&pool.done);
+  pool.initialized = 1;
+}
+
+/* Must be called with the dispatch lock held, so no tasks are running */
+static void
+stop_threads(void)
+{
+  worker_mutex_lock(&pool.lock);
+  pool.stopping = 1;
+  worker_cond_broadcast(&pool.wake);
+  worker_mutex_unlock(&pool.lock);
+  for (int i = 0; i < pool.count; ++i)
+  {
+#ifdef _WIN32
+    WaitForSingleObject(pool.threads[i], INFINITE);
+    CloseHandle(pool.threads[i]);
+#else
+    pthread_join(pool.threads[i], NULL);
+#endif
+  }
+  pool.count = 0;
+  pool.stopping = 0;
+}
+
+void
+clay_lua_stopWorkers(void)
+{
+  if (!pool.initialized) return;
+  worker_mutex_lock(&pool.dispatch);
+  stop_threads();
+  worker_mutex_unlock(&pool.dispatch);
+}
+
+/*
+ * Starts count threads (on top of the calling one) to run clay_lua_parallelFor tasks.
+ * Returns how many threads are actually running.
+ */
+int
+clay_lua_startWorkers(int count)
+{
+  if (count <= 0)
+  {
+    clay_lua_stopWorkers();
+    return 0;
+  }
+  if (count > WORKER_POOL_MAX_THREADS) count = WORKER_POOL_MAX_THREADS;
+
+  init_pool();
+  worker_mutex_lock(&pool.dispatch);
+  stop_threads();
+  pool.taskCount = pool.nextTask = pool.finishedTasks = 0;
+  for (pool.count = 0; pool.count < count; ++pool.count)
+  {
+#ifdef _WIN32
+    pool.threads[pool.count] = (HANDLE)_beginthreadex(NULL, 0, worker_main, NULL, 0, NULL);
+    if (pool.threads[pool.count] == 0) break;
+#else
+    if (pthread_create(&pool.threads[pool.count], NULL, worker_main, NULL) != 0) break;
+#endif
+  }
+  worker_mutex_unlock(&pool.dispatch);
+  return pool.count;
+}
+
+int
+clay_lua_workerCount(void)
+{
+  return pool.count;
+}
+
+/*
+ * Matches the signature Clay_SetParallelForFunction expects.
+ * The calling thread works on tasks too, so this also works with no workers running.
+ */
+void
+clay_lua_parallelFor(void (*task)(void *data, int32_t index), void *data, int32_t count, void *userData)
+{
+  (void) userData;
+  if (!pool.initialized)
+  {
+    for (int32_t i = 0; i < count; ++i) task(data, i);
+    return;
+  }
+  worker_mutex_lock(&pool.dispatch);
+  if (pool.count == 0)
+  {
+    worker_mutex_unlock(&pool.dispatch);
+    for (int32_t i = 0; i < count; ++i) task(data, i);
+    return;
+  }
+  worker_mutex_lock(&pool.lock);
+  pool.task = task;
+  pool.data = data;
+  pool.taskCount = count;
+  pool.nextTask = 0;
+  pool.finishedTasks = 0;
+  worker_cond_broadcast(&pool.wake);
+  run_tasks();
+  while (pool.finishedTasks < pool.taskCount)
+  {
+    worker_cond_wait(&pool.done, &pool.lock);
+  }
+  pool.taskCount = pool.nextTask = 0;
+  worker_mutex_unlock(&pool.lock);
+  worker_mutex_unlock(&pool.dispatch);
+}
+
+struct BackgroundJob {
+  worker_thread thread;
+  void (*fn)(void *data);
+  void *data;
+};
+
+#ifdef _WIN32
+static unsigned __stdcall
+background_main(void *job)
+#else
+static void *
+background_main(void *job)
+#endif
+{
+  struct BackgroundJob *self = job;
+  self->fn(self->data);
+#ifdef _WIN32
+  return 0;
+#else
+  return NULL;
+#endif
+}
+
+/*
+ * Runs fn(data) on a thread of its own, independent of the pool so it can use the pool itself.
+ * Returns NULL if the thread couldn't be started, fn was not called in that case.
+ */
+void *
+clay_lua_runInBackground(void (*fn)(void *data), void *data)
+{
+  /* Starting the thread publishes the pool to it, it can't see it half initialized later */
+  init_pool();
+  struct BackgroundJob *job = malloc(sizeof *job);
+  if (!job) return NULL;
+  job->fn = fn;
+  job->data = data;
+#ifdef _WIN32
+  job->thread = (HANDLE)_beginthreadex(NULL, 0, background_main, job, 0, NULL);
+  if (job->thread == 0)
+#else
+  if (pthread_create(&job->thread, NULL, background_main, job) != 0)
+#endif
+  {
+    free(job);
+    return NULL;
+  }
+  return job;
+}
+
+/* Waits for a job started by clay_lua_runInBackground to finish */
+void
+clay_lua_waitBackground(void *job)
+{
+  struct BackgroundJob *self = job;
+#ifdef _WIN32
+  WaitForSingleObject(self->thread, INFINITE);
+  CloseHandle(self->thread);
+#else
+  pthread_join(self->thread, NULL);
+#endif
+  free(self);
+}
@@ -0,0 +1,119 @@
+// Differential test for Clay__CompressChildrenAlongAxis against the original compression loop.
+//
+// cc -O2 -std=c99 -I src tools/difftest/compress.c -o compress && ./compress [rows]
+//
+// Generates rows of children with random sizes and minimum sizes, including children of equal size, and
+// compresses each row with both. Prints the rows where any size differs and fails if there are any.
+#define CLAY_IMPLEMENTATION
+#include "clay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_CHILDREN 64
+
+static uint64_t randomState = 88172645463325252ull;
+
+static uint32_t Random(void) {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return (uint32_t)randomState;
+}
+
+// The compression loop from upstream clay, rescanning every child for the largest ones on each step
+static void ReferenceCompress(Clay_Dimensions *dimensions, Clay_Dimensions *minDimensions, int32_t *resizable, int32_t resizableCount, float totalSizeToDistribute) {
+    int32_t largestContainers[MAX_CHILDREN];
+    while (totalSizeToDistribute > 0.1) {
+        int32_t largestCount = 0;
+        float largestSize = 0;
+        float targetSize = 0;
+        for (int32_t i = 0; i < resizableCount; ++i) {
+            float childSize = dimensions[resizable[i]].width;
+            if ((childSize - largestSize) < 0.1 && (childSize - largestSize) > -0.1) {
+                largestContainers[largestCount++] = resizable[i];
+            } else if (childSize > largestSize) {
+                targetSize = largestSize;
+                largestSize = childSize;
+                largestCount = 0;
+                largestContainers[largestCount++] = resizable[i];
+            }
+            else if (childSize > targetSize) {
+                targetSize = childSize;
+            }
+        }
+
+        if (largestCount == 0) {
+            return;
+        }
+
+        targetSize = CLAY__MAX(targetSize, (largestSize * largestCount) - totalSizeToDistribute) / largestCount;
+
+        for (int32_t childOffset = 0; childOffset < largestCount; childOffset++) {
+            int32_t childIndex = largestContainers[childOffset];
+            float *childSize = &dimensions[childIndex].width;
+            float childMinSize = minDimensions[childIndex].width;
+            float oldChildSize = *childSize;
+            *childSize = CLAY__MAX(childMinSize, targetSize);
+            totalSizeToDistribute -= (oldChildSize - *childSize);
+            if (*childSize == childMinSize) {
+                for (int32_t i = 0; i < resizableCount; i++) {
+                    if (resizable[i] == childIndex) {
+                        resizable[i] = resizable[--resizableCount];
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Whole sizes most of the time, so rows often have children of exactly the same size
+static float RandomSize(float max) {
+    float size = (float)(Random() % (uint32_t)max);
+    return Random() % 4 == 0 ? size + (float)(Random() % 1000) / 1000.0f : size;
+}
+
+int main(int argc, char **argv) {
+    int32_t cases = argc > 1 ? atoi(argv[1]) : 1000000;
+    int32_t mismatches = 0;
+    for (int32_t c = 0; c < cases; ++c) {
+        Clay_Dimensions dimensions[MAX_CHILDREN], minDimensions[MAX_CHILDREN];
+        Clay_Dimensions expected[MAX_CHILDREN];
+        int32_t resizable[MAX_CHILDREN], scratch[MAX_CHILDREN];
+        int32_t childCount = 1 + (int32_t)(Random() % (c % 4 == 0 ? MAX_CHILDREN : 6));
+        float maxSize = (float)(1 + Random() % 300);
+        float totalSize = 0;
+        for (int32_t i = 0; i < childCount; ++i) {
+            float size = Random() % 3 == 0 && i > 0 ? dimensions[Random() % i].width : RandomSize(maxSize);
+            float minSize = Random() % 3 == 0 ? 0 : RandomSize(size + 1);
+            dimensions[i] = CLAY__INIT(Clay_Dimensions) { size, 0 };
+            minDimensions[i] = CLAY__INIT(Clay_Dimensions) { minSize, 0 };
+            resizable[i] = i;
+            totalSize += size;
+        }
+        float totalSizeToDistribute = totalSize * (float)(Random() % 1200) / 1000.0f;
+
+        memcpy(expected, dimensions, sizeof(dimensions));
+        int32_t referenceResizable[MAX_CHILDREN];
+        memcpy(referenceResizable, resizable, sizeof(resizable));
+        ReferenceCompress(expected, minDimensions, referenceResizable, childCount, totalSizeToDistribute);
+
+        Clay__DimensionsView view = { dimensions, minDimensions, (int32_t)sizeof(Clay_Dimensions) };
+        Clay__int32_tArray resizableBuffer = { MAX_CHILDREN, childCount, resizable };
+        Clay__int32_tArray scratchBuffer = { MAX_CHILDREN, 0, scratch };
+        Clay__CompressChildrenAlongAxis(view, true, totalSizeToDistribute, resizableBuffer, scratchBuffer);
+
+        for (int32_t i = 0; i < childCount; ++i) {
+            if (memcmp(&dimensions[i].width, &expected[i].width, sizeof(float)) != 0) {
+                if (mismatches < 10) {
+                    printf("case %d child %d: %a (%g), expected %a (%g)\n", c, i, dimensions[i].width, dimensions[i].width, expected[i].width, expected[i].width);
+                }
+                mismatches++;
+                break;
+            }
+        }
+    }
+    printf("%d of %d rows differ\n", mismatches, cases);
+    return mismatches != 0;
+}
@@ -0,0 +1,130 @@
+// Collision and null id check for Clay__HashString and Clay__HashTextWithConfig.
+//
+// cc -O2 -std=c99 -I src tools/difftest/hash.c -o hash && ./hash [keys]
+//
+// Build it with and without -DCLAY_FAST_HASH to compare the two hashes. Hashes sets of generated keys ("Row%d", a
+// long shared prefix, the two mixed, random names, and one name with an index as the offset like CLAY_IDI) and
+// prints how long hashing each set ten times took and how many ids collide with another id of the same set. An
+// ideal 32 bit hash has about keys^2 / 2^33 collisions per set. Fails if any key hashes to zero, the null id.
+#define CLAY_IMPLEMENTATION
+#include "clay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define KEY_CAPACITY 48
+
+static uint64_t randomState = 88172645463325252ull;
+
+static uint32_t Random(void) {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return (uint32_t)randomState;
+}
+
+static int CompareIds(const void *a, const void *b) {
+    uint32_t left = *(const uint32_t *)a;
+    uint32_t right = *(const uint32_t *)b;
+    return left < right ? -1 : left > right;
+}
+
+static int CompareKeys(const void *a, const void *b) {
+    return strcmp((const char *)a, (const char *)b);
+}
+
+static int32_t CountCollisions(uint32_t *ids, int32_t count) {
+    qsort(ids, count, sizeof(uint32_t), CompareIds);
+    int32_t collisions = 0;
+    for (int32_t i = 1; i < count; i++) {
+        collisions += ids[i] == ids[i - 1];
+    }
+    return collisions;
+}
+
+typedef enum {
+    KEYS_ROW,
+    KEYS_LONG_PREFIX,
+    KEYS_MIXED,
+    KEYS_RANDOM,
+    KEYS_OFFSET,
+    KEYS_TEXT,
+} KeySet;
+
+static const char *keySetNames[] = { "Row%d", "long prefix", "mixed", "random names", "offsets", "text" };
+
+static void GenerateKeys(KeySet set, char (*keys)[KEY_CAPACITY], int32_t count) {
+    for (int32_t i = 0; i < count; i++) {
+        switch (set) {
+            case KEYS_ROW: snprintf(keys[i], KEY_CAPACITY, "Row%d", i); break;
+            case KEYS_LONG_PREFIX: snprintf(keys[i], KEY_CAPACITY, "SidebarNavigationItemButton_%d", i); break;
+            case KEYS_MIXED: snprintf(keys[i], KEY_CAPACITY, i % 2 ? "SidebarNavigationItemButton_%d" : "Row%d", i); break;
+            case KEYS_OFFSET: snprintf(keys[i], KEY_CAPACITY, "Row"); break;
+            default: {
+                int32_t length = 1 + (int32_t)(Random() % (KEY_CAPACITY - 1));
+                for (int32_t j = 0; j < length; j++) {
+                    keys[i][j] = set == KEYS_TEXT && Random() % 6 == 0 ? ' ' : (char)('a' + Random() % 26);
+                }
+                keys[i][length] = 0;
+            }
+        }
+    }
+}
+
+static uint32_t HashKey(KeySet set, char *key, int32_t index, uint32_t seed) {
+    Clay_String string = { (int32_t)strlen(key), key };
+    if (set == KEYS_TEXT) {
+        Clay_TextElementConfig config = { .fontSize = (uint16_t)(16 + seed), .hashStringContents = true };
+        return Clay__HashTextWithConfig(&string, &config);
+    }
+    return Clay__HashString(string, set == KEYS_OFFSET ? (uint32_t)index : 0, seed).id;
+}
+
+int main(int argc, char **argv) {
+    int32_t count = argc > 1 ? atoi(argv[1]) : 1000000;
+    char (*keys)[KEY_CAPACITY] = malloc((size_t)count * KEY_CAPACITY);
+    uint32_t *ids = malloc((size_t)count * sizeof(uint32_t));
+#ifdef CLAY_FAST_HASH
+    printf("CLAY_FAST_HASH, %d keys per set\n", count);
+#else
+    printf("byte at a time, %d keys per set\n", count);
+#endif
+    int32_t zeroIds = 0;
+    for (KeySet set = KEYS_ROW; set <= KEYS_TEXT; set++) {
+        GenerateKeys(set, keys, count);
+        uint32_t checksum = 0;
+        clock_t start = clock();
+        for (uint32_t seed = 0; seed < 10; seed++) {
+            for (int32_t i = 0; i < count; i++) {
+                checksum ^= HashKey(set, keys[i], i, seed);
+            }
+        }
+        double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+        for (int32_t i = 0; i < count; i++) {
+            ids[i] = HashKey(set, keys[i], i, 0);
+            if (ids[i] == 0) {
+                if (zeroIds < 10) {
+                    printf("%s: key %d (%s) has the null id\n", keySetNames[set], i, keys[i]);
+                }
+                zeroIds++;
+            }
+        }
+        // Random keys can repeat, those are not counted as collisions
+        if (set == KEYS_RANDOM || set == KEYS_TEXT) {
+            qsort(keys, count, KEY_CAPACITY, CompareKeys);
+            int32_t unique = 0;
+            for (int32_t i = 0; i < count; i++) {
+                if (i == 0 || strcmp(keys[i], keys[i - 1]) != 0) {
+                    ids[unique++] = HashKey(set, keys[i], i, 0);
+                }
+            }
+            printf("%-13s %.3fs, %d collisions (%d unique keys, checksum %08x)\n", keySetNames[set], seconds, CountCollisions(ids, unique), unique, checksum);
+            continue;
+        }
+        printf("%-13s %.3fs, %d collisions (checksum %08x)\n", keySetNames[set], seconds, CountCollisions(ids, count), checksum);
+    }
+    free(keys);
+    free(ids);
+    return zeroIds != 0;
+}
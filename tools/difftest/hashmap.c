@@ -0,0 +1,94 @@
+// Benchmark of the element id hash map.
+//
+// cc -O2 -std=c99 -I src tools/difftest/hashmap.c -o hashmap && ./hashmap [elements...]
+//
+// Declares frames of elements with numbered ids (8192, 20000 and 100000 by default) and looks every id up with
+// Clay_GetElementData, then looks up as many ids that were not declared. Prints the time per frame to declare the
+// elements and the time per lookup. Build it against the clay.h before and after a change to the map the same way
+// as layout.c, with -I pointing at the old header, and compare.
+#define _POSIX_C_SOURCE 199309L
+#define CLAY_IMPLEMENTATION
+#include "clay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define FRAMES 20
+#define LOOKUPS_PER_FRAME 10
+
+static void HandleError(Clay_ErrorData errorData) {
+    printf("error: %.*s\n", errorData.errorText.length, errorData.errorText.chars);
+    exit(1);
+}
+
+static double Now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec * 1000 + (double)time.tv_nsec / 1000000;
+}
+
+static void Run(int32_t elementCount) {
+    Clay_ContextOptions options = CLAY__DEFAULT_STRUCT;
+    // Leaves room for the root element declared by Clay_BeginLayout()
+    options.maxElementCount = elementCount + 100;
+    options.maxMeasureTextCacheWordCount = 16384;
+    uint32_t memorySize = Clay_MinMemorySizeWithOptions(options);
+    void *memory = malloc(memorySize);
+    Clay_InitializeWithOptions(Clay_CreateArenaWithCapacityAndMemory(memorySize, memory), CLAY__INIT(Clay_Dimensions) { 1920, 1080 }, CLAY__INIT(Clay_ErrorHandler) { HandleError, NULL }, options);
+
+    double declareTime = 0;
+    double hitTime = 0;
+    double missTime = 0;
+    int64_t hits = 0;
+    int64_t misses = 0;
+    for (int32_t frame = 0; frame < FRAMES; frame++) {
+        double start = Now();
+        Clay_BeginLayout();
+        for (int32_t i = 0; i < elementCount; i++) {
+            Clay__OpenElement();
+            Clay_ElementDeclaration declaration = CLAY__DEFAULT_STRUCT;
+            declaration.id = Clay__HashNumber((uint32_t)i, 77);
+            Clay__ConfigureOpenElement(declaration);
+            Clay__CloseElement();
+        }
+        declareTime += Now() - start;
+        Clay_EndLayout();
+
+        start = Now();
+        for (int32_t lookup = 0; lookup < LOOKUPS_PER_FRAME; lookup++) {
+            for (int32_t i = 0; i < elementCount; i++) {
+                hits += Clay_GetElementData(Clay__HashNumber((uint32_t)i, 77)).found;
+            }
+        }
+        hitTime += Now() - start;
+
+        start = Now();
+        for (int32_t lookup = 0; lookup < LOOKUPS_PER_FRAME; lookup++) {
+            for (int32_t i = 0; i < elementCount; i++) {
+                Clay_ElementId missing = CLAY__DEFAULT_STRUCT;
+                missing.id = Clay__HashNumber((uint32_t)i, 77).id * 2654435761u + 12345;
+                misses += !Clay_GetElementData(missing).found;
+            }
+        }
+        missTime += Now() - start;
+    }
+    double lookups = (double)FRAMES * LOOKUPS_PER_FRAME * elementCount;
+    // A missing id can only be found if it happens to collide with a declared one
+    printf("%6d elements: declare %.3f ms per frame, hit %.1f ns, miss %.1f ns (%.0f lookups, %lld hits, %lld misses)\n",
+        elementCount, declareTime / FRAMES, hitTime * 1000000 / lookups, missTime * 1000000 / lookups, lookups, (long long)hits, (long long)misses);
+    free(memory);
+}
+
+int main(int argc, char **argv) {
+    int32_t defaultCounts[] = { 8192, 20000, 100000 };
+    if (argc > 1) {
+        for (int32_t i = 1; i < argc; i++) {
+            Run(atoi(argv[i]));
+        }
+    } else {
+        for (int32_t i = 0; i < 3; i++) {
+            Run(defaultCounts[i]);
+        }
+    }
+    return 0;
+}
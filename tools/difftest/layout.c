@@ -0,0 +1,223 @@
+// Differential test for layout changes that must not change the output.
+//
+// cc -O2 -std=c99 -I src tools/difftest/layout.c -o layout -lm && ./layout [seeds]
+//
+// Declares a few frames of randomly generated layouts per seed (text, every sizing type, padding, gaps, borders, scroll
+// containers, images, ids and floating elements) and prints a hash of the render commands and of the hovered ids.
+// Build it against src/clay.h before and after a change and compare the hashes, e.g. with the old header from
+// git show <commit>:src/clay.h > /tmp/old/clay.h and -I /tmp/old instead of -I src. Define PARALLEL (with -lpthread),
+// COMPACT, RETAINED or GRID to turn on the matching Clay_ContextOptions, DUMP=1 in the environment prints every command.
+#define CLAY_IMPLEMENTATION
+#include "clay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(PARALLEL) || defined(COMPACT) || defined(RETAINED) || defined(GRID)
+#define WITH_OPTIONS
+#endif
+
+static uint64_t randomState;
+
+static uint32_t Random(void) {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return (uint32_t)randomState;
+}
+
+static float RandomFloat(float min, float max) {
+    return min + (max - min) * (float)(Random() % 1000) / 1000.0f;
+}
+
+static Clay_Dimensions MeasureText(Clay_StringSlice text, Clay_TextElementConfig *config, void *userData) {
+    (void) userData;
+    float width = 0;
+    for (int32_t i = 0; i < text.length; i++) {
+        width += text.chars[i] == ' ' ? 3 : (float)(5 + text.chars[i] % 3);
+    }
+    return CLAY__INIT(Clay_Dimensions) { width * config->fontSize / 10.0f, config->fontSize };
+}
+
+static void HandleError(Clay_ErrorData errorData) {
+    (void) errorData;
+}
+
+#ifdef PARALLEL
+#include <pthread.h>
+
+typedef struct {
+    void (*task)(void *data, int32_t index);
+    void *data;
+    int32_t count;
+    int32_t first;
+} ParallelJob;
+
+static void *RunParallelJob(void *argument) {
+    ParallelJob *job = argument;
+    for (int32_t i = job->first; i < job->count; i += 4) {
+        job->task(job->data, i);
+    }
+    return NULL;
+}
+
+static void ParallelFor(void (*task)(void *data, int32_t index), void *data, int32_t count, void *userData) {
+    (void) userData;
+    pthread_t threads[4];
+    ParallelJob jobs[4];
+    for (int32_t i = 0; i < 4; i++) {
+        jobs[i] = CLAY__INIT(ParallelJob) { task, data, count, i };
+        pthread_create(&threads[i], NULL, RunParallelJob, &jobs[i]);
+    }
+    for (int32_t i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+#endif
+
+static const char *words[] = { "alpha", "be", "gamma delta", "x", "lorem ipsum dolor sit amet", "a\nb c", "wrap me please now", "", "longwordwithoutspaces", "one two three four five six seven" };
+static char idNames[64][16];
+static Clay_TextElementConfig textConfigs[4];
+static int32_t floatingCount = 0;
+
+static Clay_SizingAxis RandomSizingAxis(void) {
+    switch (Random() % 5) {
+        case 0: return CLAY_SIZING_FIT(0);
+        case 1: return CLAY_SIZING_GROW(0);
+        case 2: return CLAY_SIZING_FIXED(RandomFloat(5, 200));
+        case 3: return CLAY_SIZING_PERCENT(RandomFloat(0.05f, 0.6f));
+        default: return CLAY_SIZING_FIT(RandomFloat(0, 30), RandomFloat(40, 300));
+    }
+}
+
+static void DeclareChildren(int32_t depth, int32_t *budget) {
+    int32_t childCount = depth > 5 ? 0 : (int32_t)(Random() % 6);
+    for (int32_t i = 0; i < childCount && *budget > 0; i++) {
+        (*budget)--;
+        if (Random() % 10 < 3) {
+            Clay_TextElementConfig *config = &textConfigs[Random() % 4];
+            const char *word = words[Random() % 10];
+            Clay__OpenTextElement(CLAY__INIT(Clay_String) { (int32_t)strlen(word), word }, config);
+            continue;
+        }
+        Clay__OpenElement();
+        Clay_ElementDeclaration declaration = CLAY__DEFAULT_STRUCT;
+        declaration.layout.sizing.width = RandomSizingAxis();
+        declaration.layout.sizing.height = RandomSizingAxis();
+        declaration.layout.layoutDirection = (Clay_LayoutDirection)(Random() % 2);
+        declaration.layout.childGap = (uint16_t)(Random() % 8);
+        declaration.layout.padding = CLAY__INIT(Clay_Padding) { (uint16_t)(Random() % 6), (uint16_t)(Random() % 6), (uint16_t)(Random() % 6), (uint16_t)(Random() % 6) };
+        declaration.layout.childAlignment.x = (Clay_LayoutAlignmentX)(Random() % 3);
+        declaration.layout.childAlignment.y = (Clay_LayoutAlignmentY)(Random() % 3);
+        if (Random() % 2) {
+            declaration.backgroundColor = CLAY__INIT(Clay_Color) { (float)(Random() % 255), 10, 10, 255 };
+        }
+        if (Random() % 5 == 0) {
+            declaration.border = CLAY__INIT(Clay_BorderElementConfig) { { 1, 2, 3, 255 }, { 1, 1, 1, 1, (uint16_t)(Random() % 2) } };
+        }
+        if (Random() % 7 == 0) {
+            declaration.scroll.vertical = Random() % 2;
+            declaration.scroll.horizontal = !declaration.scroll.vertical || Random() % 2;
+        }
+        if (Random() % 9 == 0) {
+            declaration.image.imageData = (void *)1;
+            declaration.image.sourceDimensions = CLAY__INIT(Clay_Dimensions) { RandomFloat(10, 100), RandomFloat(10, 100) };
+        }
+        if (Random() % 6 == 0) {
+            int32_t name = (int32_t)(Random() % 64);
+            snprintf(idNames[name], sizeof(idNames[name]), "id%d_%d", name, *budget);
+            declaration.id = Clay__HashString(CLAY__INIT(Clay_String) { (int32_t)strlen(idNames[name]), idNames[name] }, 0, 0);
+        }
+        if (depth > 0 && Random() % 12 == 0 && floatingCount < 40) {
+            floatingCount++;
+            declaration.floating.attachTo = CLAY_ATTACH_TO_PARENT;
+            declaration.floating.zIndex = (int16_t)(Random() % 5) - 2;
+            declaration.floating.offset = CLAY__INIT(Clay_Vector2) { RandomFloat(-20, 20), RandomFloat(-20, 20) };
+            declaration.floating.attachPoints.parent = (Clay_FloatingAttachPointType)(Random() % 9);
+            declaration.floating.attachPoints.element = (Clay_FloatingAttachPointType)(Random() % 9);
+            declaration.floating.pointerCaptureMode = (Clay_PointerCaptureMode)(Random() % 2);
+        }
+        Clay__ConfigureOpenElement(declaration);
+        DeclareChildren(depth + 1, budget);
+        Clay__CloseElement();
+    }
+}
+
+static uint64_t HashBytes(uint64_t hash, const char *bytes, int32_t length) {
+    for (int32_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+int main(int argc, char **argv) {
+    int32_t seeds = argc > 1 ? atoi(argv[1]) : 200;
+    bool dump = getenv("DUMP") != NULL;
+#ifdef WITH_OPTIONS
+    Clay_ContextOptions options = CLAY__DEFAULT_STRUCT;
+    options.maxElementCount = 20000;
+    options.maxMeasureTextCacheWordCount = 16384;
+#ifdef PARALLEL
+    options.parallelLayoutRoots = true;
+#endif
+#ifdef COMPACT
+    options.compactLayoutSizing = true;
+#endif
+#ifdef RETAINED
+    options.retainedLayoutSizing = true;
+#endif
+#ifdef GRID
+    options.pointerHitTestGrid = true;
+#endif
+    uint32_t memorySize = Clay_MinMemorySizeWithOptions(options);
+    Clay_Context *context = Clay_InitializeWithOptions(Clay_CreateArenaWithCapacityAndMemory(memorySize, malloc(memorySize)), CLAY__INIT(Clay_Dimensions) { 1024, 768 }, CLAY__INIT(Clay_ErrorHandler) { HandleError, NULL }, options);
+#else
+    Clay_SetMaxElementCount(20000);
+    uint32_t memorySize = Clay_MinMemorySize();
+    Clay_Context *context = Clay_Initialize(Clay_CreateArenaWithCapacityAndMemory(memorySize, malloc(memorySize)), CLAY__INIT(Clay_Dimensions) { 1024, 768 }, CLAY__INIT(Clay_ErrorHandler) { HandleError, NULL });
+#endif
+    Clay_SetMeasureTextFunction(MeasureText, NULL);
+#ifdef PARALLEL
+    Clay_SetParallelForFunction(ParallelFor, NULL);
+#endif
+    for (int32_t i = 0; i < 4; i++) {
+        textConfigs[i] = CLAY__INIT(Clay_TextElementConfig) { .textColor = { 1, 2, 3, 4 }, .fontSize = (uint16_t)(8 + i * 4), .lineHeight = (uint16_t)(i == 3 ? 20 : 0), .wrapMode = (Clay_TextElementConfigWrapMode)(i % 3) };
+    }
+
+    uint64_t hash = 1469598103934665603ull;
+    for (int32_t seed = 0; seed < seeds; seed++) {
+        randomState = 88172645463325252ull ^ (uint64_t)((uint32_t)seed * 2654435761u);
+        // A few frames per seed so state kept between frames (scrolling, hover, caches) is covered
+        for (int32_t frame = 0; frame < 3; frame++) {
+            uint64_t frameState = randomState;
+            Clay_SetLayoutDimensions(CLAY__INIT(Clay_Dimensions) { RandomFloat(300, 1400), RandomFloat(300, 900) });
+            Clay_SetPointerState(CLAY__INIT(Clay_Vector2) { RandomFloat(0, 1000), RandomFloat(0, 700) }, Random() % 2);
+            Clay_UpdateScrollContainers(true, CLAY__INIT(Clay_Vector2) { RandomFloat(-3, 3), RandomFloat(-3, 3) }, 0.016f);
+            Clay_BeginLayout();
+            int32_t budget = 60 + (int32_t)(Random() % 400);
+            floatingCount = 0;
+            DeclareChildren(0, &budget);
+            Clay_RenderCommandArray commands = Clay_EndLayout();
+            for (int32_t i = 0; i < commands.length; i++) {
+                Clay_RenderCommand *command = &commands.internalArray[i];
+                char line[512];
+                int32_t length = snprintf(line, sizeof(line), "%d %u %d %.2f %.2f %.2f %.2f", command->commandType, command->id, command->zIndex, command->boundingBox.x, command->boundingBox.y, command->boundingBox.width, command->boundingBox.height);
+                if (command->commandType == CLAY_RENDER_COMMAND_TYPE_TEXT) {
+                    length += snprintf(line + length, sizeof(line) - length, " %.*s", command->renderData.text.stringContents.length, command->renderData.text.stringContents.chars);
+                }
+                if (dump) {
+                    printf("%d %d: %s\n", seed, frame, line);
+                }
+                hash = HashBytes(hash, line, length);
+            }
+            for (int32_t i = 0; i < context->pointerOverIds.length; i++) {
+                hash ^= context->pointerOverIds.internalArray[i].id;
+                hash *= 1099511628211ull;
+            }
+            randomState = frameState ^ 1234567;
+        }
+    }
+    printf("%016llx\n", (unsigned long long)hash);
+    return 0;
+}
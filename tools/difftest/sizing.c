@@ -0,0 +1,157 @@
+// Benchmark of the sizing pass along the X axis with and without compactLayoutSizing.
+//
+// cc -O2 -std=c99 -I src tools/difftest/sizing.c -o sizing && ./sizing [containers...]
+//
+// Declares a generated tree of each size (10k to 100k containers by default, plus the text elements in them) with
+// fit, grow, percent and fixed sizing and wrapped text, then runs the X pass over the layout elements and over the
+// compact copy from the same starting sizes. Prints the best and median time of each and of building the compact
+// copy, which happens once per frame. Fails if the two passes give an element a different width.
+#define _POSIX_C_SOURCE 199309L
+#define CLAY_IMPLEMENTATION
+#include "clay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define RUNS 61
+
+static uint64_t randomState;
+
+static uint32_t Random(void) {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return (uint32_t)randomState;
+}
+
+static Clay_Dimensions MeasureText(Clay_StringSlice text, Clay_TextElementConfig *config, void *userData) {
+    (void) config;
+    (void) userData;
+    return CLAY__INIT(Clay_Dimensions) { (float)text.length * 7, 14 };
+}
+
+static void HandleError(Clay_ErrorData errorData) {
+    (void) errorData;
+}
+
+static double Now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec * 1000 + (double)time.tv_nsec / 1000000;
+}
+
+static int CompareTimes(const void *a, const void *b) {
+    double left = *(const double *)a;
+    double right = *(const double *)b;
+    return left < right ? -1 : left > right;
+}
+
+static Clay_TextElementConfig textConfig = { .fontSize = 12, .wrapMode = CLAY_TEXT_WRAP_WORDS };
+
+static void DeclareChildren(int32_t depth, int32_t *budget) {
+    int32_t childCount = depth == 0 ? 40 : 2 + (int32_t)(Random() % 6);
+    for (int32_t i = 0; i < childCount && *budget > 0; i++) {
+        (*budget)--;
+        Clay__OpenElement();
+        Clay_ElementDeclaration declaration = CLAY__DEFAULT_STRUCT;
+        declaration.layout.layoutDirection = (Clay_LayoutDirection)(Random() % 2);
+        declaration.layout.padding = CLAY__INIT(Clay_Padding) { 2, 2, 2, 2 };
+        declaration.layout.childGap = 2;
+        switch (Random() % 4) {
+            case 0: declaration.layout.sizing.width = CLAY_SIZING_GROW(0); break;
+            case 1: declaration.layout.sizing.width = CLAY_SIZING_FIT(0); break;
+            case 2: declaration.layout.sizing.width = CLAY_SIZING_PERCENT(0.2f); break;
+            default: declaration.layout.sizing.width = CLAY_SIZING_FIXED(20); break;
+        }
+        declaration.layout.sizing.height = Random() % 2 ? CLAY_SIZING_GROW(0) : CLAY_SIZING_FIT(0);
+        declaration.backgroundColor = CLAY__INIT(Clay_Color) { 1, 2, 3, 255 };
+        Clay__ConfigureOpenElement(declaration);
+        if (depth < 12 && Random() % 4) {
+            DeclareChildren(depth + 1, budget);
+        } else {
+            Clay__OpenTextElement(CLAY_STRING("hello world"), &textConfig);
+        }
+        Clay__CloseElement();
+    }
+}
+
+static bool Run(int32_t containerCount) {
+    Clay_ContextOptions options = CLAY__DEFAULT_STRUCT;
+    options.maxElementCount = containerCount * 3 + 1000;
+    options.maxMeasureTextCacheWordCount = 16384;
+    options.compactLayoutSizing = true;
+    uint32_t memorySize = Clay_MinMemorySizeWithOptions(options);
+    void *memory = malloc(memorySize);
+    Clay_Context *context = Clay_InitializeWithOptions(Clay_CreateArenaWithCapacityAndMemory(memorySize, memory), CLAY__INIT(Clay_Dimensions) { 1920, 1080 }, CLAY__INIT(Clay_ErrorHandler) { HandleError, NULL }, options);
+    Clay_SetMeasureTextFunction(MeasureText, NULL);
+
+    randomState = 12345;
+    Clay_BeginLayout();
+    int32_t budget = containerCount;
+    DeclareChildren(0, &budget);
+    // Clay_EndLayout() closes the root before calculating the layout
+    Clay__CloseElement();
+
+    int32_t count = context->layoutElements.length;
+    Clay_Dimensions *initial = malloc(count * sizeof(Clay_Dimensions));
+    float *widths = malloc(count * sizeof(float));
+    for (int32_t i = 0; i < count; i++) {
+        initial[i] = context->layoutElements.internalArray[i].dimensions;
+    }
+    double elementTimes[RUNS], compactTimes[RUNS], buildTimes[RUNS];
+    bool same = true;
+    for (int32_t run = 0; run < RUNS && same; run++) {
+        for (int32_t i = 0; i < count; i++) {
+            context->layoutElements.internalArray[i].dimensions = initial[i];
+        }
+        double start = Now();
+        for (int32_t rootIndex = 0; rootIndex < context->layoutElementTreeRoots.length; ++rootIndex) {
+            Clay__SizeLayoutRootAlongAxis(&context->layoutElementTreeRoots.internalArray[rootIndex], true, context->layoutElementChildrenBuffer, context->openLayoutElementStack, context->openClipElementStack);
+        }
+        elementTimes[run] = Now() - start;
+        for (int32_t i = 0; i < count; i++) {
+            widths[i] = context->layoutElements.internalArray[i].dimensions.width;
+            context->layoutElements.internalArray[i].dimensions = initial[i];
+        }
+
+        start = Now();
+        context->compactElementIndexes.length = 0;
+        Clay__BuildCompactLayout(context);
+        double built = Now();
+        Clay__SizeCompactLayoutAlongAxis(context, true);
+        compactTimes[run] = Now() - built;
+        buildTimes[run] = built - start;
+        for (int32_t i = 0; i < count && same; i++) {
+            if (context->layoutElements.internalArray[i].dimensions.width != widths[i]) {
+                printf("%d layout elements: element %d is %.2f wide with the compact copy, %.2f without\n", count, i, context->layoutElements.internalArray[i].dimensions.width, widths[i]);
+                same = false;
+            }
+        }
+    }
+    if (same) {
+        qsort(elementTimes, RUNS, sizeof(double), CompareTimes);
+        qsort(compactTimes, RUNS, sizeof(double), CompareTimes);
+        qsort(buildTimes, RUNS, sizeof(double), CompareTimes);
+        printf("%6d layout elements: element pass %.3f ms (median %.3f), compact pass %.3f ms (median %.3f), compact copy %.3f ms (median %.3f)\n",
+            count, elementTimes[0], elementTimes[RUNS / 2], compactTimes[0], compactTimes[RUNS / 2], buildTimes[0], buildTimes[RUNS / 2]);
+    }
+    free(initial);
+    free(widths);
+    free(memory);
+    return same;
+}
+
+int main(int argc, char **argv) {
+    int32_t defaultCounts[] = { 10000, 25000, 50000, 100000 };
+    bool same = true;
+    if (argc > 1) {
+        for (int32_t i = 1; i < argc; i++) {
+            same = Run(atoi(argv[i])) && same;
+        }
+    } else {
+        for (int32_t i = 0; i < 4; i++) {
+            same = Run(defaultCounts[i]) && same;
+        }
+    }
+    return !same;
+}
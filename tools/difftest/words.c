@@ -0,0 +1,176 @@
+// Differential test for the word lists of Clay__MeasureTextCached against the original byte loop.
+//
+// cc -O2 -std=c99 -I src tools/difftest/words.c -o words && ./words [strings]
+//
+// Build it once per implementation of Clay__FindNextWordBoundary: as is for SSE2 (or NEON on arm64), with -mavx2 for
+// AVX2 and with -DCLAY_DISABLE_SIMD for the scalar loop. Generates random strings with spaces and newlines at every
+// length and alignment around the vector widths, measures them and compares each Clay__MeasuredWord (offset, length,
+// width), the unwrapped dimensions and containsNewlines with what the original loop produces. Also checks
+// Clay__FindNextWordBoundary from every index. Prints the strings that differ and fails if there are any.
+#define CLAY_IMPLEMENTATION
+#include "clay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LENGTH 300
+
+static uint64_t randomState = 7;
+
+static uint32_t Random(void) {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return (uint32_t)randomState;
+}
+
+static Clay_Dimensions MeasureText(Clay_StringSlice text, Clay_TextElementConfig *config, void *userData) {
+    (void) userData;
+    float width = 0;
+    for (int32_t i = 0; i < text.length; i++) {
+        width += (float)(5 + text.chars[i] % 3);
+    }
+    return CLAY__INIT(Clay_Dimensions) { width * config->fontSize / 10.0f, config->fontSize };
+}
+
+static void HandleError(Clay_ErrorData errorData) {
+    printf("error: %.*s\n", errorData.errorText.length, errorData.errorText.chars);
+    exit(1);
+}
+
+typedef struct {
+    Clay__MeasuredWord words[MAX_LENGTH * 2 + 1];
+    int32_t wordCount;
+    Clay_Dimensions unwrappedDimensions;
+    bool containsNewlines;
+} MeasuredText;
+
+static void AddWord(MeasuredText *measured, int32_t startOffset, int32_t length, float width) {
+    measured->words[measured->wordCount++] = CLAY__INIT(Clay__MeasuredWord) { .startOffset = startOffset, .length = length, .width = width, .next = -1 };
+}
+
+// The word splitting loop of Clay__MeasureTextCached from upstream clay, looking at one character at a time
+static void ReferenceMeasure(Clay_String *text, Clay_TextElementConfig *config, MeasuredText *measured) {
+    int32_t start = 0;
+    int32_t end = 0;
+    float lineWidth = 0;
+    float measuredWidth = 0;
+    float measuredHeight = 0;
+    float spaceWidth = MeasureText(CLAY__INIT(Clay_StringSlice) { .length = 1, .chars = CLAY__SPACECHAR.chars, .baseChars = CLAY__SPACECHAR.chars }, config, NULL).width;
+    memset(measured, 0, sizeof(*measured));
+    while (end < text->length) {
+        char current = text->chars[end];
+        if (current == ' ' || current == '\n') {
+            int32_t length = end - start;
+            Clay_Dimensions dimensions = MeasureText(CLAY__INIT(Clay_StringSlice) { .length = length, .chars = &text->chars[start], .baseChars = text->chars }, config, NULL);
+            measuredHeight = CLAY__MAX(measuredHeight, dimensions.height);
+            if (current == ' ') {
+                dimensions.width += spaceWidth;
+                AddWord(measured, start, length + 1, dimensions.width);
+                lineWidth += dimensions.width;
+            }
+            if (current == '\n') {
+                if (length > 0) {
+                    AddWord(measured, start, length, dimensions.width);
+                }
+                AddWord(measured, end + 1, 0, 0);
+                lineWidth += dimensions.width;
+                measuredWidth = CLAY__MAX(lineWidth, measuredWidth);
+                measured->containsNewlines = true;
+                lineWidth = 0;
+            }
+            start = end + 1;
+        }
+        end++;
+    }
+    if (end - start > 0) {
+        Clay_Dimensions dimensions = MeasureText(CLAY__INIT(Clay_StringSlice) { .length = end - start, .chars = &text->chars[start], .baseChars = text->chars }, config, NULL);
+        AddWord(measured, start, end - start, dimensions.width);
+        lineWidth += dimensions.width;
+        measuredHeight = CLAY__MAX(measuredHeight, dimensions.height);
+    }
+    measuredWidth = CLAY__MAX(lineWidth, measuredWidth);
+    measured->unwrappedDimensions = CLAY__INIT(Clay_Dimensions) { measuredWidth, measuredHeight };
+}
+
+static bool SameWords(Clay_Context *context, Clay__MeasureTextCacheItem *item, MeasuredText *expected) {
+    if (item->containsNewlines != expected->containsNewlines || item->unwrappedDimensions.width != expected->unwrappedDimensions.width || item->unwrappedDimensions.height != expected->unwrappedDimensions.height) {
+        return false;
+    }
+    int32_t count = 0;
+    for (int32_t i = item->measuredWordsStartIndex; i != -1; i = context->measuredWords.internalArray[i].next) {
+        Clay__MeasuredWord *word = &context->measuredWords.internalArray[i];
+        if (count == expected->wordCount) {
+            return false;
+        }
+        Clay__MeasuredWord *expectedWord = &expected->words[count++];
+        if (word->startOffset != expectedWord->startOffset || word->length != expectedWord->length || word->width != expectedWord->width) {
+            return false;
+        }
+    }
+    return count == expected->wordCount;
+}
+
+int main(int argc, char **argv) {
+    int32_t strings = argc > 1 ? atoi(argv[1]) : 200000;
+#if defined(CLAY_DISABLE_SIMD) || !(defined(__x86_64__) || defined(_M_X64) || defined(_M_AMD64) || defined(__aarch64__))
+    const char *implementation = "scalar";
+#elif defined(__aarch64__)
+    const char *implementation = "NEON";
+#elif defined(__AVX2__)
+    const char *implementation = "AVX2";
+#else
+    const char *implementation = "SSE2";
+#endif
+    Clay_SetMaxElementCount(1 << 12);
+    Clay_SetMaxMeasureTextCacheWordCount(1 << 16);
+    uint32_t memorySize = Clay_MinMemorySize();
+    Clay_Context *context = Clay_Initialize(Clay_CreateArenaWithCapacityAndMemory(memorySize, malloc(memorySize)), CLAY__INIT(Clay_Dimensions) { 1024, 768 }, CLAY__INIT(Clay_ErrorHandler) { HandleError, NULL });
+    Clay_SetMeasureTextFunction(MeasureText, NULL);
+
+    static char buffer[MAX_LENGTH + 64];
+    static MeasuredText expected;
+    int32_t mismatches = 0;
+    for (int32_t s = 0; s < strings; ++s) {
+        // Sweep short lengths and every alignment, with sparse separators some of the time so words cross vector widths
+        int32_t length = s < MAX_LENGTH * 64 ? s / 64 : (int32_t)(Random() % MAX_LENGTH);
+        int32_t alignment = s % 64 < 32 ? s % 32 : (int32_t)(Random() % 32);
+        uint32_t separatorOdds = 2 + Random() % (s % 3 == 0 ? 100 : 10);
+        char *chars = buffer + alignment;
+        for (int32_t i = 0; i < length; i++) {
+            uint32_t r = Random() % separatorOdds;
+            chars[i] = r == 0 ? ' ' : r == 1 && Random() % 2 ? '\n' : (char)('a' + Random() % 26);
+        }
+        // A separator right after the string must not be found
+        chars[length] = ' ';
+
+        bool differs = false;
+        for (int32_t i = 0; i <= length && !differs; i++) {
+            int32_t boundary = i;
+            while (boundary < length && chars[boundary] != ' ' && chars[boundary] != '\n') {
+                boundary++;
+            }
+            if (Clay__FindNextWordBoundary(chars, i, length) != boundary) {
+                if (mismatches < 10) {
+                    printf("string %d (length %d, alignment %d): boundary from %d is %d, expected %d\n", s, length, alignment, i, Clay__FindNextWordBoundary(chars, i, length), boundary);
+                }
+                differs = true;
+            }
+        }
+
+        Clay_String text = { length, chars };
+        Clay_TextElementConfig config = { .fontSize = (uint16_t)(10 + s % 7), .hashStringContents = true };
+        ReferenceMeasure(&text, &config, &expected);
+        Clay__MeasureTextCacheItem *item = Clay__MeasureTextCached(&text, &config);
+        if (!SameWords(context, item, &expected)) {
+            if (mismatches < 10) {
+                printf("string %d (length %d, alignment %d): word lists differ\n", s, length, alignment);
+            }
+            differs = true;
+        }
+        mismatches += differs;
+        Clay_ResetMeasureTextCache();
+    }
+    printf("%s: %d of %d strings differ\n", implementation, mismatches, strings);
+    return mismatches != 0;
+}